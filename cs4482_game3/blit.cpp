@@ -0,0 +1,325 @@
+#include "cs3388lib.h"
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+
+// The compositing half of cs3388lib: every operation clips its rectangles,
+// then runs one row kernel per row. Kernels handle four pixels per SSE2
+// register and finish the odd ones a pixel at a time.
+
+// clip_blit
+//    Clips the copy of src's rectangle (sx0,sy0)-(sx1,sy1) to (x,y) in dst
+//    against both bitmaps. Returns false if nothing is left.
+//
+static bool clip_blit(const bitmap* dst, int& x, int& y, const bitmap* src, int& sx0, int& sy0, int& sx1, int& sy1)
+{
+	if (sx0 < 0) { x -= sx0; sx0 = 0; }
+	if (sy0 < 0) { y -= sy0; sy0 = 0; }
+	sx1 = std::min(sx1,src->wd);
+	sy1 = std::min(sy1,src->ht);
+	if (x < 0) { sx0 -= x; x = 0; }
+	if (y < 0) { sy0 -= y; y = 0; }
+	sx1 = std::min(sx1,sx0 + dst->wd - x);
+	sy1 = std::min(sy1,sy0 + dst->ht - y);
+	return sx0 < sx1 && sy0 < sy1;
+}
+
+// x/255 for each 16-bit x up to 255*255, rounded
+static inline __m128i div255(__m128i x)
+{
+	x = _mm_add_epi16(x,_mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x,_mm_srli_epi16(x,8)),8);
+}
+
+static inline unsigned div255(unsigned x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+// each pixel's alpha in all four of its 16-bit lanes
+static inline __m128i spread_alpha(__m128i x)
+{
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+}
+
+// over
+//    Four premultiplied pixels s over four pixels d: s + d*(255 - s.a)/255.
+//
+static inline __m128i over(__m128i s, __m128i d)
+{
+	__m128i zero = _mm_setzero_si128(), full = _mm_set1_epi16(255);
+	__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d,zero),_mm_sub_epi16(full,spread_alpha(_mm_unpacklo_epi8(s,zero))));
+	__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d,zero),_mm_sub_epi16(full,spread_alpha(_mm_unpackhi_epi8(s,zero))));
+	return _mm_adds_epu8(s,_mm_packus_epi16(div255(lo),div255(hi)));
+}
+
+static void blend_row(unsigned char* d, const unsigned char* s, int n)
+{
+	__m128i zero = _mm_setzero_si128(), ones = _mm_cmpeq_epi8(zero,zero);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i*)(s + 4*i));
+		int opaque = _mm_movemask_epi8(_mm_cmpeq_epi8(p,ones)) & 0x8888;
+		if (opaque == 0x8888) {
+			_mm_storeu_si128((__m128i*)(d + 4*i),p);
+		} else if (_mm_movemask_epi8(_mm_cmpeq_epi8(p,zero)) != 0xffff) {
+			__m128i* q = (__m128i*)(d + 4*i);
+			_mm_storeu_si128(q,over(p,_mm_loadu_si128(q)));
+		}
+	}
+	for (; i < n; ++i) {
+		const unsigned char* p = s + 4*i;
+		unsigned char* q = d + 4*i;
+		unsigned inv = 255 - p[3];
+		for (int c = 0; c < 4; ++c)
+			q[c] = (unsigned char)std::min(255u,p[c] + div255(q[c]*inv));
+	}
+}
+
+static void key_row(unsigned char* d, const unsigned char* s, int n, unsigned key)
+{
+	__m128i rgb = _mm_set1_epi32(0x00ffffff), k = _mm_set1_epi32((int)key);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i*)(s + 4*i));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(p,rgb),k);
+		int m = _mm_movemask_epi8(keyed);
+		if (m == 0) {
+			_mm_storeu_si128((__m128i*)(d + 4*i),p);
+		} else if (m != 0xffff) {
+			__m128i* q = (__m128i*)(d + 4*i);
+			_mm_storeu_si128(q,_mm_or_si128(_mm_and_si128(keyed,_mm_loadu_si128(q)),_mm_andnot_si128(keyed,p)));
+		}
+	}
+	for (; i < n; ++i) {
+		unsigned p;
+		memcpy(&p,s + 4*i,4);
+		if ((p & 0x00ffffff) != key)
+			memcpy(d + 4*i,&p,4);
+	}
+}
+
+static void premultiply_row(unsigned char* p, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i keep_alpha = _mm_set_epi16(255,0,0,0,255,0,0,0);
+	__m128i colour = _mm_set_epi16(0,-1,-1,-1,0,-1,-1,-1);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i* q = (__m128i*)(p + 4*i);
+		__m128i x = _mm_loadu_si128(q);
+		__m128i lo = _mm_unpacklo_epi8(x,zero), hi = _mm_unpackhi_epi8(x,zero);
+		lo = _mm_mullo_epi16(lo,_mm_or_si128(_mm_and_si128(spread_alpha(lo),colour),keep_alpha));
+		hi = _mm_mullo_epi16(hi,_mm_or_si128(_mm_and_si128(spread_alpha(hi),colour),keep_alpha));
+		_mm_storeu_si128(q,_mm_packus_epi16(div255(lo),div255(hi)));
+	}
+	for (; i < n; ++i) {
+		unsigned char* q = p + 4*i;
+		for (int c = 0; c < 3; ++c)
+			q[c] = (unsigned char)div255(q[c]*q[3]);
+	}
+}
+
+////////////////////////////////////////////////////////////////
+
+void bitmap_blit(bitmap* dst, int x, int y, const bitmap* src, int sx0, int sy0, int sx1, int sy1)
+{
+	if (!clip_blit(dst,x,y,src,sx0,sy0,sx1,sy1))
+		return;
+	bitmap_dirty(dst,x,y,x + sx1-sx0,y + sy1-sy0);
+
+	size_t row = 4*(size_t)(sx1-sx0);
+	int n = sy1-sy0;
+	bool upward = src == dst && y > sy0;   // overlapping rows must be moved last-first
+	for (int i = 0; i < n; ++i) {
+		int r = upward ? n-1-i : i;
+		memmove(dst->pixels + 4*((size_t)dst->wd*(y+r) + x),src->pixels + 4*((size_t)src->wd*(sy0+r) + sx0),row);
+	}
+}
+
+void bitmap_blend(bitmap* dst, int x, int y, const bitmap* src, int sx0, int sy0, int sx1, int sy1)
+{
+	if (!clip_blit(dst,x,y,src,sx0,sy0,sx1,sy1))
+		return;
+	bitmap_dirty(dst,x,y,x + sx1-sx0,y + sy1-sy0);
+	for (int r = 0; r < sy1-sy0; ++r)
+		blend_row(dst->pixels + 4*((size_t)dst->wd*(y+r) + x),src->pixels + 4*((size_t)src->wd*(sy0+r) + sx0),sx1-sx0);
+}
+
+void bitmap_blitkey(bitmap* dst, int x, int y, const bitmap* src, int sx0, int sy0, int sx1, int sy1,
+                    unsigned char r, unsigned char g, unsigned char b)
+{
+	if (!clip_blit(dst,x,y,src,sx0,sy0,sx1,sy1))
+		return;
+	bitmap_dirty(dst,x,y,x + sx1-sx0,y + sy1-sy0);
+	unsigned key = (unsigned)r << 16 | g << 8 | b;
+	for (int i = 0; i < sy1-sy0; ++i)
+		key_row(dst->pixels + 4*((size_t)dst->wd*(y+i) + x),src->pixels + 4*((size_t)src->wd*(sy0+i) + sx0),sx1-sx0,key);
+}
+
+void bitmap_premultiply(bitmap* bm)
+{
+	premultiply_row(bm->pixels,bm->wd*bm->ht);
+	bitmap_dirty(bm,0,0,bm->wd,bm->ht);
+}
+
+////////////////////////////////////////////////////////////////
+
+// sample_position
+//    Where the centre of pixel i of n lands among m source pixels, in
+//    1/65536ths of a source pixel, measured from the first one's centre.
+//
+static long long sample_position(int i, int n, int m)
+{
+	return ((2*(long long)i + 1)*m*65536)/(2*n) - 32768;
+}
+
+// lerp_rows
+//    Blends rows a and b (n pixels each) by f/256 into out.
+//
+static void lerp_rows(unsigned char* out, const unsigned char* a, const unsigned char* b, int n, int f)
+{
+	if (f == 0) {
+		memcpy(out,a,4*(size_t)n);
+		return;
+	}
+	__m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+	__m128i wa = _mm_set1_epi16((short)(256-f)), wb = _mm_set1_epi16((short)f);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(a + 4*i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(b + 4*i));
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x,zero),wa),_mm_mullo_epi16(_mm_unpacklo_epi8(y,zero),wb));
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x,zero),wa),_mm_mullo_epi16(_mm_unpackhi_epi8(y,zero),wb));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo,half),8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi,half),8);
+		_mm_storeu_si128((__m128i*)(out + 4*i),_mm_packus_epi16(lo,hi));
+	}
+	for (i *= 4; i < 4*n; ++i)
+		out[i] = (unsigned char)((a[i]*(256-f) + b[i]*f + 128) >> 8);
+}
+
+// lerp_columns
+//    Pixel i of out blends pixels xs[i] and xs[i]+1 of 'row' with the
+//    weights in w[8*i..8*i+7] (256-f four times, then f four times).
+//
+static void lerp_columns(unsigned char* out, const unsigned char* row, const int* xs, const short* w, int n)
+{
+	__m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row + 4*xs[i])),zero);
+		__m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row + 4*xs[i+1])),zero);
+		a = _mm_mullo_epi16(a,_mm_loadu_si128((const __m128i*)(w + 8*i)));
+		b = _mm_mullo_epi16(b,_mm_loadu_si128((const __m128i*)(w + 8*i + 8)));
+		__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(a,b),_mm_unpackhi_epi64(a,b));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum,half),8);
+		_mm_storel_epi64((__m128i*)(out + 4*i),_mm_packus_epi16(sum,zero));
+	}
+	for (; i < n; ++i) {
+		const unsigned char* p = row + 4*xs[i];
+		int f = w[8*i+4];
+		for (int c = 0; c < 4; ++c)
+			out[4*i+c] = (unsigned char)((p[c]*(256-f) + p[c+4]*f + 128) >> 8);
+	}
+}
+
+void bitmap_stretch(bitmap* dst, int x0, int y0, int x1, int y1,
+                    const bitmap* src, int sx0, int sy0, int sx1, int sy1, int flags)
+{
+	sx0 = std::max(sx0,0); sy0 = std::max(sy0,0);
+	sx1 = std::min(sx1,src->wd); sy1 = std::min(sy1,src->ht);
+	if (sx0 >= sx1 || sy0 >= sy1 || x0 >= x1 || y0 >= y1)
+		return;
+	int sw = sx1-sx0, sh = sy1-sy0, dw = x1-x0, dh = y1-y0;
+	if (sw == dw && sh == dh) {
+		if (flags & BLIT_BLEND)
+			bitmap_blend(dst,x0,y0,src,sx0,sy0,sx1,sy1);
+		else
+			bitmap_blit(dst,x0,y0,src,sx0,sy0,sx1,sy1);
+		return;
+	}
+
+	int cx0 = std::max(x0,0), cy0 = std::max(y0,0);
+	int cx1 = std::min(x1,dst->wd), cy1 = std::min(y1,dst->ht);
+	if (cx0 >= cx1 || cy0 >= cy1)
+		return;
+	bitmap_dirty(dst,cx0,cy0,cx1,cy1);
+	int n = cx1-cx0;
+	std::vector<unsigned char> scaled(4*(size_t)n);
+	std::vector<int> xs(n);
+
+	if (!(flags & BLIT_BILINEAR)) {
+		for (int i = 0; i < n; ++i)
+			xs[i] = sx0 + (int)(((2*(long long)(cx0-x0+i) + 1)*sw)/(2*dw));
+		const unsigned char* last = 0;
+		for (int y = cy0; y < cy1; ++y) {
+			int sy = sy0 + (int)(((2*(long long)(y-y0) + 1)*sh)/(2*dh));
+			const unsigned* s = (const unsigned*)(src->pixels + 4*(size_t)src->wd*sy);
+			unsigned char* d = dst->pixels + 4*((size_t)dst->wd*y + cx0);
+			if (flags & BLIT_BLEND) {
+				if (s != (const unsigned*)last) {
+					for (int i = 0; i < n; ++i)
+						((unsigned*)&scaled[0])[i] = s[xs[i]];
+					last = (const unsigned char*)s;
+				}
+				blend_row(d,&scaled[0],n);
+			} else if (s == (const unsigned*)last) {
+				memcpy(d,d - 4*(size_t)dst->wd,4*(size_t)n);   // same source row as the one above
+			} else {
+				for (int i = 0; i < n; ++i)
+					((unsigned*)d)[i] = s[xs[i]];
+				last = (const unsigned char*)s;
+			}
+		}
+		return;
+	}
+
+	// bilinear: each row is first blended vertically, over the columns it needs
+	// plus one more, then each pixel blends two neighbours of that
+	std::vector<short> w(8*(size_t)n);
+	for (int i = 0; i < n; ++i) {
+		long long u = sample_position(cx0-x0+i,dw,sw);
+		int f = (int)((u & 0xffff) >> 8);
+		int sx = (int)(u >> 16);
+		if (sx < 0) {
+			sx = 0; f = 0;
+		} else if (sx >= sw-1) {
+			sx = sw-1; f = 0;
+		}
+		xs[i] = sx;
+		for (int c = 0; c < 4; ++c) {
+			w[8*i+c] = (short)(256-f);
+			w[8*i+4+c] = (short)f;
+		}
+	}
+	int lo = xs[0], hi = std::min(xs[n-1] + 2,sw);
+	for (int i = 0; i < n; ++i)
+		xs[i] -= lo;
+	std::vector<unsigned char> column(4*(size_t)(hi-lo+1));
+
+	for (int y = cy0; y < cy1; ++y) {
+		long long v = sample_position(y-y0,dh,sh);
+		int f = (int)((v & 0xffff) >> 8);
+		int sy = (int)(v >> 16);
+		if (sy < 0) {
+			sy = 0; f = 0;
+		} else if (sy >= sh-1) {
+			sy = sh-1; f = 0;
+		}
+		const unsigned char* a = src->pixels + 4*((size_t)src->wd*(sy0+sy) + sx0+lo);
+		const unsigned char* b = f ? a + 4*(size_t)src->wd : a;
+		lerp_rows(&column[0],a,b,hi-lo,f);
+		memcpy(&column[4*(hi-lo)],&column[4*(hi-lo-1)],4);   // so the right-most pixel has a neighbour
+
+		unsigned char* d = dst->pixels + 4*((size_t)dst->wd*y + cx0);
+		if (flags & BLIT_BLEND) {
+			lerp_columns(&scaled[0],&column[0],&xs[0],&w[0],n);
+			blend_row(d,&scaled[0],n);
+		} else {
+			lerp_columns(d,&column[0],&xs[0],&w[0],n);
+		}
+	}
+}
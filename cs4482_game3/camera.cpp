@@ -0,0 +1,60 @@
+#include "camera.h"
+#include "pacing.h"
+#include "gl3w.h"
+
+camera_block* camera_create()
+{
+	camera_block* cb = new camera_block;
+	cb->ubo = 0;
+	cb->input_time = 0;
+	cb->latency_ms = cb->latency_avg_ms = 0;
+
+	if (gl3wIsSupported(3,1)) {
+		glGenBuffers(1,&cb->ubo);
+		glBindBuffer(GL_UNIFORM_BUFFER,cb->ubo);
+		glBufferData(GL_UNIFORM_BUFFER,sizeof(mat4x4),0,GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER,0);
+		glBindBufferRange(GL_UNIFORM_BUFFER,CAMERA_BINDING,cb->ubo,0,sizeof(mat4x4));
+	}
+	return cb;
+}
+
+const char* camera_glsl()
+{
+	// our matrices are stored by rows, hence row_major
+	if (gl3wIsSupported(3,1))
+		return
+			"#extension GL_ARB_uniform_buffer_object : enable\n"
+			"layout(std140, row_major) uniform camera { mat4 V; };\n";
+	return
+		"uniform mat4 V;\n";
+}
+
+void camera_latch(camera_block* cb, const mat4x4& V, double input_time)
+{
+	cb->V = V;
+	cb->input_time = input_time;
+	if (cb->ubo) {
+		glBindBuffer(GL_UNIFORM_BUFFER,cb->ubo);
+		glBufferData(GL_UNIFORM_BUFFER,sizeof(mat4x4),0,GL_STREAM_DRAW);  // orphan last frame's copy
+		glBufferSubData(GL_UNIFORM_BUFFER,0,sizeof(mat4x4),V.ptr());
+		glBindBuffer(GL_UNIFORM_BUFFER,0);
+	}
+}
+
+void camera_use(camera_block* cb, unsigned program)
+{
+	if (cb->ubo) {
+		GLuint block = glGetUniformBlockIndex(program,"camera");
+		if (block != GL_INVALID_INDEX)
+			glUniformBlockBinding(program,block,CAMERA_BINDING);
+	} else {
+		glUniformMatrix4fv(glGetUniformLocation(program,"V"),1,GL_TRUE,cb->V.ptr());
+	}
+}
+
+void camera_submitted(camera_block* cb)
+{
+	cb->latency_ms = 1000*(pacer_now() - cb->input_time);
+	cb->latency_avg_ms += 0.1*(cb->latency_ms - cb->latency_avg_ms);
+}
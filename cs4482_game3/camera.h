@@ -0,0 +1,51 @@
+#ifndef __CAMERA_H__
+#define __CAMERA_H__
+
+// camera.h
+//    The view matrix shared by every shader. It lives in a uniform buffer
+//    (OpenGL 3.1) so that it is written once per frame, just before the
+//    draw calls are issued and after all culling and uploads are done,
+//    from the newest mouse input. Also measures how old that input is by
+//    the time the frame's last draw call has been issued.
+//
+//    Without uniform buffers V is set on each program as a plain uniform.
+
+#include "mat4x4.h"
+
+#define CAMERA_BINDING  0   // uniform buffer binding point of the camera block
+
+struct camera_block {
+	unsigned ubo;            // 0 without uniform buffers
+	mat4x4   V;              // world to eye, from the last camera_latch
+	double   input_time;     // pacer_now() when the input behind V was read
+	double   latency_ms;     // from then until camera_submitted, last frame
+	double   latency_avg_ms; // same, smoothed
+};
+
+// camera_create
+//    Allocates the uniform buffer if available. Needs a GL context.
+//
+camera_block* camera_create();
+
+// camera_glsl
+//    GLSL declaring 'mat4 V' for #version 120 shaders; it must come right
+//    after the #version line since it may enable an extension.
+//
+const char* camera_glsl();
+
+// camera_latch
+//    Sets the view matrix for the draws that follow.
+//
+void camera_latch(camera_block* cb, const mat4x4& V, double input_time);
+
+// camera_use
+//    Connects the bound 'program' to the view matrix; call after glUseProgram.
+//
+void camera_use(camera_block* cb, unsigned program);
+
+// camera_submitted
+//    Call once the frame's last draw call using V has been issued.
+//
+void camera_submitted(camera_block* cb);
+
+#endif // __CAMERA_H__
@@ -0,0 +1,346 @@
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "capture.h"
+#include "cs3388lib.h"
+#include "gl3w.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#define QOI_OP_INDEX  0x00
+#define QOI_OP_DIFF   0x40
+#define QOI_OP_LUMA   0x80
+#define QOI_OP_RUN    0xc0
+#define QOI_OP_RGB    0xfe
+
+//
+// capture_image -- a frame on its way to disk
+//
+struct capture_image {
+	long number;
+	int  wd, ht;
+	std::vector<unsigned char> pixels;   // B,G,R,A bottom row first, as read back
+	std::vector<unsigned char> encoded;  // the file, built by a writer
+};
+
+struct capture_writers {
+	std::vector<HANDLE> threads;
+	CRITICAL_SECTION    lock;    // guards the rest, and the frame_capture's counts
+	HANDLE wake;                 // semaphore; one count per frame queued, and one per thread to quit
+	HANDLE idle;                 // auto-reset event; a writer finished a frame
+	std::deque<capture_image*>  queue;
+	std::vector<capture_image*> spare;    // written frames, kept to be refilled
+	int    writing;              // frames a writer has taken off the queue
+};
+
+static unsigned char* put_be32(unsigned char* p, unsigned v)
+{
+	p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);  p[3] = (unsigned char)v;
+	return p + 4;
+}
+
+// qoi_encode
+//    Encodes B,G,R,A pixels, bottom row first, as a 3-channel QOI file
+//    (the window's alpha means nothing) into 'out', which must hold
+//    5*wd*ht + 22 bytes. Returns the size of the file.
+//
+static size_t qoi_encode(const unsigned char* bgra, int wd, int ht, unsigned char* out)
+{
+	unsigned char* p = out;
+	*p++ = 'q'; *p++ = 'o'; *p++ = 'i'; *p++ = 'f';
+	p = put_be32(p,wd);
+	p = put_be32(p,ht);
+	*p++ = 3;   // channels
+	*p++ = 0;   // sRGB
+
+	unsigned index[64];
+	memset(index,0,sizeof(index));
+	unsigned prev = 0xff000000;   // opaque black, as B | G << 8 | R << 16 | A << 24
+	int run = 0;
+	for (int y = ht-1; y >= 0; --y) {
+		const unsigned char* src = bgra + 4*(size_t)wd*y;
+		for (int x = 0; x < wd; ++x, src += 4) {
+			unsigned px;
+			memcpy(&px,src,4);
+			px |= 0xff000000;
+			if (px == prev) {
+				if (++run == 62) {
+					*p++ = QOI_OP_RUN | (run-1);
+					run = 0;
+				}
+				continue;
+			}
+			if (run) {
+				*p++ = QOI_OP_RUN | (run-1);
+				run = 0;
+			}
+
+			int r = (px >> 16) & 255, g = (px >> 8) & 255, b = px & 255;
+			int h = (r*3 + g*5 + b*7 + 255*11) & 63;
+			if (index[h] == px) {
+				*p++ = QOI_OP_INDEX | h;
+			} else {
+				index[h] = px;
+				int dr = (signed char)(r - (int)((prev >> 16) & 255));
+				int dg = (signed char)(g - (int)((prev >> 8) & 255));
+				int db = (signed char)(b - (int)(prev & 255));
+				int dr_dg = dr - dg, db_dg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+					*p++ = (unsigned char)(QOI_OP_DIFF | (dr+2) << 4 | (dg+2) << 2 | (db+2));
+				} else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+					*p++ = (unsigned char)(QOI_OP_LUMA | (dg+32));
+					*p++ = (unsigned char)((dr_dg+8) << 4 | (db_dg+8));
+				} else {
+					*p++ = QOI_OP_RGB;
+					*p++ = (unsigned char)r; *p++ = (unsigned char)g; *p++ = (unsigned char)b;
+				}
+			}
+			prev = px;
+		}
+	}
+	if (run)
+		*p++ = QOI_OP_RUN | (run-1);
+	static const unsigned char end[8] = { 0,0,0,0,0,0,0,1 };
+	memcpy(p,end,8);
+	return p + 8 - out;
+}
+
+static bool write_image(const std::string& prefix, capture_image* im)
+{
+	im->encoded.resize(5*(size_t)im->wd*im->ht + 22);
+	size_t size = qoi_encode(&im->pixels[0],im->wd,im->ht,&im->encoded[0]);
+
+	char name[32];
+	sprintf_s(name,sizeof(name),"%06ld.qoi",im->number);
+	FILE* fh;
+	if (fopen_s(&fh,(prefix + name).c_str(),"wb") != 0)
+		return false;
+	bool ok = fwrite(&im->encoded[0],1,size,fh) == size;
+	return fclose(fh) == 0 && ok;
+}
+
+static DWORD WINAPI writer(LPVOID arg)
+{
+	frame_capture* fc = (frame_capture*)arg;
+	capture_writers* w = fc->writers;
+	for (;;) {
+		WaitForSingleObject(w->wake,INFINITE);
+		EnterCriticalSection(&w->lock);
+		if (w->queue.empty()) {
+			// every frame's count comes with a frame, so this is a count to quit
+			LeaveCriticalSection(&w->lock);
+			return 0;
+		}
+		capture_image* im = w->queue.front();
+		w->queue.pop_front();
+		w->writing++;
+		LeaveCriticalSection(&w->lock);
+
+		bool ok = write_image(fc->prefix,im);
+
+		EnterCriticalSection(&w->lock);
+		w->writing--;
+		if (ok)
+			fc->written++;
+		else
+			fc->failed++;
+		w->spare.push_back(im);
+		LeaveCriticalSection(&w->lock);
+		SetEvent(w->idle);
+	}
+}
+
+frame_capture* capture_create(const char* prefix, int writers)
+{
+	if (!gl3wIsSupported(2,1))
+		return 0;
+
+	frame_capture* fc = new frame_capture;
+	fc->prefix = prefix;
+	fc->recording = false;
+	fc->fences = gl3wIsSupported(3,2);
+	for (int i = 0; i < CAPTURE_SLOTS; ++i) {
+		fc->pbo[i] = 0;
+		fc->fence[i] = 0;
+		fc->slot_number[i] = -1;
+	}
+	fc->next = 0;
+	fc->wd = fc->ht = 0;
+	fc->number = 0;
+	fc->dropped = 0;
+	fc->written = 0;
+	fc->failed = 0;
+
+	writers = std::max(writers,1);
+	capture_writers* w = fc->writers = new capture_writers;
+	InitializeCriticalSection(&w->lock);
+	w->wake = CreateSemaphore(0,0,CAPTURE_QUEUE + writers,0);
+	w->idle = CreateEvent(0,FALSE,FALSE,0);
+	w->writing = 0;
+	for (int i = 0; i < writers; ++i)
+		w->threads.push_back(CreateThread(0,0,writer,fc,0,0));
+	return fc;
+}
+
+void capture_start(frame_capture* fc)
+{
+	fc->recording = true;
+}
+
+// readback_done
+//    Whether the frame in slot i can be mapped without waiting.
+//
+static bool readback_done(frame_capture* fc, int i)
+{
+	if (!fc->fences)
+		return fc->number - fc->slot_number[i] >= CAPTURE_SLOTS-1;
+	GLenum r = glClientWaitSync((GLsync)fc->fence[i],GL_SYNC_FLUSH_COMMANDS_BIT,0);
+	return r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED;
+}
+
+// retire_slot
+//    Maps slot i's buffer, waiting for the readback if it is still under
+//    way, and queues a copy of the pixels for the writers.
+//
+static void retire_slot(frame_capture* fc, int i)
+{
+	if (fc->fence[i]) {
+		glDeleteSync((GLsync)fc->fence[i]);
+		fc->fence[i] = 0;
+	}
+
+	capture_writers* w = fc->writers;
+	capture_image* im = 0;
+	EnterCriticalSection(&w->lock);
+	if (w->queue.size() + w->writing < CAPTURE_QUEUE) {
+		if (w->spare.empty()) {
+			im = new capture_image;
+		} else {
+			im = w->spare.back();
+			w->spare.pop_back();
+		}
+	}
+	LeaveCriticalSection(&w->lock);
+
+	bool queued = false;
+	if (im) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,fc->pbo[i]);
+		const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+		if (pixels) {
+			im->number = fc->slot_number[i];
+			im->wd = fc->wd;
+			im->ht = fc->ht;
+			im->pixels.resize(4*(size_t)fc->wd*fc->ht);
+			memcpy(&im->pixels[0],pixels,im->pixels.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+
+		EnterCriticalSection(&w->lock);
+		queued = pixels != 0;
+		if (queued)
+			w->queue.push_back(im);
+		else
+			w->spare.push_back(im);
+		LeaveCriticalSection(&w->lock);
+	}
+	if (queued)
+		ReleaseSemaphore(w->wake,1,0);
+	else
+		fc->dropped++;
+	fc->slot_number[i] = -1;
+}
+
+// retire_all
+//    Passes on every frame still being read back, oldest first.
+//
+static void retire_all(frame_capture* fc)
+{
+	for (int k = 0; k < CAPTURE_SLOTS; ++k) {
+		int i = (fc->next + k) % CAPTURE_SLOTS;
+		if (fc->slot_number[i] >= 0)
+			retire_slot(fc,i);
+	}
+}
+
+void capture_frame(frame_capture* fc, int wd, int ht)
+{
+	// frames whose readback has finished, oldest first; a later one is never done before an earlier one
+	for (int k = 0; k < CAPTURE_SLOTS; ++k) {
+		int i = (fc->next + k) % CAPTURE_SLOTS;
+		if (fc->slot_number[i] < 0)
+			continue;
+		if (!readback_done(fc,i))
+			break;
+		retire_slot(fc,i);
+	}
+	if (!fc->recording || wd <= 0 || ht <= 0)
+		return;
+
+	if (wd != fc->wd || ht != fc->ht) {
+		retire_all(fc);   // frames of the old size
+		if (!fc->pbo[0])
+			glGenBuffers(CAPTURE_SLOTS,fc->pbo);
+		for (int i = 0; i < CAPTURE_SLOTS; ++i) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER,fc->pbo[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER,4*(size_t)wd*ht,0,GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+		fc->wd = wd;
+		fc->ht = ht;
+	}
+
+	int i = fc->next;
+	if (fc->slot_number[i] >= 0)
+		retire_slot(fc,i);   // the GPU is a whole ring behind; wait rather than lose the frame
+
+	// B,G,R,A is what the hardware stores, so the copy needs no conversion
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,fc->pbo[i]);
+	glPixelStorei(GL_PACK_ALIGNMENT,4);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0,0,wd,ht,GL_BGRA,GL_UNSIGNED_BYTE,0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+	if (fc->fences)
+		fc->fence[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	fc->slot_number[i] = fc->number++;
+	fc->next = (i + 1) % CAPTURE_SLOTS;
+}
+
+void capture_stop(frame_capture* fc)
+{
+	fc->recording = false;
+	retire_all(fc);
+	capture_writers* w = fc->writers;
+	for (;;) {
+		EnterCriticalSection(&w->lock);
+		bool busy = !w->queue.empty() || w->writing;
+		LeaveCriticalSection(&w->lock);
+		if (!busy)
+			break;
+		WaitForSingleObject(w->idle,INFINITE);
+	}
+}
+
+void capture_delete(frame_capture* fc)
+{
+	capture_stop(fc);
+	capture_writers* w = fc->writers;
+	ReleaseSemaphore(w->wake,(LONG)w->threads.size(),0);
+	for (size_t i = 0; i < w->threads.size(); ++i) {
+		WaitForSingleObject(w->threads[i],INFINITE);
+		CloseHandle(w->threads[i]);
+	}
+	CloseHandle(w->wake);
+	CloseHandle(w->idle);
+	DeleteCriticalSection(&w->lock);
+
+	for (size_t i = 0; i < w->spare.size(); ++i)
+		delete w->spare[i];
+	delete w;
+	if (fc->pbo[0])
+		glDeleteBuffers(CAPTURE_SLOTS,fc->pbo);
+	delete fc;
+}
@@ -0,0 +1,78 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+// capture.h
+//    Records the frames shown in the window as a numbered sequence of
+//    QOI images (lossless, and encoded and decoded many times faster than
+//    PNG; image_load reads them back for comparisons).
+//
+//    Each frame is read back with glReadPixels into one of a ring of
+//    pixel pack buffers, which returns at once; the copy happens on the
+//    GPU in its own time. The buffer is mapped a frame or two later, once
+//    its fence has signalled (OpenGL 3.2; without fences, after the ring
+//    has come around), and the pixels are handed to background threads
+//    that encode them and write the files. The game never waits for the
+//    disk, and only waits for the GPU if it falls a whole ring behind.
+//
+//    A frame is dropped, and counted, only when the writers have more
+//    than CAPTURE_QUEUE frames still to write. Frames are numbered when
+//    they are read back, so a dropped frame leaves a gap in the names.
+
+#include <string>
+
+#define CAPTURE_SLOTS   3    // pixel pack buffers the readback rotates through
+#define CAPTURE_QUEUE   16   // frames waiting to be written before more are dropped
+
+struct capture_writers;   // the threads and their queue, in capture.cpp
+
+struct frame_capture {
+	std::string prefix;          // frames are written as <prefix>000000.qoi, ...
+	bool     recording;
+	bool     fences;             // OpenGL 3.2 sync objects are available
+
+	// readback, on the GL thread
+	unsigned pbo[CAPTURE_SLOTS];
+	void*    fence[CAPTURE_SLOTS];
+	long     slot_number[CAPTURE_SLOTS];  // frame in each buffer, or -1 if free
+	int      next;               // slot the next frame goes to; the oldest if all are busy
+	int      wd, ht;             // size the buffers were allocated for
+	long     number;             // frames read back so far
+	long     dropped;            // frames lost because the writers fell behind
+
+	capture_writers* writers;
+	long     written;            // updated by the writers
+	long     failed;             // frames whose file could not be written
+};
+
+// capture_create
+//    Starts 'writers' encoding threads; the buffers are allocated by the
+//    first frame. Needs OpenGL 2.1 pixel buffer objects; returns 0
+//    without them.
+//
+frame_capture* capture_create(const char* prefix = "capture_", int writers = 2);
+
+// capture_start
+//    Begins recording with the next capture_frame. Numbering carries on
+//    from any earlier recording, so files are never overwritten.
+//
+void capture_start(frame_capture* fc);
+
+// capture_frame
+//    Call once per frame, after the frame is drawn into the default
+//    framebuffer's back buffer and before it is swapped. Starts reading
+//    it back if recording, and passes on frames whose readback finished.
+//
+void capture_frame(frame_capture* fc, int wd, int ht);
+
+// capture_stop
+//    Stops recording and returns once every frame read back so far is
+//    written.
+//
+void capture_stop(frame_capture* fc);
+
+// capture_delete
+//    Stops recording, finishes writing, and joins the writers.
+//
+void capture_delete(frame_capture* fc);
+
+#endif // __CAPTURE_H__
@@ -5,9 +5,10 @@
      Provides simple functions to:
         - create and draw simple bitmaps (BGRA pixel format only)
         - draw lines, rectangles, and circles into bitmaps
+        - copy, blend and scale bitmaps into each other (blit.cpp)
         - read and write bitmap files (read PNG/BMP, write BMP)
         - draw bitmaps into an OpenGL framebuffer
-        - simpler random number generation
+        - simpler random number generation (on top of rng.h)
 
 *******************************************************************************/
 
@@ -17,14 +18,22 @@
 // bitmap
 //   The minimal information needed to store/draw a bitmap.
 //   The pixel format is assumed to be BGRA.
+//   The drawing functions also note which pixels they changed, so that
+//   gl_drawbitmap only has to send those to its texture.
 //
 struct bitmap {
 	int wd,ht;
 	unsigned char* pixels;
+	int dirty_x0, dirty_y0;   // pixels changed since last drawn, excluding
+	int dirty_x1, dirty_y1;   // column x1 and row y1; empty if x0 >= x1
+	unsigned texture;         // gl_drawbitmap's copy, 0 until first drawn
+	unsigned upload[2];       // pixel buffers it alternates between, 0 until needed
+	int      upload_next;
 };
 
 // bitmap_load
-//    Reads a PNG or BMP file from disk.
+//    Reads a PNG or BMP file from disk (see image_load, which also
+//    returns rows bottom-up or channels as RGBA if asked).
 //    Use bitmap_delete if the bitmap is no longer needed.
 //
 // Example:
@@ -56,7 +65,8 @@ bitmap* bitmap_create(int width, int height);
 // bitmap_pixel
 //    Returns a pointer to the raw bytes that define the
 //    image's colour data. Only needed if you want to 
-//    inspect/modify specific pixels. 
+//    inspect/modify specific pixels. The pixel is assumed
+//    to be modified (see bitmap_dirty).
 //
 // Example:
 //    bitmap* bm = bitmap_create(9,9);
@@ -67,9 +77,17 @@ bitmap* bitmap_create(int width, int height);
 //
 unsigned char* bitmap_pixel(bitmap* bm, int x, int y);
 
+// bitmap_dirty
+//    Notes that pixels from (x0,y0) to (x1,y1), excluding the right-most
+//    column and bottom-most row, have changed. Only needed after writing
+//    to 'pixels' directly; bitmap_pixel and the drawing functions below
+//    already do this.
+//
+void bitmap_dirty(bitmap* bm, int x0, int y0, int x1, int y1);
+
 // bitmap_delete
 //    Releases any pixel memory associated with the bitmap,
-//    including the 'bitmap' struct itself.
+//    including the 'bitmap' struct itself, and its OpenGL copy.
 //
 void bitmap_delete(bitmap* bm);
 
@@ -108,6 +126,54 @@ void drawline(bitmap* bm, int x0, int y0, int x1, int y1,
 void drawcircle(bitmap* bm, int x, int y, int radius, 
                 unsigned char r, unsigned char g, unsigned char b);
 
+////////////////////////////////////////////////////////////////
+
+#define BLIT_BILINEAR  1   // bitmap_stretch filters instead of picking the nearest pixel
+#define BLIT_BLEND     2   // bitmap_stretch composes like bitmap_blend instead of copying
+
+// bitmap_blit
+//    Copies the rectangle (sx0,sy0)-(sx1,sy1) of src, excluding the
+//    right-most column and bottom-most row, into dst with its top-left
+//    corner at (x,y). Parts falling outside either bitmap are skipped.
+//    src and dst may be the same bitmap, even if the rectangles overlap.
+//
+// Example:
+//    bitmap_blit(hud, 8,8, icons, 16,0, 32,16); // second 16x16 icon to (8,8)
+//
+void bitmap_blit(bitmap* dst, int x, int y, const bitmap* src, int sx0, int sy0, int sx1, int sy1);
+
+// bitmap_blend
+//    Same, but draws src over what is in dst using src's alpha, which
+//    must be premultiplied (see bitmap_premultiply): each colour channel
+//    becomes src + dst*(255-src alpha)/255.
+//
+void bitmap_blend(bitmap* dst, int x, int y, const bitmap* src, int sx0, int sy0, int sx1, int sy1);
+
+// bitmap_blitkey
+//    Same as bitmap_blit, but leaves dst alone wherever src is the
+//    colour (r,g,b), whatever its alpha.
+//
+void bitmap_blitkey(bitmap* dst, int x, int y, const bitmap* src, int sx0, int sy0, int sx1, int sy1,
+                    unsigned char r, unsigned char g, unsigned char b);
+
+// bitmap_premultiply
+//    Multiplies each pixel's colour by its alpha, as bitmap_blend and
+//    BLIT_BLEND expect. Do it once, after loading or drawing.
+//
+void bitmap_premultiply(bitmap* bm);
+
+// bitmap_stretch
+//    Scales the rectangle (sx0,sy0)-(sx1,sy1) of src to cover the
+//    rectangle (x0,y0)-(x1,y1) of dst, clipped to dst. 'flags' combines
+//    the BLIT_ constants; bilinear filtering never reaches outside the
+//    source rectangle, so it is safe on a cell of an atlas.
+//
+// Example:
+//    bitmap_stretch(hud, 0,0, 128,128, map, 0,0, map->wd,map->ht, BLIT_BILINEAR);
+//
+void bitmap_stretch(bitmap* dst, int x0, int y0, int x1, int y1,
+                    const bitmap* src, int sx0, int sy0, int sx1, int sy1, int flags = 0);
+
 
 ////////////////////////////////////////////////////////////////
 
@@ -128,10 +194,19 @@ void drawcircle(bitmap* bm, int x, int y, int radius,
 void   gl_drawbitmap(bitmap* bm, int left, int top);
 void   gl_drawbitmap(bitmap* bm, int left, int right, int top, int bottom);
 
+// gl_initdrawbitmap
+//    Starts building the shader program gl_drawbitmap uses, in the
+//    background if shader_init was called, so that its first call
+//    does not stall the frame it is drawn in.
+//
+void   gl_initdrawbitmap();
+
 // gl_drawstring
 //    Draws text in 'str' to the screen using colour (r,g,b)
 //    The location (left,top) is in window coordinates, i.e.
 //    in pixels from top-left corner of window.
+//    Once text_init has been called this goes through the batched
+//    text renderer; to draw many strings at once, use text.h directly.
 void   gl_drawstring(const char* str, int left, int top, unsigned char r, unsigned char g, unsigned char b);
 
 // gl_createprogram
@@ -149,12 +224,22 @@ unsigned gl_loadprogram(const char* vsfile, const char* fsfile);
 
 // gl_loadtexture
 //    Loads a BMP or PNG bitmap, registers it with OpenGL, 
-//    builds mipmaps, and returns the new OpenGL texture identifier
+//    builds mipmaps, and returns the new OpenGL texture identifier.
+//    The texture is block-compressed where the driver allows, and
+//    cached that way next to the file (see texcook.h).
 unsigned gl_loadtexture(const char* filename);
 
 
 ////////////////////////////////////////////////////////////////
 
+// random_seed
+//    Restarts random_int and random_float from a known seed, so a run can
+//    be repeated. Without it they are seeded from the clock on first use.
+//    They share one generator and must only be called from one thread;
+//    other threads should use their own (see rng.h).
+//
+void random_seed(unsigned long long seed);
+
 // random_int
 //    Returns a random, non-negative integer.
 //
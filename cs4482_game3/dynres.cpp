@@ -0,0 +1,102 @@
+#include "dynres.h"
+#include "gl3w.h"
+#include <cmath>
+#include <algorithm>
+
+#define DYNRES_SMOOTHING  0.2   // weight of the newest frame in gpu_ms
+
+dynres* dynres_create(double budget_ms, float min_scale, float max_scale, float step, int interval, double headroom)
+{
+	dynres* dr = new dynres;
+	dr->min_scale = std::min(std::max(min_scale,0.1f),1.0f);
+	dr->max_scale = std::min(std::max(max_scale,dr->min_scale),1.0f);
+	dr->scale = dr->max_scale;
+	dr->step = std::max(step,0.01f);
+	dr->budget_ms = budget_ms;
+	dr->headroom = headroom;
+	dr->interval = std::max(interval,1);
+	dr->next = 0;
+	dr->frames = 0;
+	dr->gpu_ms = budget_ms;
+
+	bool timers = gl3wIsSupported(3,3);
+	for (int i = 0; i < DYNRES_QUERY_FRAMES; ++i) {
+		dr->queries[i][0] = dr->queries[i][1] = 0;
+		if (timers)
+			glGenQueries(2,dr->queries[i]);
+		dr->pending[i] = false;
+	}
+	return dr;
+}
+
+// the measurement from the oldest frame still outstanding, if it has arrived
+static bool read_oldest(dynres* dr, double& ms)
+{
+	for (int k = 0; k < DYNRES_QUERY_FRAMES; ++k) {
+		int i = (dr->next + k) % DYNRES_QUERY_FRAMES;
+		if (!dr->pending[i])
+			continue;
+		GLint available = 0;
+		glGetQueryObjectiv(dr->queries[i][1],GL_QUERY_RESULT_AVAILABLE,&available);
+		if (!available)
+			return false;  // later ones cannot be ready either
+		GLuint64 start, end;
+		glGetQueryObjectui64v(dr->queries[i][0],GL_QUERY_RESULT,&start);
+		glGetQueryObjectui64v(dr->queries[i][1],GL_QUERY_RESULT,&end);
+		dr->pending[i] = false;
+		ms = (end - start)/1e6;
+		return true;
+	}
+	return false;
+}
+
+void dynres_begin_frame(dynres* dr)
+{
+	unsigned* q = dr->queries[dr->next];
+	if (!q[0])
+		return;
+
+	double ms;
+	while (read_oldest(dr,ms))
+		dr->gpu_ms += DYNRES_SMOOTHING*(ms - dr->gpu_ms);
+	if (!dr->pending[dr->next])
+		glQueryCounter(q[0],GL_TIMESTAMP);
+}
+
+static void adjust(dynres* dr)
+{
+	if (dr->gpu_ms <= 0)
+		return;
+
+	// pixels, and so (roughly) time, go with the square of the scale
+	float want = dr->scale*(float)std::sqrt(dr->budget_ms/dr->gpu_ms);
+	if (want > dr->scale && dr->gpu_ms > dr->budget_ms*(1 - dr->headroom))
+		return;
+	float change = std::min(std::max(want - dr->scale,-dr->step),dr->step);
+	dr->scale = std::min(std::max(dr->scale + change,dr->min_scale),dr->max_scale);
+}
+
+void dynres_end_frame(dynres* dr)
+{
+	unsigned* q = dr->queries[dr->next];
+	if (!q[0])
+		return;
+	if (!dr->pending[dr->next]) {
+		glQueryCounter(q[1],GL_TIMESTAMP);
+		dr->pending[dr->next] = true;
+	}  // else the slot's frame is still out; this frame goes unmeasured
+	dr->next = (dr->next + 1) % DYNRES_QUERY_FRAMES;
+
+	if (++dr->frames >= dr->interval) {
+		dr->frames = 0;
+		adjust(dr);
+	}
+}
+
+void dynres_delete(dynres* dr)
+{
+	for (int i = 0; i < DYNRES_QUERY_FRAMES; ++i)
+		if (dr->queries[i][0])
+			glDeleteQueries(2,dr->queries[i]);
+	delete dr;
+}
@@ -0,0 +1,58 @@
+#ifndef __DYNRES_H__
+#define __DYNRES_H__
+
+// dynres.h
+//    Dynamic resolution. The GPU time of each frame is measured with a
+//    pair of timestamp queries (OpenGL 3.3), read back a few frames later
+//    so that nothing waits for them, and every 'interval' frames the
+//    fraction of the window the scene is drawn at is moved towards the
+//    one that would fit the frame budget, by at most 'step' at a time.
+//    The cost of a frame is taken to grow with its pixel count, so the
+//    scale follows the square root of budget/measured time. The scale
+//    only grows again once there is some headroom, so that it does not
+//    flip between two sizes.
+
+#define DYNRES_QUERY_FRAMES  4   // frames a timestamp may take to come back
+
+struct dynres {
+	float  scale;          // fraction of the window's width and height to draw the scene at
+	float  min_scale;
+	float  max_scale;
+	float  step;           // largest change of scale per adjustment
+	double budget_ms;      // GPU time we want a frame to take
+	double headroom;       // fraction of the budget that must be left over before scaling up
+	int    interval;       // frames between adjustments
+
+	unsigned queries[DYNRES_QUERY_FRAMES][2];  // start and end timestamps; 0 without timer queries
+	bool   pending[DYNRES_QUERY_FRAMES];
+	int    next;
+	int    frames;         // since the last adjustment
+	double gpu_ms;         // measured GPU time per frame, smoothed
+};
+
+// dynres_create
+//    Needs a GL context. The scale starts at max_scale.
+//
+dynres* dynres_create(double budget_ms, float min_scale = 0.5f, float max_scale = 1.0f,
+                      float step = 0.05f, int interval = 8, double headroom = 0.15);
+
+// dynres_begin_frame
+//    Call once the frame's CPU work (culling and the like) is done,
+//    immediately before its first draw call, so that the timestamps
+//    bracket GPU work only.
+//
+void dynres_begin_frame(dynres* dr);
+
+// dynres_end_frame
+//    Call after the last draw call whose cost depends on the scale; may
+//    change dr->scale for the frames that follow. Without timer queries
+//    nothing is measured and the scale stays where it is.
+//
+void dynres_end_frame(dynres* dr);
+
+// dynres_delete
+//    Releases the queries.
+//
+void dynres_delete(dynres* dr);
+
+#endif // __DYNRES_H__
@@ -0,0 +1,58 @@
+#include "frustum.h"
+#include <cmath>
+
+frustum frustum_from_matrix(const mat4x4& M)
+{
+	// Gribb & Hartmann: each plane is the last row of M plus/minus one of the others
+	vec4 r[4];
+	for (int row = 0; row < 4; ++row)
+		r[row] = vec4(M[row][0],M[row][1],M[row][2],M[row][3]);
+
+	frustum f;
+	f.planes[0] = r[3] + r[0];  // left
+	f.planes[1] = r[3] - r[0];  // right
+	f.planes[2] = r[3] + r[1];  // bottom
+	f.planes[3] = r[3] - r[1];  // top
+	f.planes[4] = r[3] + r[2];  // near
+	f.planes[5] = r[3] - r[2];  // far
+
+	for (int i = 0; i < 6; ++i) {
+		vec4& p = f.planes[i];
+		float len = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+		if (len > 0)
+			p /= len;
+	}
+	return f;
+}
+
+int frustum_test_aabb(const frustum& f, const vec4& bmin, const vec4& bmax)
+{
+	int result = FRUSTUM_INSIDE;
+	for (int i = 0; i < 6; ++i) {
+		const vec4& p = f.planes[i];
+
+		// corner furthest along the plane normal ('positive vertex') and its opposite
+		vec4 pos(p.x >= 0 ? bmax.x : bmin.x, p.y >= 0 ? bmax.y : bmin.y, p.z >= 0 ? bmax.z : bmin.z, 1);
+		vec4 neg(p.x >= 0 ? bmin.x : bmax.x, p.y >= 0 ? bmin.y : bmax.y, p.z >= 0 ? bmin.z : bmax.z, 1);
+
+		if (p*pos < 0)
+			return FRUSTUM_OUTSIDE;
+		if (p*neg < 0)
+			result = FRUSTUM_INTERSECT;
+	}
+	return result;
+}
+
+int frustum_test_sphere(const frustum& f, const vec4& center, float radius)
+{
+	vec4 c(center.x,center.y,center.z,1);
+	int result = FRUSTUM_INSIDE;
+	for (int i = 0; i < 6; ++i) {
+		float d = f.planes[i]*c;
+		if (d < -radius)
+			return FRUSTUM_OUTSIDE;
+		if (d < radius)
+			result = FRUSTUM_INTERSECT;
+	}
+	return result;
+}
@@ -0,0 +1,43 @@
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+// frustum.h
+//    Extracts the clipping planes of a view volume from a projection
+//    (or projection*modelview) matrix, and tests bounding volumes
+//    against them so that objects outside the view can be skipped.
+
+#include "vec4.h"
+#include "mat4x4.h"
+
+#define FRUSTUM_OUTSIDE    0   // volume is entirely outside at least one plane
+#define FRUSTUM_INTERSECT  1   // volume straddles one or more planes
+#define FRUSTUM_INSIDE     2   // volume is entirely inside all planes
+
+//
+// frustum -- six planes (left,right,bottom,top,near,far), each stored as
+//            (a,b,c,d) with point p inside when a*p.x + b*p.y + c*p.z + d >= 0.
+//            Planes are normalized so that the test gives a true distance.
+//
+struct frustum {
+	vec4 planes[6];
+};
+
+// frustum_from_matrix
+//    Extracts the planes of the clip volume of M. If M = P*MV then the
+//    planes are expressed in the coordinates that MV transforms from,
+//    so boxes can be tested in their own model space.
+//
+frustum frustum_from_matrix(const mat4x4& M);
+
+// frustum_test_aabb
+//    Classifies the axis-aligned box [bmin,bmax] against the frustum.
+//    Returns FRUSTUM_OUTSIDE, FRUSTUM_INTERSECT or FRUSTUM_INSIDE.
+//
+int frustum_test_aabb(const frustum& f, const vec4& bmin, const vec4& bmax);
+
+// frustum_test_sphere
+//    Same as frustum_test_aabb but for a sphere around 'center'.
+//
+int frustum_test_sphere(const frustum& f, const vec4& center, float radius);
+
+#endif // __FRUSTUM_H__
@@ -0,0 +1,324 @@
+#include "geometry.h"
+#include "camera.h"
+#include "gl3w.h"
+#include <map>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#define BUFFER_OFFSET(bytes) ((const char*)(0) + (bytes))
+
+int geometry_alloc(geometry_allocator& a, int size)
+{
+	for (size_t i = 0; i < a.free.size(); ++i) {
+		geometry_block& b = a.free[i];
+		if (b.size < size)
+			continue;
+		int offset = b.offset;
+		b.offset += size;
+		b.size -= size;
+		if (b.size == 0)
+			a.free.erase(a.free.begin() + i);
+		return offset;
+	}
+	return -1;
+}
+
+void geometry_release(geometry_allocator& a, int offset, int size)
+{
+	if (size <= 0)
+		return;
+
+	size_t i = 0;
+	while (i < a.free.size() && a.free[i].offset < offset)
+		++i;
+	geometry_block b = { offset, size };
+	a.free.insert(a.free.begin() + i, b);
+
+	// merge with the following block, then with the preceding one
+	if (i+1 < a.free.size() && a.free[i].offset + a.free[i].size == a.free[i+1].offset) {
+		a.free[i].size += a.free[i+1].size;
+		a.free.erase(a.free.begin() + i+1);
+	}
+	if (i > 0 && a.free[i-1].offset + a.free[i-1].size == a.free[i].offset) {
+		a.free[i-1].size += a.free[i].size;
+		a.free.erase(a.free.begin() + i);
+	}
+}
+
+////////////////////////////////////////////////////////
+
+geometry_arena* geometry_create(int max_vertices, int max_indices)
+{
+	geometry_arena* a = new geometry_arena;
+	a->vertices.capacity = max_vertices;
+	a->indices.capacity = max_indices;
+	geometry_block all_vertices = { 0, max_vertices };
+	geometry_block all_indices  = { 0, max_indices };
+	a->vertices.free.push_back(all_vertices);
+	a->indices.free.push_back(all_indices);
+	a->draw_calls = 0;
+	a->drawn_objects = 0;
+
+	glGenBuffers(1,&a->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER,a->vbo);
+	glBufferData(GL_ARRAY_BUFFER,max_vertices*sizeof(vertex),0,GL_STATIC_DRAW);
+	glGenBuffers(1,&a->instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+
+	glGenBuffers(1,&a->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,a->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,max_indices*sizeof(unsigned),0,GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+
+	a->uploaded = false;
+	a->source = 0;
+	a->instance_offset = a->command_offset = 0;
+
+	a->indirect_buffer = 0;
+	if (gl3wIsSupported(4,0))
+		glGenBuffers(1,&a->indirect_buffer);
+	return a;
+}
+
+// orders vertices by their bytes, to find duplicates
+struct vertex_less {
+	bool operator()(const vertex& a, const vertex& b) const { return memcmp(&a,&b,sizeof(vertex)) < 0; }
+};
+
+geometry_mesh* geometry_add(geometry_arena* a, const triangles& tri)
+{
+	std::vector<vertex> verts;
+	std::vector<unsigned> idx;
+	std::map<vertex,unsigned,vertex_less> seen;
+	for (size_t i = 0; i < tri.size(); ++i) {
+		const vertex& v = tri[i];
+		std::map<vertex,unsigned,vertex_less>::iterator it = seen.find(v);
+		if (it == seen.end()) {
+			it = seen.insert(std::make_pair(v,(unsigned)verts.size())).first;
+			verts.push_back(v);
+		}
+		idx.push_back(it->second);
+	}
+
+	int first_vertex = geometry_alloc(a->vertices,(int)verts.size());
+	if (first_vertex < 0)
+		return 0;
+	int first_index = geometry_alloc(a->indices,(int)idx.size());
+	if (first_index < 0) {
+		geometry_release(a->vertices,first_vertex,(int)verts.size());
+		return 0;
+	}
+
+	geometry_mesh* m = new geometry_mesh;
+	m->first_vertex = first_vertex;
+	m->vertex_count = (int)verts.size();
+	m->first_index = first_index;
+	m->index_count = (int)idx.size();
+
+	if (!verts.empty()) {
+		glBindBuffer(GL_ARRAY_BUFFER,a->vbo);
+		glBufferSubData(GL_ARRAY_BUFFER,first_vertex*sizeof(vertex),verts.size()*sizeof(vertex),&verts[0]);
+		glBindBuffer(GL_ARRAY_BUFFER,0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,a->ibo);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,first_index*sizeof(unsigned),idx.size()*sizeof(unsigned),&idx[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+	}
+
+	a->meshes.push_back(m);
+	return m;
+}
+
+void geometry_remove(geometry_arena* a, geometry_mesh* m)
+{
+	geometry_release(a->vertices,m->first_vertex,m->vertex_count);
+	geometry_release(a->indices,m->first_index,m->index_count);
+	a->meshes.erase(std::remove(a->meshes.begin(),a->meshes.end(),m),a->meshes.end());
+	delete m;
+}
+
+const char* geometry_vertex_shader()
+{
+	static std::string code;
+	code = std::string(
+		"#version 120\n") + camera_glsl() +
+		"uniform mat4 P;\n"
+		"attribute vec4 p;\n"
+		"attribute mat4 inst_M;\n"   // model matrix of this object
+		"attribute vec4 inst_c;\n"   // colour of this object
+		"varying vec4 p_col;\n"
+		"void main()\n"
+		"{\n"
+		"	gl_Position = P*(V*(inst_M*p));\n"
+		"	p_col = inst_c;\n"
+		"}\n";
+	return code.c_str();
+}
+
+void geometry_queue(geometry_mesh* m, const mat4x4& M, const vec4& clr)
+{
+	// GLSL fills a mat4 attribute column by column, and our matrices are stored by rows
+	mat4x4 columns = transpose(M);
+	const float* f = columns.ptr();
+	m->queued.insert(m->queued.end(),f,f+16);
+	m->queued.push_back(clr.x);
+	m->queued.push_back(clr.y);
+	m->queued.push_back(clr.z);
+	m->queued.push_back(clr.w);
+}
+
+////////////////////////////////////////////////////////
+
+static void point_instances(GLint mloc, GLint cloc, size_t first_byte)
+{
+	const int stride = GEOMETRY_INSTANCE_FLOATS*sizeof(float);
+	for (int k = 0; k < 4; ++k)
+		glVertexAttribPointer(mloc+k,4,GL_FLOAT,GL_FALSE,stride,BUFFER_OFFSET(first_byte + 4*k*sizeof(float)));
+	glVertexAttribPointer(cloc,4,GL_FLOAT,GL_FALSE,stride,BUFFER_OFFSET(first_byte + 16*sizeof(float)));
+}
+
+// one command per mesh with objects queued, and their instance data back to back
+static void gather(geometry_arena* a, std::vector<float>& instances)
+{
+	a->commands.clear();
+	instances.clear();
+	for (size_t i = 0; i < a->meshes.size(); ++i) {
+		geometry_mesh* m = a->meshes[i];
+		if (m->queued.empty())
+			continue;
+		geometry_command cmd;
+		cmd.count = m->index_count;
+		cmd.instance_count = (unsigned)(m->queued.size() / GEOMETRY_INSTANCE_FLOATS);
+		cmd.first_index = m->first_index;
+		cmd.base_vertex = m->first_vertex;
+		cmd.base_instance = 0;
+		a->commands.push_back(cmd);
+		instances.insert(instances.end(),m->queued.begin(),m->queued.end());
+		m->queued.clear();
+	}
+}
+
+void geometry_upload(geometry_arena* a, stream_buffer* sb)
+{
+	if (!gl3wIsSupported(3,3))
+		return;  // drawn one object at a time from the queues
+
+	static std::vector<float> instances;
+	gather(a,instances);
+	a->uploaded = true;
+	a->source = sb->buffer;
+	a->instance_offset = a->command_offset = 0;
+	if (a->commands.empty())
+		return;
+
+	a->instance_offset = stream_write(sb,&instances[0],(int)(instances.size()*sizeof(float)));
+	if (a->indirect_buffer)
+		a->command_offset = stream_write(sb,&a->commands[0],(int)(a->commands.size()*sizeof(geometry_command)));
+	if (a->instance_offset < 0 || a->command_offset < 0) {
+		// out of room; keep the data and upload it ourselves in geometry_draw
+		a->source = a->instance_vbo;
+		a->instance_offset = a->command_offset = 0;
+		glBindBuffer(GL_ARRAY_BUFFER,a->instance_vbo);
+		glBufferData(GL_ARRAY_BUFFER,instances.size()*sizeof(float),&instances[0],GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER,0);
+		if (a->indirect_buffer) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER,a->indirect_buffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER,a->commands.size()*sizeof(geometry_command),&a->commands[0],GL_STREAM_DRAW);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+		}
+	}
+}
+
+void geometry_draw(geometry_arena* a, unsigned program)
+{
+	a->draw_calls = 0;
+	a->drawn_objects = 0;
+
+	GLint ploc = glGetAttribLocation(program,"p");
+	GLint mloc = glGetAttribLocation(program,"inst_M");   // and the three locations after it
+	GLint cloc = glGetAttribLocation(program,"inst_c");
+
+	glBindBuffer(GL_ARRAY_BUFFER,a->vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,a->ibo);
+	glVertexAttribPointer(ploc,4,GL_FLOAT,GL_FALSE,sizeof(vertex),BUFFER_OFFSET(offsetof(vertex,p)));
+	glEnableVertexAttribArray(ploc);
+
+	if (gl3wIsSupported(3,3)) {
+		if (!a->uploaded) {
+			// nothing streamed this frame; upload into our own buffers, orphaning last frame's data
+			static std::vector<float> instances;
+			gather(a,instances);
+			a->source = a->instance_vbo;
+			a->instance_offset = a->command_offset = 0;
+			if (!a->commands.empty()) {
+				glBindBuffer(GL_ARRAY_BUFFER,a->instance_vbo);
+				glBufferData(GL_ARRAY_BUFFER,instances.size()*sizeof(float),0,GL_STREAM_DRAW);
+				glBufferSubData(GL_ARRAY_BUFFER,0,instances.size()*sizeof(float),&instances[0]);
+				if (a->indirect_buffer) {
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER,a->indirect_buffer);
+					glBufferData(GL_DRAW_INDIRECT_BUFFER,a->commands.size()*sizeof(geometry_command),&a->commands[0],GL_STREAM_DRAW);
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+				}
+			}
+		}
+		a->uploaded = false;
+
+		if (!a->commands.empty()) {
+			glBindBuffer(GL_ARRAY_BUFFER,a->source);
+			for (int k = 0; k < 4; ++k) {
+				glEnableVertexAttribArray(mloc+k);
+				glVertexAttribDivisor(mloc+k,1);
+			}
+			glEnableVertexAttribArray(cloc);
+			glVertexAttribDivisor(cloc,1);
+			if (a->indirect_buffer)
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER,a->source == a->instance_vbo ? a->indirect_buffer : a->source);
+
+			// without base instances the instance attributes are moved to each mesh's objects instead
+			size_t first = 0;
+			for (size_t i = 0; i < a->commands.size(); ++i) {
+				const geometry_command& cmd = a->commands[i];
+				point_instances(mloc,cloc,a->instance_offset + first*GEOMETRY_INSTANCE_FLOATS*sizeof(float));
+				if (a->indirect_buffer)
+					glDrawElementsIndirect(GL_TRIANGLES,GL_UNSIGNED_INT,BUFFER_OFFSET(a->command_offset + i*sizeof(geometry_command)));
+				else
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES,cmd.count,GL_UNSIGNED_INT,
+						BUFFER_OFFSET(cmd.first_index*sizeof(unsigned)),cmd.instance_count,cmd.base_vertex);
+				first += cmd.instance_count;
+				a->draw_calls++;
+				a->drawn_objects += cmd.instance_count;
+			}
+
+			if (a->indirect_buffer)
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+			for (int k = 0; k < 4; ++k) {
+				glVertexAttribDivisor(mloc+k,0);
+				glDisableVertexAttribArray(mloc+k);
+			}
+			glVertexAttribDivisor(cloc,0);
+			glDisableVertexAttribArray(cloc);
+		}
+	} else {
+		// no instancing: the per-object values become constant attributes, one draw per object
+		for (size_t i = 0; i < a->meshes.size(); ++i) {
+			geometry_mesh* m = a->meshes[i];
+			if (m->queued.empty())
+				continue;
+			glVertexAttribPointer(ploc,4,GL_FLOAT,GL_FALSE,sizeof(vertex),BUFFER_OFFSET(m->first_vertex*sizeof(vertex) + offsetof(vertex,p)));
+			for (size_t j = 0; j < m->queued.size(); j += GEOMETRY_INSTANCE_FLOATS) {
+				const float* f = &m->queued[j];
+				for (int k = 0; k < 4; ++k)
+					glVertexAttrib4fv(mloc+k,f + 4*k);
+				glVertexAttrib4fv(cloc,f + 16);
+				glDrawElements(GL_TRIANGLES,m->index_count,GL_UNSIGNED_INT,BUFFER_OFFSET(m->first_index*sizeof(unsigned)));
+				a->draw_calls++;
+				a->drawn_objects++;
+			}
+			m->queued.clear();
+		}
+	}
+
+	glDisableVertexAttribArray(ploc);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+}
@@ -0,0 +1,118 @@
+#ifndef __GEOMETRY_H__
+#define __GEOMETRY_H__
+
+// geometry.h
+//    A geometry arena: every static mesh lives in one shared vertex buffer
+//    and one shared index buffer, suballocated from free lists, so drawing
+//    never switches buffers. Objects are queued each frame with their
+//    model matrix and colour; geometry_draw then submits every mesh's
+//    objects as one instanced draw, through an indirect command buffer
+//    where OpenGL 4 is available.
+
+#include "trimesh.h"
+#include "mat4x4.h"
+#include "stream.h"
+#include <vector>
+
+#define GEOMETRY_INSTANCE_FLOATS  20   // per object: model matrix (4 columns) and colour
+
+//
+// geometry_block -- a range of elements in one of the arena's buffers
+//
+struct geometry_block {
+	int offset;
+	int size;
+};
+
+//
+// geometry_allocator -- first-fit free list over 'capacity' elements;
+//                       free blocks are kept sorted and merged with their neighbours
+//
+struct geometry_allocator {
+	int capacity;
+	std::vector<geometry_block> free;
+};
+
+// returns the offset of 'size' free elements, or -1 if there is no room
+int  geometry_alloc(geometry_allocator& a, int size);
+void geometry_release(geometry_allocator& a, int offset, int size);
+
+//
+// geometry_mesh -- where one mesh lives in the arena, and its objects queued for this frame
+//
+struct geometry_mesh {
+	int first_vertex, vertex_count;
+	int first_index, index_count;   // indices are relative to first_vertex
+	std::vector<float> queued;      // GEOMETRY_INSTANCE_FLOATS per object
+};
+
+//
+// geometry_command -- one mesh's draw, laid out as OpenGL 4's DrawElementsIndirectCommand
+//
+struct geometry_command {
+	unsigned count;
+	unsigned instance_count;
+	unsigned first_index;
+	int      base_vertex;
+	unsigned base_instance;         // must be 0 before OpenGL 4.2
+};
+
+struct geometry_arena {
+	unsigned vbo, ibo;              // shared vertices ('vertex' structs) and 32-bit indices
+	unsigned instance_vbo;          // per-object data, when not streamed
+	unsigned indirect_buffer;       // draw commands when not streamed; 0 before OpenGL 4
+	geometry_allocator vertices, indices;
+	std::vector<geometry_mesh*> meshes;
+
+	std::vector<geometry_command> commands;   // this frame's draws, from geometry_upload
+	bool     uploaded;              // geometry_upload ran since the last geometry_draw
+	unsigned source;                // buffer holding this frame's instances and commands
+	int      instance_offset;       // byte offsets within it
+	int      command_offset;
+
+	int draw_calls;                 // statistics from the last geometry_draw
+	int drawn_objects;
+};
+
+// geometry_create
+//    Allocates buffers for up to max_vertices vertices and max_indices indices.
+//
+geometry_arena* geometry_create(int max_vertices, int max_indices);
+
+// geometry_add
+//    Copies 'tri' into the arena, sharing identical vertices. Returns 0 if
+//    the arena has no room left.
+//
+geometry_mesh* geometry_add(geometry_arena* a, const triangles& tri);
+
+// geometry_remove
+//    Frees a mesh's space in the arena for later meshes.
+//
+void geometry_remove(geometry_arena* a, geometry_mesh* m);
+
+// geometry_vertex_shader
+//    GLSL 1.20 vertex shader for arena meshes. It reads uniform P, the
+//    view matrix V from camera.h, and attributes p, inst_M (model matrix)
+//    and inst_c (colour), and writes varying p_col.
+//
+const char* geometry_vertex_shader();
+
+// geometry_queue
+//    Queues one object using mesh 'm' for the next geometry_draw.
+//
+void geometry_queue(geometry_mesh* m, const mat4x4& M, const vec4& clr);
+
+// geometry_upload
+//    Writes the queued objects and their draw commands into the frame's
+//    stream buffer (between stream_map and stream_unmap). Optional;
+//    otherwise geometry_draw uploads them into buffers of its own.
+//
+void geometry_upload(geometry_arena* a, stream_buffer* sb);
+
+// geometry_draw
+//    Draws every queued object with 'program' (bound, with P and V set)
+//    and empties the queues.
+//
+void geometry_draw(geometry_arena* a, unsigned program);
+
+#endif // __GEOMETRY_H__
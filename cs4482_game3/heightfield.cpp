@@ -0,0 +1,66 @@
+#include "heightfield.h"
+#include <cstring>
+
+heightfield* heightfield_create(const bitmap* bm, float max_height)
+{
+	heightfield* hf = new heightfield;
+	hf->wd = bm->wd;
+	hf->ht = bm->ht;
+	hf->x0 = -bm->wd/2;
+	hf->z0 = -bm->ht/2;
+	hf->scale = max_height/65536;
+	hf->offset = 0;
+	hf->samples = new unsigned short[(size_t)bm->wd*bm->ht];
+	for (size_t i = 0; i < (size_t)bm->wd*bm->ht; ++i)
+		hf->samples[i] = (unsigned short)(bm->pixels[4*i] << 8);
+	return hf;
+}
+
+heightfield* heightfield_load(const char* filename, float max_height)
+{
+	bitmap* bm = bitmap_load(filename);
+	heightfield* hf = heightfield_create(bm,max_height);
+	bitmap_delete(bm);
+	return hf;
+}
+
+void heightfield_delete(heightfield* hf)
+{
+	delete [] hf->samples;
+	delete hf;
+}
+
+bitmask* bitmask_create(const bitmap* bm)
+{
+	bitmask* bits = new bitmask;
+	bits->wd = bm->wd;
+	bits->ht = bm->ht;
+	bits->x0 = -bm->wd/2;
+	bits->z0 = -bm->ht/2;
+	bits->words_per_row = (bm->wd + 31)/32;
+	size_t words = (size_t)bits->words_per_row*bm->ht;
+	bits->words = new unsigned[words];
+	memset(bits->words,0,words*sizeof(unsigned));
+	for (int j = 0; j < bm->ht; ++j) {
+		const unsigned char* p = bm->pixels + 4*(size_t)bm->wd*j;
+		unsigned* row = bits->words + (size_t)bits->words_per_row*j;
+		for (int i = 0; i < bm->wd; ++i, p += 4)
+			if (p[0])
+				row[i >> 5] |= 1u << (i & 31);
+	}
+	return bits;
+}
+
+bitmask* bitmask_load(const char* filename)
+{
+	bitmap* bm = bitmap_load(filename);
+	bitmask* bits = bitmask_create(bm);
+	bitmap_delete(bm);
+	return bits;
+}
+
+void bitmask_delete(bitmask* bits)
+{
+	delete [] bits->words;
+	delete bits;
+}
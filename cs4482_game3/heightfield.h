@@ -0,0 +1,102 @@
+#ifndef __HEIGHTFIELD_H__
+#define __HEIGHTFIELD_H__
+
+// heightfield.h
+//    Map images decoded once into the smallest form their lookups need.
+//    A heightfield keeps one 16-bit sample per pixel (half the memory of
+//    the BGRA bitmap, and room for 16-bit heightmaps) with the scale and
+//    offset that turn it into a height; a bitmask keeps one bit per pixel
+//    (a thirty-second). Both are centred on the world origin with one
+//    world unit per pixel, as the game lays out the valley, and their
+//    accessors are plain array reads that are safe outside the map.
+
+#include "cs3388lib.h"
+
+struct heightfield {
+	int    wd, ht;             // samples per row, and rows
+	int    x0, z0;             // world position of sample (0,0)
+	float  scale;              // world height per step of a sample
+	float  offset;             // world height of a sample of 0
+	unsigned short* samples;   // row by row, z increasing
+};
+
+//
+// bitmask -- one bit per pixel of a map image
+//
+struct bitmask {
+	int    wd, ht;
+	int    x0, z0;             // world position of bit (0,0)
+	int    words_per_row;
+	unsigned* words;           // bit i of a row is bit i%32 of word i/32
+};
+
+// heightfield_create
+//    Decodes the first channel of a heightmap; a pixel value v stands
+//    for a height of max_height*v/256.
+//
+heightfield* heightfield_create(const bitmap* bm, float max_height);
+
+// heightfield_load
+//    Same, from an image file, which is freed once decoded.
+//
+heightfield* heightfield_load(const char* filename, float max_height);
+
+void heightfield_delete(heightfield* hf);
+
+// heightfield_sample
+//    Height of sample (i,j), clamped to the edge of the grid.
+//
+inline float heightfield_sample(const heightfield* hf, int i, int j)
+{
+	i = i < 0 ? 0 : i >= hf->wd ? hf->wd-1 : i;
+	j = j < 0 ? 0 : j >= hf->ht ? hf->ht-1 : j;
+	return hf->offset + hf->scale*hf->samples[j*hf->wd + i];
+}
+
+// heightfield_height
+//    Height at world position (x,z), clamped to the edge of the map.
+//
+inline float heightfield_height(const heightfield* hf, int x, int z)
+{
+	return heightfield_sample(hf,x - hf->x0,z - hf->z0);
+}
+
+// heightfield_top
+//    A height no sample can reach or exceed.
+//
+inline float heightfield_top(const heightfield* hf)
+{
+	return hf->offset + hf->scale*65536;
+}
+
+// bitmask_create
+//    Sets the bits of the pixels whose first channel is not zero.
+//
+bitmask* bitmask_create(const bitmap* bm);
+
+// bitmask_load
+//    Same, from an image file, which is freed once decoded.
+//
+bitmask* bitmask_load(const char* filename);
+
+void bitmask_delete(bitmask* bits);
+
+// bitmask_bit
+//    Bit (i,j); false outside the mask.
+//
+inline bool bitmask_bit(const bitmask* bits, int i, int j)
+{
+	if ((unsigned)i >= (unsigned)bits->wd || (unsigned)j >= (unsigned)bits->ht)
+		return false;
+	return (bits->words[j*bits->words_per_row + (i >> 5)] >> (i & 31)) & 1;
+}
+
+// bitmask_at
+//    The bit at world position (x,z); false outside the map.
+//
+inline bool bitmask_at(const bitmask* bits, int x, int z)
+{
+	return bitmask_bit(bits,x - bits->x0,z - bits->z0);
+}
+
+#endif // __HEIGHTFIELD_H__
@@ -0,0 +1,731 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "image.h"
+#include "inflate.h"
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+
+#define MAX_IMAGE_SIDE  32768   // refuse anything larger; it is surely a corrupt header
+#define READ_BUFFER     65536   // bytes of a file read at a time
+#define MAX_BMP_HEADER  1024    // the largest BMP info header is 124 bytes
+
+static unsigned get_be32(const unsigned char* p) { return (unsigned)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+static unsigned get_le32(const unsigned char* p) { return (unsigned)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]; }
+static unsigned get_le16(const unsigned char* p) { return (unsigned)p[1] << 8 | p[0]; }
+
+// image_bitmap
+//    A bitmap for wd*ht pixels, left uninitialised since the decoder
+//    writes every pixel.
+//
+static bitmap* image_bitmap(int wd, int ht)
+{
+	bitmap* bm = new bitmap;
+	bm->wd = wd;
+	bm->ht = ht;
+	bm->pixels = new unsigned char[4*(size_t)wd*ht];
+	bm->dirty_x0 = bm->dirty_y0 = 0;
+	bm->dirty_x1 = wd;
+	bm->dirty_y1 = ht;
+	bm->texture = 0;
+	bm->upload[0] = bm->upload[1] = 0;
+	bm->upload_next = 0;
+	return bm;
+}
+
+static void image_free(bitmap* bm)
+{
+	delete [] bm->pixels;
+	delete bm;
+}
+
+//
+// image_reader -- the bytes of a file, or of memory, from front to back
+//
+// The decoders look at the bytes in hand, p to end, asking for more with
+// reader_fill. In memory they are all in hand from the start; a file is
+// read into the buffer a piece at a time, so the whole of it is never
+// held at once.
+//
+struct image_reader {
+	FILE* fh;                        // 0 for memory
+	const unsigned char* p;
+	const unsigned char* end;
+	std::vector<unsigned char> buffer;
+};
+
+// reader_fill
+//    Makes at least n bytes (n not much more than READ_BUFFER) be in hand
+//    unless the data ends first; returns how many there are. Pointers to
+//    the bytes in hand do not survive it.
+//
+static size_t reader_fill(image_reader& r, size_t n)
+{
+	size_t have = (size_t)(r.end - r.p);
+	if (have >= n || !r.fh)
+		return have;
+	if (r.buffer.size() < n || r.buffer.size() < READ_BUFFER) {
+		std::vector<unsigned char> bigger(std::max(n,(size_t)READ_BUFFER));
+		if (have)
+			memcpy(&bigger[0],r.p,have);
+		r.buffer.swap(bigger);
+	} else if (have) {
+		memmove(&r.buffer[0],r.p,have);
+	}
+	have += fread(&r.buffer[have],1,r.buffer.size() - have,r.fh);
+	r.p = &r.buffer[0];
+	r.end = r.p + have;
+	return have;
+}
+
+// reader_skip
+//    Passes over n bytes; false if the data ends first (for a file, that
+//    shows only at the next reader_fill).
+//
+static bool reader_skip(image_reader& r, size_t n)
+{
+	size_t have = (size_t)(r.end - r.p);
+	if (n <= have) {
+		r.p += n;
+		return true;
+	}
+	r.p = r.end;
+	return r.fh && n - have <= LONG_MAX && fseek(r.fh,(long)(n - have),SEEK_CUR) == 0;
+}
+
+//////////////////////////////////////////////////////////////// PNG
+
+struct png_info {
+	int wd, ht;
+	int depth;                  // bits per sample: 1, 2, 4, 8 or 16
+	int colour;                 // 0 grey, 2 RGB, 3 paletted, 4 grey+alpha, 6 RGBA
+	int channels;               // samples per pixel
+	int filter_bpp;             // bytes per pixel as the filters see them, at least 1
+	size_t stride;              // bytes per row, not counting its filter byte
+	unsigned char palette[256][4];  // R,G,B,A
+};
+
+static unsigned char paeth(unsigned char a, unsigned char b, unsigned char c)
+{
+	int p = a + b - c;
+	int pa = p > a ? p-a : a-p;
+	int pb = p > b ? p-b : b-p;
+	int pc = p > c ? p-c : c-p;
+	return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+// png_unfilter
+//    Undoes the filter of one row of n bytes in place; 'prev' is the row
+//    above, already unfiltered, or 0 for the first row.
+//
+static bool png_unfilter(int filter, unsigned char* line, const unsigned char* prev, size_t n, int bpp)
+{
+	size_t j;
+	switch (filter) {
+	case 0: // none
+		break;
+	case 1: // sub
+		for (j = bpp; j < n; ++j)
+			line[j] += line[j-bpp];
+		break;
+	case 2: // up
+		if (prev) {
+			for (j = 0; j + 16 <= n; j += 16) {
+				__m128i x = _mm_loadu_si128((const __m128i*)(line+j));
+				_mm_storeu_si128((__m128i*)(line+j),_mm_add_epi8(x,_mm_loadu_si128((const __m128i*)(prev+j))));
+			}
+			for (; j < n; ++j)
+				line[j] += prev[j];
+		}
+		break;
+	case 3: // average
+		if (prev) {
+			for (j = 0; j < (size_t)bpp; ++j)
+				line[j] += prev[j]/2;
+			for (; j < n; ++j)
+				line[j] += (line[j-bpp] + prev[j])/2;
+		} else {
+			for (j = bpp; j < n; ++j)
+				line[j] += line[j-bpp]/2;
+		}
+		break;
+	case 4: // paeth, which is 'sub' when there is no row above
+		if (prev) {
+			for (j = 0; j < (size_t)bpp; ++j)
+				line[j] += prev[j];
+			for (; j < n; ++j)
+				line[j] += paeth(line[j-bpp],prev[j],prev[j-bpp]);
+		} else {
+			for (j = bpp; j < n; ++j)
+				line[j] += line[j-bpp];
+		}
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+// expand_rgb8
+//    8-bit RGB or RGBA pixels (bpp 3 or 4) to RGBA, or to BGRA if 'swap'.
+//
+static void expand_rgb8(const unsigned char* src, unsigned char* dst, int wd, int bpp, bool swap)
+{
+	int x = 0;
+	if (bpp == 4) {
+		// four pixels at a time, exchanging bytes 0 and 2 of each
+		__m128i keep = _mm_set1_epi32(0xff00ff00), low = _mm_set1_epi32(0xff);
+		for (; x + 4 <= wd; x += 4, src += 16, dst += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)src);
+			if (swap)
+				v = _mm_or_si128(_mm_and_si128(v,keep),
+				                 _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v,16),low),_mm_slli_epi32(_mm_and_si128(v,low),16)));
+			_mm_storeu_si128((__m128i*)dst,v);
+		}
+	}
+	for (; x < wd; ++x, src += bpp, dst += 4) {
+		unsigned v = src[0] | src[1] << 8 | src[2] << 16 | (bpp == 4 ? (unsigned)src[3] << 24 : 0xff000000u);
+		if (swap)
+			v = (v & 0xff00ff00u) | (v >> 16 & 0xffu) | (v & 0xffu) << 16;
+		memcpy(dst,&v,4);
+	}
+}
+
+// The 8-bit RGB and RGBA rows that make up most files are unfiltered a
+// pixel at a time in SSE2 registers, one 16-bit lane per channel, and each
+// pixel is written to the bitmap as soon as it is known.
+
+static inline __m128i load_pixel(const unsigned char* p, int bpp)
+{
+	int v;
+	if (bpp == 4) memcpy(&v,p,4);
+	else          v = p[0] | p[1] << 8 | p[2] << 16;   // byte loads; a 3-byte memcpy goes through the stack
+	return _mm_unpacklo_epi8(_mm_cvtsi32_si128(v),_mm_setzero_si128());
+}
+
+// store_pixel
+//    Writes x back over the filtered bytes (the row below needs them) and
+//    to the bitmap, swapping red and blue unless the bitmap is RGBA.
+//
+static inline void store_pixel(__m128i x, unsigned char* p, int bpp, unsigned char* dst, bool swap, unsigned alpha)
+{
+	unsigned v = (unsigned)_mm_cvtsi128_si32(_mm_packus_epi16(x,x));
+	if (bpp == 4) {
+		memcpy(p,&v,4);
+	} else {
+		p[0] = (unsigned char)v;
+		p[1] = (unsigned char)(v >> 8);
+		p[2] = (unsigned char)(v >> 16);
+	}
+	if (swap)
+		v = (v & 0xff00ff00u) | (v >> 16 & 0xffu) | (v & 0xffu) << 16;
+	v |= alpha;
+	memcpy(dst,&v,4);
+}
+
+// paeth_sse2
+//    The Paeth predictor for four channels at once: whichever of a (left),
+//    b (above) and c (above left) is nearest a+b-c, ties going to a, then b.
+//
+static inline __m128i paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i pa = _mm_sub_epi16(b,c);        // p-a
+	__m128i pb = _mm_sub_epi16(a,c);        // p-b
+	__m128i pc = _mm_add_epi16(pa,pb);      // p-c
+	pa = _mm_max_epi16(pa,_mm_sub_epi16(zero,pa));
+	pb = _mm_max_epi16(pb,_mm_sub_epi16(zero,pb));
+	pc = _mm_max_epi16(pc,_mm_sub_epi16(zero,pc));
+	__m128i smallest = _mm_min_epi16(pc,_mm_min_epi16(pa,pb));
+	__m128i use_a = _mm_cmpeq_epi16(smallest,pa);
+	__m128i use_b = _mm_andnot_si128(use_a,_mm_cmpeq_epi16(smallest,pb));
+	__m128i use_c = _mm_andnot_si128(_mm_or_si128(use_a,use_b),_mm_set1_epi16(-1));
+	return _mm_or_si128(_mm_or_si128(_mm_and_si128(use_a,a),_mm_and_si128(use_b,b)),_mm_and_si128(use_c,c));
+}
+
+// png_unfilter_pixels
+//    png_unfilter and png_expand in one pass, for rows of 3- or 4-byte
+//    pixels. 'prev' is the unfiltered row above, or 0 for the first row.
+//    The filters without a chain from pixel to pixel, none and up, are
+//    faster as two passes that each work on 16 bytes at a time.
+//
+static bool png_unfilter_pixels(int filter, unsigned char* line, const unsigned char* prev, int wd, int bpp, unsigned char* dst, bool swap)
+{
+	if (filter == 0 || filter == 2) {
+		png_unfilter(filter,line,prev,(size_t)wd*bpp,bpp);
+		expand_rgb8(line,dst,wd,bpp,swap);
+		return true;
+	}
+	static const unsigned char no_row[4] = { 0, 0, 0, 0 };
+	int prev_step = bpp;
+	if (!prev) {
+		prev = no_row;      // a row of zeros: the same pixel over and over
+		prev_step = 0;
+	}
+	unsigned alpha = bpp == 3 ? 0xff000000u : 0;
+	__m128i mask = _mm_set1_epi16(0xff);
+	__m128i a = _mm_setzero_si128(), c = a;  // left and above-left start out as zero
+	switch (filter) {
+	case 1: // sub
+		for (int x = 0; x < wd; ++x, line += bpp, dst += 4) {
+			a = _mm_and_si128(_mm_add_epi16(load_pixel(line,bpp),a),mask);
+			store_pixel(a,line,bpp,dst,swap,alpha);
+		}
+		break;
+	case 3: // average, rounding down
+		for (int x = 0; x < wd; ++x, line += bpp, prev += prev_step, dst += 4) {
+			__m128i b = load_pixel(prev,bpp);
+			__m128i avg = _mm_srli_epi16(_mm_add_epi16(a,b),1);
+			a = _mm_and_si128(_mm_add_epi16(load_pixel(line,bpp),avg),mask);
+			store_pixel(a,line,bpp,dst,swap,alpha);
+		}
+		break;
+	case 4: // paeth
+		for (int x = 0; x < wd; ++x, line += bpp, prev += prev_step, dst += 4) {
+			__m128i b = load_pixel(prev,bpp);
+			a = _mm_and_si128(_mm_add_epi16(load_pixel(line,bpp),paeth_sse2(a,b,c)),mask);
+			c = b;
+			store_pixel(a,line,bpp,dst,swap,alpha);
+		}
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+// png_expand
+//    Writes one unfiltered row as wd pixels with red at dst[ri] and blue
+//    at dst[bi]. 16-bit samples keep their high byte.
+//
+static void png_expand(const png_info& png, const unsigned char* src, unsigned char* dst, int ri, int bi)
+{
+	int wd = png.wd;
+	if (png.depth < 8) {
+		// grey levels or palette indices packed into bytes, first pixel in the high bits
+		int mask = (1 << png.depth) - 1, per_byte = 8/png.depth;
+		int grey_scale = 255/mask;
+		for (int x = 0; x < wd; ++x, dst += 4) {
+			int v = (src[x/per_byte] >> (8 - png.depth*(x%per_byte + 1))) & mask;
+			if (png.colour == 3) {
+				dst[ri] = png.palette[v][0]; dst[1] = png.palette[v][1];
+				dst[bi] = png.palette[v][2]; dst[3] = png.palette[v][3];
+			} else {
+				dst[0] = dst[1] = dst[2] = (unsigned char)(v*grey_scale);
+				dst[3] = 255;
+			}
+		}
+		return;
+	}
+
+	int step = png.depth/8;   // bytes per sample
+	switch (png.colour) {
+	case 0:
+		for (int x = 0; x < wd; ++x, src += step, dst += 4) {
+			dst[0] = dst[1] = dst[2] = src[0];
+			dst[3] = 255;
+		}
+		break;
+	case 2:
+		if (step == 1) {
+			expand_rgb8(src,dst,wd,3,ri == 2);
+			break;
+		}
+		for (int x = 0; x < wd; ++x, src += 3*step, dst += 4) {
+			dst[ri] = src[0]; dst[1] = src[step]; dst[bi] = src[2*step];
+			dst[3] = 255;
+		}
+		break;
+	case 3:
+		for (int x = 0; x < wd; ++x, ++src, dst += 4) {
+			const unsigned char* p = png.palette[*src];
+			dst[ri] = p[0]; dst[1] = p[1]; dst[bi] = p[2]; dst[3] = p[3];
+		}
+		break;
+	case 4:
+		for (int x = 0; x < wd; ++x, src += 2*step, dst += 4) {
+			dst[0] = dst[1] = dst[2] = src[0];
+			dst[3] = src[step];
+		}
+		break;
+	case 6:
+		if (step == 1) {
+			expand_rgb8(src,dst,wd,4,ri == 2);
+			break;
+		}
+		for (int x = 0; x < wd; ++x, src += 4*step, dst += 4) {
+			dst[ri] = src[0]; dst[1] = src[step]; dst[bi] = src[2*step];
+			dst[3] = src[3*step];
+		}
+		break;
+	}
+}
+
+static bool png_header(const unsigned char* ihdr, png_info& png)
+{
+	static const unsigned char channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+	png.wd = (int)get_be32(ihdr);
+	png.ht = (int)get_be32(ihdr+4);
+	png.depth = ihdr[8];
+	png.colour = ihdr[9];
+	if (png.wd <= 0 || png.ht <= 0 || png.wd > MAX_IMAGE_SIDE || png.ht > MAX_IMAGE_SIDE)
+		return false;
+	if (png.colour > 6 || !channels[png.colour])
+		return false;
+	if (ihdr[10] != 0 || ihdr[11] != 0 || ihdr[12] != 0)  // deflate, adaptive filters, not interlaced
+		return false;
+	bool low_depth = png.depth == 1 || png.depth == 2 || png.depth == 4;
+	if (png.depth == 16 ? png.colour == 3 : png.depth != 8 && !(low_depth && (png.colour == 0 || png.colour == 3)))
+		return false;
+	png.channels = channels[png.colour];
+	png.filter_bpp = (png.channels*png.depth + 7)/8;
+	png.stride = ((size_t)png.wd*png.channels*png.depth + 7)/8;
+	for (int i = 0; i < 256; ++i) {
+		png.palette[i][0] = png.palette[i][1] = png.palette[i][2] = 0;
+		png.palette[i][3] = 255;
+	}
+	return true;
+}
+
+// png_idat
+//    Hands the contents of the IDAT chunks to inflate as they are read,
+//    however the encoder split up the zlib stream.
+//
+struct png_idat {
+	image_reader* r;
+	size_t left;         // bytes of the current chunk not yet handed on
+	bool   in_chunk;     // its CRC is still to be passed over
+};
+
+static bool png_next_idat(void* arg, const unsigned char** body, size_t* len)
+{
+	png_idat& c = *(png_idat*)arg;
+	image_reader& r = *c.r;
+	while (!c.left) {
+		if (c.in_chunk && (reader_fill(r,4) < 4 || !reader_skip(r,4)))
+			return false;    // the CRC
+		c.in_chunk = false;
+		if (reader_fill(r,8) < 8 || memcmp(r.p+4,"IDAT",4) != 0)
+			return false;    // IDAT chunks are consecutive
+		c.left = get_be32(r.p);
+		c.in_chunk = true;
+		reader_skip(r,8);
+	}
+	size_t have = reader_fill(r,1);
+	if (!have)
+		return false;
+	*body = r.p;
+	*len = std::min(have,c.left);
+	r.p += *len;
+	c.left -= *len;
+	return true;
+}
+
+// png_rows
+//    Takes the inflated rows as they come and unfilters each as soon as
+//    it is whole, writing its pixels straight to their row of the bitmap.
+//    Only the row being gathered and the one above it are kept.
+//
+struct png_rows {
+	const png_info* png;
+	bitmap* bm;
+	int    flags;
+	size_t filled;        // bytes of 'line' gathered so far
+	int    y;             // row being gathered
+	std::vector<unsigned char> lines;   // two rows, each with its filter byte
+	unsigned char* line;
+	unsigned char* prev;
+};
+
+static bool png_row(png_rows& r)
+{
+	const png_info& png = *r.png;
+	int y = r.y;
+	unsigned char* dst = r.bm->pixels + 4*(size_t)png.wd*((r.flags & IMAGE_BOTTOM_UP) ? png.ht-1-y : y);
+	const unsigned char* prev = y ? r.prev+1 : 0;
+	if (png.depth == 8 && (png.colour == 2 || png.colour == 6))
+		return png_unfilter_pixels(r.line[0],r.line+1,prev,png.wd,png.channels,dst,!(r.flags & IMAGE_RGBA));
+	if (!png_unfilter(r.line[0],r.line+1,prev,png.stride,png.filter_bpp))
+		return false;
+	int ri = (r.flags & IMAGE_RGBA) ? 0 : 2, bi = 2 - ri;
+	png_expand(png,r.line+1,dst,ri,bi);
+	return true;
+}
+
+static bool png_take_rows(void* arg, const unsigned char* data, size_t size)
+{
+	png_rows& r = *(png_rows*)arg;
+	size_t row = r.png->stride + 1;
+	while (size) {
+		if (r.y == r.png->ht)
+			return false;    // more data than rows
+		size_t n = std::min(size,row - r.filled);
+		memcpy(r.line + r.filled,data,n);
+		r.filled += n;
+		data += n;
+		size -= n;
+		if (r.filled == row) {
+			if (!png_row(r))
+				return false;
+			std::swap(r.line,r.prev);
+			r.filled = 0;
+			r.y++;
+		}
+	}
+	return true;
+}
+
+static bitmap* load_png(image_reader& in, int flags)
+{
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	if (reader_fill(in,8+25) < 8+25 || memcmp(in.p,signature,8) != 0 || memcmp(in.p+12,"IHDR",4) != 0)
+		return 0;
+	png_info png;
+	if (!png_header(in.p+16,png))
+		return 0;
+	reader_skip(in,8);
+
+	// read the palette, up to the first IDAT
+	for (;;) {
+		if (reader_fill(in,8) < 8)
+			return 0;
+		size_t len = get_be32(in.p);
+		bool idat = memcmp(in.p+4,"IDAT",4) == 0;
+		bool plte = memcmp(in.p+4,"PLTE",4) == 0;
+		bool trns = memcmp(in.p+4,"tRNS",4) == 0 && png.colour == 3;
+		if (idat)
+			break;
+		if (memcmp(in.p+4,"IEND",4) == 0)
+			return 0;
+		reader_skip(in,8);
+		if (plte || trns) {
+			size_t n = std::min(len,(size_t)(plte ? 3*256 : 256));
+			if (reader_fill(in,n) < n)
+				return 0;
+			for (size_t i = 0; plte && i < n/3; ++i)
+				for (int c = 0; c < 3; ++c)
+					png.palette[i][c] = in.p[3*i+c];
+			for (size_t i = 0; trns && i < n; ++i)
+				png.palette[i][3] = in.p[i];
+		}
+		if (!reader_skip(in,len + 4))
+			return 0;
+	}
+
+	bitmap* bm = image_bitmap(png.wd,png.ht);
+	png_rows rows;
+	rows.png = &png;
+	rows.bm = bm;
+	rows.flags = flags;
+	rows.filled = 0;
+	rows.y = 0;
+	rows.lines.resize(2*(png.stride + 1));
+	rows.line = &rows.lines[0];
+	rows.prev = rows.line + png.stride + 1;
+	png_idat idat = { &in, 0, false };
+	bool ok = inflate_stream(png_take_rows,&rows,png_next_idat,&idat) == INFLATE_OK && rows.y == png.ht;
+
+	// inflate stops at the end of the deflate data; the chunk it was in must be whole too,
+	// up to the last byte of its CRC
+	if (ok && idat.in_chunk)
+		ok = reader_skip(in,idat.left + 3) && reader_fill(in,1) >= 1;
+	if (!ok) {
+		image_free(bm);
+		return 0;
+	}
+	return bm;
+}
+
+//////////////////////////////////////////////////////////////// BMP
+
+static bitmap* load_bmp(image_reader& in, int flags)
+{
+	if (reader_fill(in,54) < 54 || in.p[0] != 'B' || in.p[1] != 'M')
+		return 0;
+	const unsigned char* data = in.p;
+	size_t offset = get_le32(data+10);
+	size_t header = get_le32(data+14);
+	if (header < 40 || header > MAX_BMP_HEADER)
+		return 0;   // OS/2 headers are not worth the trouble
+	int wd = (int)get_le32(data+18);
+	int ht = (int)get_le32(data+22);
+	int bits = get_le16(data+28);
+	unsigned compression = get_le32(data+30);
+	unsigned colours = get_le32(data+46);
+	bool top_down = ht < 0;
+	if (top_down)
+		ht = -ht;
+	if (wd <= 0 || ht <= 0 || wd > MAX_IMAGE_SIDE || ht > MAX_IMAGE_SIDE)
+		return 0;
+	if (bits != 1 && bits != 4 && bits != 8 && bits != 24 && bits != 32)
+		return 0;
+	if (compression == 3 && bits == 32 && reader_fill(in,66) >= 66) {
+		// bit fields are fine as long as they are the usual ones
+		data = in.p;
+		if (get_le32(data+54) != 0x00ff0000 || get_le32(data+58) != 0x0000ff00 || get_le32(data+62) != 0x000000ff)
+			return 0;
+	} else if (compression != 0) {
+		return 0;
+	}
+
+	unsigned char palette[4*256];   // B,G,R,unused
+	if (bits <= 8) {
+		if (!colours || colours > (1u << bits))
+			colours = 1 << bits;
+		size_t end = 14 + header + 4*colours;
+		if (end > offset || reader_fill(in,end) < end)
+			return 0;
+		memcpy(palette,in.p + 14 + header,4*colours);
+	}
+	if (!reader_skip(in,offset))
+		return 0;
+
+	size_t stride = (((size_t)wd*bits + 31)/32)*4;
+	bitmap* bm = image_bitmap(wd,ht);
+	int ri = (flags & IMAGE_RGBA) ? 0 : 2, bi = 2 - ri;
+	bool flip = top_down == ((flags & IMAGE_BOTTOM_UP) != 0);
+	for (int y = 0; y < ht; ++y) {
+		if (reader_fill(in,stride) < stride) {
+			image_free(bm);
+			return 0;
+		}
+		const unsigned char* src = in.p;
+		in.p += stride;
+		unsigned char* dst = bm->pixels + 4*(size_t)wd*(flip ? ht-1-y : y);
+		switch (bits) {
+		case 32:
+			for (int x = 0; x < wd; ++x, src += 4, dst += 4) {
+				dst[bi] = src[0]; dst[1] = src[1]; dst[ri] = src[2]; dst[3] = src[3];
+			}
+			break;
+		case 24:
+			for (int x = 0; x < wd; ++x, src += 3, dst += 4) {
+				dst[bi] = src[0]; dst[1] = src[1]; dst[ri] = src[2]; dst[3] = 255;
+			}
+			break;
+		default: {
+			int mask = (1 << bits) - 1, per_byte = 8/bits;
+			for (int x = 0; x < wd; ++x, dst += 4) {
+				unsigned i = (src[x/per_byte] >> (8 - bits*(x%per_byte + 1))) & mask;
+				const unsigned char* p = palette + 4*(i < colours ? i : 0);
+				dst[bi] = p[0]; dst[1] = p[1]; dst[ri] = p[2]; dst[3] = 255;
+			}
+			break;
+		}
+		}
+	}
+	return bm;
+}
+
+//////////////////////////////////////////////////////////////// QOI
+
+static bitmap* load_qoi(image_reader& in, int flags)
+{
+	if (reader_fill(in,14+8) < 14+8 || memcmp(in.p,"qoif",4) != 0)
+		return 0;
+	const unsigned char* data = in.p;
+	int wd = (int)get_be32(data+4);
+	int ht = (int)get_be32(data+8);
+	if (wd <= 0 || ht <= 0 || wd > MAX_IMAGE_SIDE || ht > MAX_IMAGE_SIDE || (data[12] != 3 && data[12] != 4))
+		return 0;
+
+	bitmap* bm = image_bitmap(wd,ht);
+	int ri = (flags & IMAGE_RGBA) ? 0 : 2, bi = 2 - ri;
+	unsigned char index[64][4], px[4] = { 0,0,0,255 };   // R,G,B,A
+	memset(index,0,sizeof(index));
+	reader_skip(in,14);
+	const unsigned char* p = in.p;
+	int run = 0;
+	for (int y = 0; y < ht; ++y) {
+		unsigned char* dst = bm->pixels + 4*(size_t)wd*((flags & IMAGE_BOTTOM_UP) ? ht-1-y : y);
+		for (int x = 0; x < wd; ++x, dst += 4) {
+			if (run) {
+				--run;
+			} else {
+				if (in.end - p < 5+8) {
+					// the longest op, and the end marker, which no op may run into
+					in.p = p;
+					reader_fill(in,5+8);
+					p = in.p;
+				}
+				size_t left = (size_t)(in.end - p);
+				if (left <= 8) {
+					image_free(bm);
+					return 0;
+				}
+				int op = *p++;
+				--left;
+				if (op == 0xfe || op == 0xff) {
+					if (left < (op == 0xff ? 4u : 3u) + 8) {
+						image_free(bm);
+						return 0;
+					}
+					px[0] = p[0]; px[1] = p[1]; px[2] = p[2];
+					if (op == 0xff)
+						px[3] = p[3];
+					p += op == 0xff ? 4 : 3;
+				} else if (op < 0x40) {
+					memcpy(px,index[op],4);
+				} else if (op < 0x80) {
+					px[0] += ((op >> 4) & 3) - 2;
+					px[1] += ((op >> 2) & 3) - 2;
+					px[2] += (op & 3) - 2;
+				} else if (op < 0xc0) {
+					if (left < 1+8) {
+						image_free(bm);
+						return 0;
+					}
+					int dg = (op & 63) - 32;
+					px[0] += dg - 8 + (*p >> 4);
+					px[1] += dg;
+					px[2] += dg - 8 + (*p & 15);
+					++p;
+				} else {
+					run = op & 63;
+				}
+				memcpy(index[(px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) & 63],px,4);
+			}
+			dst[ri] = px[0]; dst[1] = px[1]; dst[bi] = px[2]; dst[3] = px[3];
+		}
+	}
+	return bm;
+}
+
+////////////////////////////////////////////////////////////////
+
+static bitmap* load(image_reader& in, int flags)
+{
+	if (reader_fill(in,8) < 8)
+		return 0;
+	const unsigned char* data = in.p;
+	if (data[0] == 137 && data[1] == 'P' && data[2] == 'N' && data[3] == 'G')
+		return load_png(in,flags);
+	if (data[0] == 'B' && data[1] == 'M')
+		return load_bmp(in,flags);
+	if (memcmp(data,"qoif",4) == 0)
+		return load_qoi(in,flags);
+	return 0;
+}
+
+bitmap* image_decode(const unsigned char* data, size_t size, int flags)
+{
+	image_reader in;
+	in.fh = 0;
+	in.p = data;
+	in.end = data + size;
+	return load(in,flags);
+}
+
+bitmap* image_load(const char* filename, int flags)
+{
+	image_reader in;
+	in.fh = fopen(filename,"rb");
+	if (!in.fh)
+		return 0;
+	in.p = in.end = 0;
+	bitmap* bm = load(in,flags);
+	fclose(in.fh);
+	return bm;
+}
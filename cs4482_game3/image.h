@@ -0,0 +1,33 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+// image.h
+//    Reads PNG, BMP and QOI files without help from the operating system.
+//    Pixels are decoded straight into the memory of the bitmap that is
+//    returned, already in the row order and channel order asked for, so
+//    loading allocates the pixels once and touches each of them once.
+//    Files are read a buffer at a time rather than whole, and a PNG is
+//    inflated and unfiltered a row at a time as its IDAT chunks are read.
+
+#include "cs3388lib.h"
+#include <cstddef>
+
+#define IMAGE_BOTTOM_UP  1   // row 0 is the bottom of the picture, as OpenGL expects
+#define IMAGE_RGBA       2   // R,G,B,A bytes instead of the bitmap's usual B,G,R,A
+
+// image_load
+//    Decodes a .png (8- or 16-bit grey, grey+alpha, RGB or RGBA, or
+//    paletted, not interlaced), a .bmp (1, 4, 8, 24 or 32 bits, not
+//    run-length encoded) or a .qoi file. 'flags' combines the IMAGE_
+//    constants.
+//    Returns 0 if the file is missing or not in a supported format;
+//    free the result with bitmap_delete.
+//
+bitmap* image_load(const char* filename, int flags = 0);
+
+// image_decode
+//    Same, for a file already in memory.
+//
+bitmap* image_decode(const unsigned char* data, size_t size, int flags = 0);
+
+#endif // __IMAGE_H__
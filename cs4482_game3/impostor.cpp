@@ -0,0 +1,289 @@
+#include "impostor.h"
+#include "mat4x4.h"
+#include "cs3388lib.h"
+#include "camera.h"
+#include "gl3w.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#define PI					3.14159265359f
+
+#define BUFFER_OFFSET(bytes) ((const char*)(0) + (bytes))
+
+static bool file_exists(const char* filename)
+{
+	FILE* fh;
+	if (fopen_s(&fh,filename,"rb") != 0)
+		return false;
+	fclose(fh);
+	return true;
+}
+
+// Render the silhouette of 'tri' from each angle into the atlas texture
+static void render_atlas(impostor* imp, const triangles& tri)
+{
+	const char* vscode =
+		"#version 120\n"
+		"uniform mat4 MVP;\n"
+		"attribute vec4 p;\n"
+		"void main()\n"
+		"{\n"
+		"	gl_Position = MVP*p;\n"
+		"}\n";
+
+	const char* fscode =
+		"#version 120\n"
+		"void main()\n"
+		"{\n"
+		"	gl_FragColor = vec4(1,1,1,1);\n"
+		"}\n";
+
+	GLuint prog = gl_createprogram(vscode,fscode);
+
+	GLuint vbo;
+	glGenBuffers(1,&vbo);
+	glBindBuffer(GL_ARRAY_BUFFER,vbo);
+	glBufferData(GL_ARRAY_BUFFER,tri.size()*sizeof(vertex),&tri[0],GL_STATIC_DRAW);
+
+	GLuint fbo;
+	glGenFramebuffers(1,&fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,imp->tex,0);
+
+	// remember state that we change so that the caller is unaffected
+	int viewport[4];
+	float clear[4];
+	glGetIntegerv(GL_VIEWPORT,viewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE,clear);
+	GLboolean cull = glIsEnabled(GL_CULL_FACE);
+	GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_SCISSOR_TEST);
+
+	glViewport(0,0,imp->views*imp->frame_size,imp->frame_size);
+	glClearColor(0,0,0,0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glUseProgram(prog);
+	GLuint ploc = glGetAttribLocation(prog,"p");
+	glVertexAttribPointer(ploc,4,GL_FLOAT,GL_FALSE,sizeof(vertex),BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(ploc);
+
+	float r = imp->radius;
+	mat4x4 P = orthographic(-r,r,-r,r,0.5f*r,3.5f*r);
+	for (int k = 0; k < imp->views; ++k) {
+		// camera orbits the center looking inward; frame k is seen from direction (sin,0,cos) of angle k
+		float theta = 2*PI*k/imp->views;
+		vec4 eye = imp->center + 2*r*vec4(sin(theta),0,cos(theta),0);
+		mat4x4 V = inverse(translation(eye)*rotation_y(-theta));
+		mat4x4 MVP = P*V;
+		glUniformMatrix4fv(glGetUniformLocation(prog,"MVP"),1,GL_TRUE,MVP.ptr());
+		glViewport(k*imp->frame_size,0,imp->frame_size,imp->frame_size);
+		glDrawArrays(GL_TRIANGLES,0,(GLsizei)tri.size());
+	}
+
+	glDisableVertexAttribArray(ploc);
+	glUseProgram(0);
+	glBindFramebuffer(GL_FRAMEBUFFER,0);
+	glDeleteFramebuffers(1,&fbo);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	glDeleteBuffers(1,&vbo);
+	glDeleteProgram(prog);
+
+	glViewport(viewport[0],viewport[1],viewport[2],viewport[3]);
+	glClearColor(clear[0],clear[1],clear[2],clear[3]);
+	if (cull)    glEnable(GL_CULL_FACE);
+	if (depth)   glEnable(GL_DEPTH_TEST);
+	if (scissor) glEnable(GL_SCISSOR_TEST);
+}
+
+impostor* impostor_create(const triangles& tri, int views, int frame_size, const char* cachefile)
+{
+	impostor* imp = new impostor;
+	imp->views = views;
+	imp->frame_size = frame_size;
+	bounding_sphere(tri,imp->center,imp->radius);
+
+	int atlas_wd = views*frame_size;
+	int atlas_ht = frame_size;
+
+	glGenTextures(1,&imp->tex);
+	glBindTexture(GL_TEXTURE_2D,imp->tex);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+
+	// Atlas rows are kept in OpenGL order (bottom row first) both in memory and in the cache file
+	bitmap* bm = 0;
+	if (cachefile && file_exists(cachefile)) {
+		bm = bitmap_load(cachefile);
+		if (bm && (bm->wd != atlas_wd || bm->ht != atlas_ht)) {
+			bitmap_delete(bm); // stale cache, e.g. number of views changed
+			bm = 0;
+		}
+	}
+
+	if (bm) {
+		glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,atlas_wd,atlas_ht,0,GL_BGRA,GL_UNSIGNED_BYTE,bm->pixels);
+		bitmap_delete(bm);
+	} else if (gl3wIsSupported(3,0)) {
+		glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,atlas_wd,atlas_ht,0,GL_BGRA,GL_UNSIGNED_BYTE,0);
+		render_atlas(imp,tri);
+		if (cachefile) {
+			bm = bitmap_create(atlas_wd,atlas_ht);
+			glBindTexture(GL_TEXTURE_2D,imp->tex);
+			glGetTexImage(GL_TEXTURE_2D,0,GL_BGRA,GL_UNSIGNED_BYTE,bm->pixels);
+			bitmap_save(bm,cachefile);
+			bitmap_delete(bm);
+		}
+	} else {
+		glBindTexture(GL_TEXTURE_2D,0);
+		glDeleteTextures(1,&imp->tex);
+		delete imp;
+		return 0;
+	}
+
+	glBindTexture(GL_TEXTURE_2D,imp->tex);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D,0);
+
+	// one quad, as a triangle strip of corners
+	float quad[8] = { -1,-1,  1,-1,  -1,1,  1,1 };
+	glGenBuffers(1,&imp->quad_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER,imp->quad_vbo);
+	glBufferData(GL_ARRAY_BUFFER,sizeof(quad),quad,GL_STATIC_DRAW);
+
+	glGenBuffers(1,&imp->instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	imp->source = 0;
+	imp->source_offset = 0;
+	return imp;
+}
+
+const char* impostor_vertex_shader()
+{
+	static std::string code;
+	code = std::string(
+		"#version 120					\n") + camera_glsl() +
+		"uniform mat4 P;				\n"     // projection matrix
+		"uniform vec3 eye;				\n"     // camera position
+		"uniform float views;			\n"     // frames in the atlas
+
+		"attribute vec4 c;				\n"
+		"attribute vec2 p;				\n"     // quad corner, in [-1,1]
+		"attribute vec4 inst;			\n"     // billboard center (x,y,z) and radius (w)
+		"attribute float frame;			\n"     // atlas frame
+
+		"varying vec4 p_col;			\n"
+		"varying vec2 atlas_uv;			\n"
+
+		"void main()					\n"
+		"{								\n"
+		// turn about the vertical axis to face the camera
+		"	vec3 d = eye - inst.xyz;	\n"
+		"	vec3 right = normalize(vec3(d.z, 0.0, -d.x) + vec3(1e-6, 0.0, 0.0));	\n"
+		"	vec3 world = inst.xyz + (right*p.x + vec3(0.0, p.y, 0.0))*inst.w;		\n"
+		"	gl_Position = P*V*vec4(world, 1.0);										\n"
+		"	atlas_uv = vec2((frame + 0.5*p.x + 0.5)/views, 0.5*p.y + 0.5);			\n"
+		"	p_col = c;					\n"
+		"}								\n";
+	return code.c_str();
+}
+
+void impostor_add(impostor* imp, const vec4& pos, float yaw, float scale, const vec4& eye)
+{
+	float c = cos(yaw), s = sin(yaw);
+
+	// same rotation as rotation_y(yaw), applied to the scaled bounding sphere center
+	impostor_instance inst;
+	inst.x = pos.x + scale*(c*imp->center.x - s*imp->center.z);
+	inst.y = pos.y + scale*imp->center.y;
+	inst.z = pos.z + scale*(s*imp->center.x + c*imp->center.z);
+	inst.radius = scale*imp->radius;
+
+	// direction to the camera in the object's own frame picks the nearest view
+	float dx = eye.x - inst.x, dz = eye.z - inst.z;
+	float lx =  c*dx + s*dz;
+	float lz = -s*dx + c*dz;
+	float theta = atan2(lx,lz);
+	int frame = (int)floor(theta/(2*PI)*imp->views + 0.5f);
+	frame = ((frame % imp->views) + imp->views) % imp->views;
+	inst.frame = (float)frame;
+
+	imp->instances.push_back(inst);
+}
+
+void impostor_upload(impostor* imp, stream_buffer* sb)
+{
+	if (imp->instances.empty() || !gl3wIsSupported(3,3))
+		return;
+	int offset = stream_write(sb,&imp->instances[0],(int)(imp->instances.size()*sizeof(impostor_instance)));
+	if (offset >= 0) {
+		imp->source = sb->buffer;
+		imp->source_offset = offset;
+	}
+}
+
+void impostor_draw(impostor* imp, unsigned program, const vec4& eye)
+{
+	if (imp->instances.empty())
+		return;
+
+	glUniform3f(glGetUniformLocation(program,"eye"),eye.x,eye.y,eye.z);
+	glUniform1f(glGetUniformLocation(program,"views"),(float)imp->views);
+	glUniform1i(glGetUniformLocation(program,"atlas"),0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D,imp->tex);
+
+	GLuint ploc = glGetAttribLocation(program,"p");
+	GLuint iloc = glGetAttribLocation(program,"inst");
+	GLuint floc = glGetAttribLocation(program,"frame");
+
+	glBindBuffer(GL_ARRAY_BUFFER,imp->quad_vbo);
+	glVertexAttribPointer(ploc,2,GL_FLOAT,GL_FALSE,2*sizeof(float),BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(ploc);
+
+	GLsizei count = (GLsizei)imp->instances.size();
+	if (gl3wIsSupported(3,3)) {
+		// every billboard in one draw; instance attributes advance once per quad
+		if (!imp->source) {
+			imp->source = imp->instance_vbo;
+			imp->source_offset = 0;
+			glBindBuffer(GL_ARRAY_BUFFER,imp->instance_vbo);
+			glBufferData(GL_ARRAY_BUFFER,count*sizeof(impostor_instance),0,GL_STREAM_DRAW); // orphan last frame's data
+			glBufferSubData(GL_ARRAY_BUFFER,0,count*sizeof(impostor_instance),&imp->instances[0]);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER,imp->source);
+		glVertexAttribPointer(iloc,4,GL_FLOAT,GL_FALSE,sizeof(impostor_instance),BUFFER_OFFSET(imp->source_offset));
+		glVertexAttribPointer(floc,1,GL_FLOAT,GL_FALSE,sizeof(impostor_instance),BUFFER_OFFSET(imp->source_offset + 4*sizeof(float)));
+		glEnableVertexAttribArray(iloc);
+		glEnableVertexAttribArray(floc);
+		glVertexAttribDivisor(iloc,1);
+		glVertexAttribDivisor(floc,1);
+
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP,0,4,count);
+
+		glVertexAttribDivisor(iloc,0);
+		glVertexAttribDivisor(floc,0);
+		glDisableVertexAttribArray(iloc);
+		glDisableVertexAttribArray(floc);
+	} else {
+		// no instancing; still cheap since each billboard is only four vertices
+		for (GLsizei i = 0; i < count; ++i) {
+			const impostor_instance& inst = imp->instances[i];
+			glVertexAttrib4f(iloc,inst.x,inst.y,inst.z,inst.radius);
+			glVertexAttrib1f(floc,inst.frame);
+			glDrawArrays(GL_TRIANGLE_STRIP,0,4);
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	glBindTexture(GL_TEXTURE_2D,0);
+	imp->instances.clear();
+	imp->source = 0;
+}
@@ -0,0 +1,76 @@
+#ifndef __IMPOSTOR_H__
+#define __IMPOSTOR_H__
+
+// impostor.h
+//    Billboard impostors for distant copies of a mesh. At load time the
+//    mesh is rendered from a number of angles around its vertical axis
+//    into a texture atlas (or the atlas is read back from a cache file).
+//    Far objects are then drawn as camera-facing quads, all in one
+//    instanced draw call, each showing the atlas frame nearest to the
+//    angle it is being viewed from.
+
+#include "trimesh.h"
+#include "vec4.h"
+#include "stream.h"
+#include <vector>
+
+//
+// impostor_instance -- one billboard, as sent to the vertex shader
+//
+struct impostor_instance {
+	float x,y,z;   // world position of the bounding sphere center
+	float radius;  // world radius (half the quad size)
+	float frame;   // which atlas frame to show
+};
+
+struct impostor {
+	unsigned tex;          // atlas: 'views' square frames side by side
+	int      views;
+	int      frame_size;   // pixels along each side of a frame
+	vec4     center;       // bounding sphere of the mesh (model coordinates)
+	float    radius;
+
+	unsigned quad_vbo;
+	unsigned instance_vbo;
+	std::vector<impostor_instance> instances;  // billboards queued for the next impostor_draw
+	unsigned source;       // buffer and byte offset of the queued billboards once uploaded, else 0
+	int      source_offset;
+};
+
+// impostor_create
+//    Builds the atlas of 'tri' seen from 'views' directions, each frame
+//    frame_size x frame_size pixels. If 'cachefile' (a .bmp) exists with the
+//    right size it is loaded instead; otherwise the atlas is rendered and
+//    saved there. Needs OpenGL 3.0 framebuffers to render; returns 0 if
+//    the atlas can be neither loaded nor rendered.
+//
+impostor* impostor_create(const triangles& tri, int views, int frame_size, const char* cachefile);
+
+// impostor_vertex_shader
+//    GLSL 1.20 vertex shader code for drawing billboards. It reads
+//    uniforms P, V (camera.h), eye (camera position) and views,
+//    attributes c (colour), p (corner), inst and frame, and writes the
+//    varyings p_col and atlas_uv for the fragment shader.
+//
+const char* impostor_vertex_shader();
+
+// impostor_add
+//    Queues a billboard for an object at 'pos' turned by 'yaw' about the
+//    y axis and scaled uniformly by 'scale', seen from 'eye' (world).
+//
+void impostor_add(impostor* imp, const vec4& pos, float yaw, float scale, const vec4& eye);
+
+// impostor_upload
+//    Writes the queued billboards into the frame's stream buffer (between
+//    stream_map and stream_unmap). Optional; otherwise impostor_draw
+//    uploads them itself.
+//
+void impostor_upload(impostor* imp, stream_buffer* sb);
+
+// impostor_draw
+//    Draws all queued billboards with 'program' (which must already be
+//    bound, with P, V and colour set) and empties the queue.
+//
+void impostor_draw(impostor* imp, unsigned program, const vec4& eye);
+
+#endif // __IMPOSTOR_H__
@@ -0,0 +1,514 @@
+#include "inflate.h"
+#include <cstring>
+
+#define MAX_CODE_BITS      15
+#define LITLEN_TABLE_BITS  10     // codes up to this long are found with one lookup
+#define DIST_TABLE_BITS    8
+#define CODELEN_TABLE_BITS 7
+#define LITLEN_TABLE_SIZE  2048   // primary table plus room for the subtables of longer codes
+#define DIST_TABLE_SIZE    1024
+#define MAX_MATCH          258
+#define WINDOW_SIZE        32768        // farthest back a match may reach
+#define STREAM_ROOM        (256*1024)   // output inflate_stream gathers between calls to its output
+
+// A table entry packs what a code decodes to with the number of bits to drop:
+//    bits 0-4   code length (in a subtable, the bits past the primary table)
+//    bits 5-8   extra bits that follow the code; for a link, the subtable's index bits
+//    bits 9-10  kind
+//    bits 16-31 literal byte, base length or distance, or subtable offset
+// An entry of 0 is a code that must not occur.
+#define KIND_LITERAL   0
+#define KIND_MATCH     1      // a length (literal/length table) or distance
+#define KIND_END       2      // end of block
+#define KIND_SUBTABLE  3      // look the next bits up in a subtable
+#define ENTRY(value,kind,extra,len) ((unsigned)(value) << 16 | (unsigned)(kind) << 9 | (unsigned)(extra) << 5 | (unsigned)(len))
+#define ENTRY_LEN(e)    ((e) & 31)
+#define ENTRY_EXTRA(e)  (((e) >> 5) & 15)
+#define ENTRY_KIND(e)   (((e) >> 9) & 3)
+#define ENTRY_VALUE(e)  ((e) >> 16)
+#define NO_SYMBOL       0xffffffffu
+
+static const unsigned short sLengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char sLengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short sDistBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char sDistExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char sCodeLengthOrder[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static unsigned litlen_symbol(int sym)
+{
+	if (sym < 256)  return ENTRY(sym,KIND_LITERAL,0,0);
+	if (sym == 256) return ENTRY(0,KIND_END,0,0);
+	if (sym < 286)  return ENTRY(sLengthBase[sym-257],KIND_MATCH,sLengthExtra[sym-257],0);
+	return NO_SYMBOL;
+}
+
+static unsigned dist_symbol(int sym)
+{
+	return sym < 30 ? ENTRY(sDistBase[sym],KIND_MATCH,sDistExtra[sym],0) : NO_SYMBOL;
+}
+
+static unsigned codelen_symbol(int sym)
+{
+	return ENTRY(sym,KIND_LITERAL,0,0);
+}
+
+// build_table
+//    Fills 'table' (of 'capacity' entries) for the canonical Huffman code
+//    with the given code lengths: a primary table indexed by the next
+//    'bits' bits of input, linking to subtables for longer codes.
+//    Returns false for an over-subscribed or incomplete code; the one
+//    incomplete code allowed is one with a single symbol.
+//
+static bool build_table(unsigned* table, int bits, int capacity, const unsigned char* lengths, int n, unsigned (*symbol)(int))
+{
+	int count[MAX_CODE_BITS+1] = { 0 };
+	for (int i = 0; i < n; ++i)
+		count[lengths[i]]++;
+	count[0] = 0;
+
+	int left = 1, codes = 0;
+	for (int len = 1; len <= MAX_CODE_BITS; ++len) {
+		left = (left << 1) - count[len];
+		if (left < 0)
+			return false;
+		codes += count[len];
+	}
+	if (left > 0 && codes > 1)
+		return false;
+
+	// symbols in canonical order: by length, then by value
+	int offset[MAX_CODE_BITS+2];
+	unsigned short sorted[288];
+	offset[1] = 0;
+	for (int len = 1; len <= MAX_CODE_BITS; ++len)
+		offset[len+1] = offset[len] + count[len];
+	for (int i = 0; i < n; ++i)
+		if (lengths[i])
+			sorted[offset[lengths[i]]++] = (unsigned short)i;
+
+	unsigned next_code[MAX_CODE_BITS+1];
+	unsigned code = 0;
+	next_code[0] = 0;
+	for (int len = 1; len <= MAX_CODE_BITS; ++len) {
+		code = (code + count[len-1]) << 1;
+		next_code[len] = code;
+	}
+
+	int primary = 1 << bits;
+	memset(table,0,primary*sizeof(unsigned));
+	int next_free = primary, sub_start = 0, sub_bits = 0;
+	unsigned sub_prefix = ~0u;
+	for (int i = 0; i < codes; ++i) {
+		int sym = sorted[i], len = lengths[sym];
+		unsigned e = symbol(sym);
+
+		// deflate sends codes most significant bit first, so they are looked up reversed
+		unsigned c = next_code[len]++, rev = 0;
+		for (int b = 0; b < len; ++b)
+			rev |= ((c >> b) & 1) << (len-1-b);
+
+		if (len <= bits) {
+			unsigned entry = e == NO_SYMBOL ? 0 : e | len;
+			for (int j = rev; j < primary; j += 1 << len)
+				table[j] = entry;
+		} else {
+			unsigned prefix = rev & (primary-1);
+			if (prefix != sub_prefix) {
+				// a new subtable, as large as the codes starting with this prefix need
+				sub_bits = len - bits;
+				int room = 1 << sub_bits;
+				while (sub_bits + bits < MAX_CODE_BITS) {
+					room -= count[sub_bits + bits];
+					if (room <= 0)
+						break;
+					sub_bits++;
+					room <<= 1;
+				}
+				if (next_free + (1 << sub_bits) > capacity)
+					return false;
+				sub_prefix = prefix;
+				sub_start = next_free;
+				next_free += 1 << sub_bits;
+				memset(table+sub_start,0,(1 << sub_bits)*sizeof(unsigned));
+				table[prefix] = ENTRY(sub_start,KIND_SUBTABLE,sub_bits,bits);
+			}
+			unsigned entry = e == NO_SYMBOL ? 0 : e | (len - bits);
+			for (int j = rev >> bits; j < (1 << sub_bits); j += 1 << (len - bits))
+				table[sub_start + j] = entry;
+		}
+		count[len]--;
+	}
+	return true;
+}
+
+struct inflater {
+	unsigned long long bitbuf;   // next bits of input, first in the lowest bit
+	unsigned bitcount;           // how many of them are valid
+	const unsigned char* in;     // rest of the current piece of input
+	const unsigned char* in_end;
+	inflate_input input;
+	void*    arg;
+	unsigned overrun;            // zero bytes made up past the end of the input
+	inflate_output output;       // inflate_stream only; 0 when inflating into one buffer
+	void*    out_arg;
+	unsigned char* flushed;      // output not yet handed on starts here
+	unsigned char* limit;        // room for a whole match is left up to here
+	unsigned litlen[LITLEN_TABLE_SIZE];
+	unsigned dist[DIST_TABLE_SIZE];
+};
+
+static void refill_slow(inflater& s)
+{
+	while (s.bitcount <= 56) {
+		while (s.in == s.in_end) {
+			const unsigned char* data;
+			size_t size;
+			if (!s.input(s.arg,&data,&size)) {
+				// pad with zeros; using them is caught by input_overrun
+				s.overrun++;
+				s.bitcount += 8;
+				if (s.bitcount > 56)
+					return;
+				continue;
+			}
+			s.in = data;
+			s.in_end = data + size;
+		}
+		s.bitbuf |= (unsigned long long)*s.in++ << s.bitcount;
+		s.bitcount += 8;
+	}
+}
+
+// refill
+//    Tops the bit buffer up to at least 56 bits, enough for a length and
+//    a distance code with their extra bits. Away from the end of a piece
+//    this is a single unaligned load; the bits above bitcount it leaves
+//    behind are the right ones, so loading them again does no harm.
+//
+static inline void refill(inflater& s)
+{
+	if (s.in_end - s.in >= 8) {
+		unsigned long long word;
+		memcpy(&word,s.in,8);
+		s.bitbuf |= word << s.bitcount;
+		s.in += (63 - s.bitcount) >> 3;
+		s.bitcount |= 56;
+	} else {
+		refill_slow(s);
+	}
+}
+
+static inline unsigned take(inflater& s, unsigned n)
+{
+	unsigned v = (unsigned)(s.bitbuf & ((1ull << n) - 1));
+	s.bitbuf >>= n;
+	s.bitcount -= n;
+	return v;
+}
+
+static inline bool input_overrun(const inflater& s)
+{
+	return s.overrun*8 > s.bitcount;
+}
+
+// decode
+//    The next symbol's entry from 'table'; its code bits are dropped but
+//    not its extra bits. Returns 0 for a code that must not occur.
+//
+static inline unsigned decode(inflater& s, const unsigned* table, int bits)
+{
+	unsigned e = table[s.bitbuf & ((1u << bits) - 1)];
+	if (ENTRY_KIND(e) == KIND_SUBTABLE) {
+		s.bitbuf >>= bits;
+		s.bitcount -= bits;
+		e = table[ENTRY_VALUE(e) + (s.bitbuf & ((1u << ENTRY_EXTRA(e)) - 1))];
+	}
+	s.bitbuf >>= ENTRY_LEN(e);
+	s.bitcount -= ENTRY_LEN(e);
+	return e;
+}
+
+// slide
+//    For inflate_stream: hands the output written since the last call on,
+//    then moves the last WINDOW_SIZE bytes, all a match can reach, to the
+//    start of the buffer to make room. Returns false if the output refused
+//    the data.
+//
+static bool slide(inflater& s, unsigned char* dest, unsigned char*& out)
+{
+	if (out > s.flushed && !s.output(s.out_arg,s.flushed,(size_t)(out - s.flushed)))
+		return false;
+	size_t keep = (size_t)(out - dest) < WINDOW_SIZE ? (size_t)(out - dest) : WINDOW_SIZE;
+	memmove(dest,out - keep,keep);
+	out = dest + keep;
+	s.flushed = out;
+	return true;
+}
+
+static int stored_block(inflater& s, unsigned char* dest, unsigned char*& out, unsigned char* end)
+{
+	take(s,s.bitcount & 7);
+	refill(s);
+	unsigned len = take(s,16), nlen = take(s,16);
+	if (input_overrun(s))
+		return INFLATE_TRUNCATED;
+	if (len != (~nlen & 0xffff))
+		return INFLATE_BAD_DATA;
+	if (s.output && len > (size_t)(end - out) && !slide(s,dest,out))
+		return INFLATE_FULL;
+	if (len > (size_t)(end - out))
+		return INFLATE_FULL;
+
+	// whole bytes already in the bit buffer come first, then the input itself;
+	// any padding refill made up is the last 8*overrun bits there
+	while (len && s.bitcount >= 8*(s.overrun + 1)) {
+		*out++ = (unsigned char)take(s,8);
+		len--;
+	}
+	if (len && s.overrun)
+		return INFLATE_TRUNCATED;
+	if (s.bitcount >= 8) {
+		// a short block; keep the remaining buffered bytes for the next one
+		return INFLATE_OK;
+	}
+	s.bitbuf = 0;
+	s.bitcount = 0;
+	while (len) {
+		if (s.in == s.in_end) {
+			const unsigned char* data;
+			size_t size;
+			if (!s.input(s.arg,&data,&size))
+				return INFLATE_TRUNCATED;
+			s.in = data;
+			s.in_end = data + size;
+			continue;
+		}
+		size_t n = (size_t)(s.in_end - s.in) < len ? (size_t)(s.in_end - s.in) : len;
+		memcpy(out,s.in,n);
+		out += n;
+		s.in += n;
+		len -= (unsigned)n;
+	}
+	return INFLATE_OK;
+}
+
+static bool fixed_tables(inflater& s)
+{
+	unsigned char lengths[288 + 32];
+	memset(lengths,8,144);
+	memset(lengths+144,9,112);
+	memset(lengths+256,7,24);
+	memset(lengths+280,8,8);
+	memset(lengths+288,5,32);
+	return build_table(s.litlen,LITLEN_TABLE_BITS,LITLEN_TABLE_SIZE,lengths,288,litlen_symbol)
+	    && build_table(s.dist,DIST_TABLE_BITS,DIST_TABLE_SIZE,lengths+288,32,dist_symbol);
+}
+
+static int dynamic_tables(inflater& s)
+{
+	refill(s);
+	int nlitlen = take(s,5) + 257;
+	int ndist = take(s,5) + 1;
+	int ncodelen = take(s,4) + 4;
+	if (nlitlen > 286 || ndist > 30)
+		return INFLATE_BAD_DATA;
+
+	unsigned char lengths[286 + 30];
+	memset(lengths,0,19);
+	for (int i = 0; i < ncodelen; ++i) {
+		refill(s);
+		lengths[sCodeLengthOrder[i]] = (unsigned char)take(s,3);
+	}
+	unsigned codelen[1 << CODELEN_TABLE_BITS];
+	if (!build_table(codelen,CODELEN_TABLE_BITS,1 << CODELEN_TABLE_BITS,lengths,19,codelen_symbol))
+		return INFLATE_BAD_DATA;
+
+	for (int i = 0; i < nlitlen + ndist; ) {
+		refill(s);
+		unsigned e = decode(s,codelen,CODELEN_TABLE_BITS);
+		if (!e)
+			return INFLATE_BAD_DATA;
+		unsigned sym = ENTRY_VALUE(e);
+		if (sym < 16) {
+			lengths[i++] = (unsigned char)sym;
+			continue;
+		}
+		unsigned char repeat = 0;
+		int times;
+		if (sym == 16) {
+			if (i == 0)
+				return INFLATE_BAD_DATA;
+			repeat = lengths[i-1];
+			times = 3 + take(s,2);
+		} else if (sym == 17) {
+			times = 3 + take(s,3);
+		} else {
+			times = 11 + take(s,7);
+		}
+		if (i + times > nlitlen + ndist)
+			return INFLATE_BAD_DATA;
+		memset(lengths+i,repeat,times);
+		i += times;
+	}
+	if (input_overrun(s))
+		return INFLATE_TRUNCATED;
+	if (lengths[256] == 0)
+		return INFLATE_BAD_DATA;   // a block with no way to end
+	if (!build_table(s.litlen,LITLEN_TABLE_BITS,LITLEN_TABLE_SIZE,lengths,nlitlen,litlen_symbol)
+	 || !build_table(s.dist,DIST_TABLE_BITS,DIST_TABLE_SIZE,lengths+nlitlen,ndist,dist_symbol))
+		return INFLATE_BAD_DATA;
+	return INFLATE_OK;
+}
+
+// huffman_block
+//    Once the input has run out, the zero bits refill pads with decode
+//    like any other, so every symbol is checked against them before it
+//    is used; s.overrun stays 0 until then, keeping the check off the
+//    common path. When streaming, the output slides along before any
+//    symbol that might not fit.
+//
+static int huffman_block(inflater& s, unsigned char* dest, unsigned char*& out, unsigned char* end)
+{
+	for (;;) {
+		if (out > s.limit && !slide(s,dest,out))
+			return INFLATE_FULL;
+		refill(s);
+		unsigned e = decode(s,s.litlen,LITLEN_TABLE_BITS);
+		unsigned kind = ENTRY_KIND(e);
+		if (kind == KIND_LITERAL) {
+			if (s.overrun && input_overrun(s))
+				return INFLATE_TRUNCATED;
+			if (!e)
+				return INFLATE_BAD_DATA;
+			if (out == end)
+				return INFLATE_FULL;
+			*out++ = (unsigned char)ENTRY_VALUE(e);
+			continue;
+		}
+		if (kind == KIND_END)
+			return input_overrun(s) ? INFLATE_TRUNCATED : INFLATE_OK;
+
+		size_t length = ENTRY_VALUE(e) + take(s,ENTRY_EXTRA(e));
+		e = decode(s,s.dist,DIST_TABLE_BITS);
+		if (!e)
+			return input_overrun(s) ? INFLATE_TRUNCATED : INFLATE_BAD_DATA;
+		size_t dist = ENTRY_VALUE(e) + take(s,ENTRY_EXTRA(e));
+		if (s.overrun && input_overrun(s))
+			return INFLATE_TRUNCATED;
+		if (dist > (size_t)(out - dest))
+			return INFLATE_BAD_DATA;
+		size_t room = (size_t)(end - out);
+		if (length > room)
+			return INFLATE_FULL;
+
+		const unsigned char* from = out - dist;
+		if (dist >= 8 && room >= length + 8) {
+			// eight bytes at a time; the source always stays a word behind
+			unsigned char* stop = out + length;
+			do {
+				memcpy(out,from,8);
+				out += 8;
+				from += 8;
+			} while (out < stop);
+			out = stop;
+		} else if (dist == 1) {
+			memset(out,out[-1],length);
+			out += length;
+		} else {
+			for (size_t i = 0; i < length; ++i)
+				out[i] = from[i];
+			out += length;
+		}
+	}
+}
+
+// run
+//    Inflates a whole zlib stream from s's input into 'dest', leaving
+//    'out' after the last byte written.
+//
+static int run(inflater& s, unsigned char* dest, unsigned char*& out, unsigned char* end)
+{
+	// zlib header: deflate with a window of at most 32K, no preset dictionary
+	refill(s);
+	unsigned cmf = take(s,8), flg = take(s,8);
+	if (input_overrun(s))
+		return INFLATE_TRUNCATED;
+	if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7 || (flg & 0x20) || (cmf*256 + flg) % 31 != 0)
+		return INFLATE_BAD_DATA;
+
+	int err = INFLATE_OK;
+	unsigned last;
+	do {
+		refill(s);
+		last = take(s,1);
+		unsigned type = take(s,2);
+		if (input_overrun(s))
+			err = INFLATE_TRUNCATED;
+		else if (type == 0)
+			err = stored_block(s,dest,out,end);
+		else if (type == 1)
+			err = fixed_tables(s) ? huffman_block(s,dest,out,end) : INFLATE_BAD_DATA;
+		else if (type == 2)
+			err = (err = dynamic_tables(s)) != INFLATE_OK ? err : huffman_block(s,dest,out,end);
+		else
+			err = INFLATE_BAD_DATA;
+	} while (!last && err == INFLATE_OK);
+	if (err == INFLATE_BAD_DATA && input_overrun(s))
+		err = INFLATE_TRUNCATED;   // what looked wrong was the padding past the end of the input
+	return err;
+}
+
+static void start(inflater& s, inflate_input input, void* arg)
+{
+	s.bitbuf = 0;
+	s.bitcount = 0;
+	s.in = s.in_end = 0;
+	s.input = input;
+	s.arg = arg;
+	s.overrun = 0;
+	s.output = 0;
+	s.out_arg = 0;
+}
+
+int inflate(unsigned char* dest, size_t* destlen, inflate_input input, void* arg)
+{
+	inflater s;
+	start(s,input,arg);
+	unsigned char* out = dest;
+	unsigned char* end = dest + *destlen;
+	s.flushed = dest;
+	s.limit = end;   // out never passes it, so nothing slides
+
+	int err = run(s,dest,out,end);
+	*destlen = (size_t)(out - dest);
+	return err;
+}
+
+int inflate_stream(inflate_output output, void* out_arg, inflate_input input, void* in_arg)
+{
+	inflater s;
+	start(s,input,in_arg);
+	s.output = output;
+	s.out_arg = out_arg;
+
+	unsigned char* buffer = new unsigned char[WINDOW_SIZE + STREAM_ROOM];
+	unsigned char* out = buffer;
+	unsigned char* end = buffer + WINDOW_SIZE + STREAM_ROOM;
+	s.flushed = buffer;
+	s.limit = end - MAX_MATCH;
+
+	int err = run(s,buffer,out,end);
+	if (err == INFLATE_OK && out > s.flushed && !output(out_arg,s.flushed,(size_t)(out - s.flushed)))
+		err = INFLATE_FULL;
+	delete [] buffer;
+	return err;
+}
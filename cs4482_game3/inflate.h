@@ -0,0 +1,49 @@
+#ifndef __INFLATE_H__
+#define __INFLATE_H__
+
+// inflate.h
+//    Decompresses zlib streams (RFC 1950/1951), as found in PNG files.
+//    Codes are decoded through lookup tables, a whole symbol (and its
+//    extra bits) at a time from a 64-bit bit buffer, and matches are
+//    copied a word at a time. The compressed data may arrive in pieces,
+//    such as a PNG's IDAT chunks, without first being gathered together,
+//    and the output may be taken in pieces too (inflate_stream).
+//    Assumes a little-endian CPU.
+
+#include <cstddef>
+
+#define INFLATE_OK         0
+#define INFLATE_FULL       1   // 'dest' was too small, or the output refused more
+#define INFLATE_TRUNCATED  2   // the input ended before the stream did
+#define INFLATE_BAD_DATA   3   // not a valid stream
+
+// inflate_input
+//    Supplies the next piece of compressed data; returns false when
+//    there is no more. Empty pieces are allowed.
+//
+typedef bool (*inflate_input)(void* arg, const unsigned char** data, size_t* size);
+
+// inflate
+//    Decompresses the zlib stream read through input(arg,...) into
+//    'dest'. On entry *destlen is the space available and on return the
+//    number of bytes written. The Adler-32 trailer is not checked.
+//    Returns one of the INFLATE_ codes.
+//
+int inflate(unsigned char* dest, size_t* destlen, inflate_input input, void* arg);
+
+// inflate_output
+//    Takes the next piece of decompressed data, which is only valid
+//    during the call; returns false to stop.
+//
+typedef bool (*inflate_output)(void* arg, const unsigned char* data, size_t size);
+
+// inflate_stream
+//    Decompresses the zlib stream read through input(in_arg,...),
+//    handing the result to output(out_arg,...) in pieces of up to 256K
+//    as it goes, so that nothing the size of the whole result is needed.
+//    Returns one of the INFLATE_ codes; a piece that output refuses
+//    makes it INFLATE_FULL.
+//
+int inflate_stream(inflate_output output, void* out_arg, inflate_input input, void* in_arg);
+
+#endif // __INFLATE_H__
@@ -0,0 +1,119 @@
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "jobs.h"
+#include <vector>
+
+// one call to jobs_parallel_for; lives on the caller's stack until every thread has let go of it
+struct job_batch {
+	void (*job)(int index, void* arg);
+	void* arg;
+	int   count;
+	volatile LONG next;      // next index to hand out
+	volatile LONG holders;   // threads woken for this batch, plus the caller, not yet done with it
+};
+
+static std::vector<HANDLE> sWorkers;
+static CRITICAL_SECTION    sSubmitLock;      // one batch at a time
+static HANDLE              sWake = 0;        // semaphore; one count per worker woken for the batch
+static HANDLE              sDone = 0;        // auto-reset event; the last holder of a batch let go of it
+static job_batch* volatile sBatch = 0;
+static volatile bool       sQuit = false;
+
+static void run_batch(job_batch* b)
+{
+	for (;;) {
+		int i = (int)InterlockedIncrement(&b->next) - 1;
+		if (i >= b->count)
+			break;
+		b->job(i,b->arg);
+	}
+}
+
+static DWORD WINAPI worker(LPVOID)
+{
+	for (;;) {
+		WaitForSingleObject(sWake,INFINITE);
+		if (sQuit)
+			return 0;
+
+		// the caller waits for every count it released, so the batch is still there
+		job_batch* b = sBatch;
+		run_batch(b);
+		if (InterlockedDecrement(&b->holders) == 0)
+			SetEvent(sDone);
+	}
+}
+
+void jobs_init(int threads)
+{
+	if (!sWorkers.empty())
+		return;
+	if (threads <= 0) {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		threads = (int)info.dwNumberOfProcessors - 1;
+	}
+	if (threads <= 0)
+		return;
+
+	InitializeCriticalSection(&sSubmitLock);
+	sWake = CreateSemaphore(0,0,threads,0);
+	sDone = CreateEvent(0,FALSE,FALSE,0);
+	sQuit = false;
+	for (int i = 0; i < threads; ++i)
+		sWorkers.push_back(CreateThread(0,0,worker,0,0,0));
+}
+
+void jobs_shutdown()
+{
+	if (sWorkers.empty())
+		return;
+	sQuit = true;
+	ReleaseSemaphore(sWake,(LONG)sWorkers.size(),0);
+	for (size_t i = 0; i < sWorkers.size(); ++i) {
+		WaitForSingleObject(sWorkers[i],INFINITE);
+		CloseHandle(sWorkers[i]);
+	}
+	sWorkers.clear();
+	CloseHandle(sWake);
+	CloseHandle(sDone);
+	DeleteCriticalSection(&sSubmitLock);
+}
+
+int jobs_thread_count()
+{
+	return (int)sWorkers.size() + 1;
+}
+
+void jobs_parallel_for(int count, void (*job)(int index, void* arg), void* arg)
+{
+	if (count <= 0)
+		return;
+
+	if (sWorkers.empty() || count == 1) {
+		for (int i = 0; i < count; ++i)
+			job(i,arg);
+		return;
+	}
+
+	EnterCriticalSection(&sSubmitLock);
+
+	// no more workers than there are indices for the caller to share
+	int woken = (int)sWorkers.size() < count-1 ? (int)sWorkers.size() : count-1;
+
+	job_batch b;
+	b.job = job;
+	b.arg = arg;
+	b.count = count;
+	b.next = 0;
+	b.holders = woken + 1;
+	sBatch = &b;
+	ReleaseSemaphore(sWake,woken,0);
+
+	run_batch(&b);
+	if (InterlockedDecrement(&b.holders) != 0)
+		WaitForSingleObject(sDone,INFINITE);
+	sBatch = 0;
+
+	LeaveCriticalSection(&sSubmitLock);
+}
@@ -0,0 +1,38 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+// jobs.h
+//    A small pool of worker threads for splitting per-frame work
+//    (rasterizing, compositing, ...) across the CPU's cores.
+//    Work is submitted from one thread at a time, usually the main thread,
+//    which also helps run the jobs instead of sitting idle.
+
+// jobs_init
+//    Starts the worker threads. With threads = 0, one worker is started per
+//    hardware thread minus one (for the caller). Without jobs_init, every
+//    jobs_parallel_for simply runs on the calling thread.
+//
+void jobs_init(int threads = 0);
+
+// jobs_shutdown
+//    Stops and joins the worker threads.
+//
+void jobs_shutdown();
+
+// jobs_thread_count
+//    Number of threads that run jobs, including the caller.
+//
+int jobs_thread_count();
+
+// jobs_parallel_for
+//    Calls job(i,arg) once for every i in [0,count), spread over the worker
+//    threads and the calling thread, and returns once all calls are done.
+//    Jobs must not call jobs_parallel_for themselves.
+//
+// Example:
+//    void clear_row(int y, void* arg) { bitmap* bm = (bitmap*)arg; ... }
+//    jobs_parallel_for(bm->ht, clear_row, bm);
+//
+void jobs_parallel_for(int count, void (*job)(int index, void* arg), void* arg);
+
+#endif // __JOBS_H__
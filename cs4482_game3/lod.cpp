@@ -0,0 +1,97 @@
+#include "lod.h"
+#include <cmath>
+
+lod_group* lod_create(triangles* tri, float hysteresis)
+{
+	lod_group* g = new lod_group;
+	bounding_sphere(*tri,g->center,g->radius);
+	g->hysteresis = hysteresis;
+
+	lod_level level;
+	level.tri = tri;
+	level.imp = 0;
+	level.min_size = 0;
+	g->levels.push_back(level);
+	return g;
+}
+
+void lod_add_level(lod_group* g, triangles* tri, float distance)
+{
+	g->levels.back().min_size = g->radius / distance;
+
+	lod_level level;
+	level.tri = tri;
+	level.imp = 0;
+	level.min_size = 0;
+	g->levels.push_back(level);
+}
+
+void lod_add_impostor(lod_group* g, impostor* imp, float distance)
+{
+	g->levels.back().min_size = g->radius / distance;
+
+	lod_level level;
+	level.tri = 0;
+	level.imp = imp;
+	level.min_size = 0;
+	g->levels.push_back(level);
+}
+
+void lod_set_cull_distance(lod_group* g, float distance)
+{
+	g->levels.back().min_size = g->radius / distance;
+}
+
+void lod_clear_levels(lod_group* g)
+{
+	g->levels.resize(1);
+	g->levels[0].min_size = 0;
+}
+
+float lod_screen_size(const lod_group* g, const mat4x4& P, const mat4x4& MV)
+{
+	// largest scale along any axis, so the sphere stays conservative
+	float scale = 0;
+	for (int col = 0; col < 3; ++col) {
+		float s = sqrt(MV[0][col]*MV[0][col] + MV[1][col]*MV[1][col] + MV[2][col]*MV[2][col]);
+		if (s > scale)
+			scale = s;
+	}
+
+	vec4 eye = MV*g->center;
+	float dist = sqrt(eye.x*eye.x + eye.y*eye.y + eye.z*eye.z);
+	float radius = g->radius*scale;
+	if (dist <= radius)
+		return 1e30f;  // camera is inside the bounding sphere
+	return radius * fabs(P[0][0]) / dist;
+}
+
+int lod_select(const lod_group* g, float size, int current)
+{
+	int n = (int)g->levels.size();
+
+	// the level we would pick with no history
+	int level = n;
+	for (int i = 0; i < n; ++i) {
+		if (size >= g->levels[i].min_size) {
+			level = i;
+			break;
+		}
+	}
+
+	if (current < 0 || current > n || level == current)
+		return level;
+
+	if (level > current) {
+		// getting coarser: hold the current level until we are clearly below its threshold
+		if (size >= g->levels[current].min_size*(1-g->hysteresis))
+			return current;
+		return level;
+	}
+
+	// getting finer: only move up to levels we are clearly above the threshold of
+	for (int i = level; i < current; ++i)
+		if (size >= g->levels[i].min_size*(1+g->hysteresis))
+			return i;
+	return current;
+}
@@ -0,0 +1,83 @@
+#ifndef __LOD_H__
+#define __LOD_H__
+
+// lod.h
+//    A level-of-detail group holds any number of versions of a mesh,
+//    from most to least detailed. Each object using the group picks a
+//    level from how large it appears on screen rather than from its
+//    distance, and thresholds are stretched by a hysteresis band so that
+//    an object sitting near a threshold does not pop back and forth.
+
+#include "trimesh.h"
+#include "mat4x4.h"
+#include <vector>
+
+struct impostor;
+
+//
+// lod_level -- one mesh (or billboard impostor) and the smallest screen size at which it is used
+//
+struct lod_level {
+	triangles* tri;
+	impostor*  imp;        // if set, the level is drawn as a billboard instead of 'tri'
+	float      min_size;   // smallest lod_screen_size at which this level is drawn
+};
+
+//
+// lod_group -- the levels of one mesh, most detailed first
+//
+struct lod_group {
+	std::vector<lod_level> levels;
+	vec4  center;          // bounding sphere of the most detailed level (model coordinates)
+	float radius;
+	float hysteresis;      // e.g. 0.1 means a level is kept until size drops 10% below its threshold
+};
+
+// lod_create
+//    Starts a group whose bounding sphere is taken from 'tri', which is
+//    also added as the most detailed level (used at any size).
+//
+lod_group* lod_create(triangles* tri, float hysteresis = 0.1f);
+
+// lod_add_level
+//    Appends a coarser level used once an unscaled object is at least
+//    'distance' units away with a 90 degree horizontal field of view
+//    (narrower views or larger objects shift the switch further out).
+//    The previous level's threshold is set to where this one starts.
+//    Use lod_set_cull_distance to stop drawing beyond the last level.
+//
+void lod_add_level(lod_group* g, triangles* tri, float distance);
+
+// lod_add_impostor
+//    Same as lod_add_level, but the new level is drawn as a billboard
+//    from the impostor atlas 'imp'.
+//
+void lod_add_impostor(lod_group* g, impostor* imp, float distance);
+
+// lod_set_cull_distance
+//    Objects smaller than they would appear at 'distance' are not drawn.
+//
+void lod_set_cull_distance(lod_group* g, float distance);
+
+// lod_clear_levels
+//    Drops every level but the most detailed, so that the thresholds
+//    can be set up again with lod_add_level and friends, e.g. when the
+//    quality settings change. Objects keep their current level numbers.
+//
+void lod_clear_levels(lod_group* g);
+
+// lod_screen_size
+//    How large an object (with this group's bounding sphere) appears:
+//    its projected radius as a fraction of half the viewport width.
+//    'MV' is the object's modelview matrix, including its scale.
+//
+float lod_screen_size(const lod_group* g, const mat4x4& P, const mat4x4& MV);
+
+// lod_select
+//    Returns the level to use for an object of the given screen size
+//    that was drawn at level 'current' last frame (-1 if unknown).
+//    Returns levels.size() if the object is too small to be drawn.
+//
+int lod_select(const lod_group* g, float size, int current);
+
+#endif // __LOD_H__
@@ -4,9 +4,32 @@
 #include "vec4.h"
 #include "mat4x4.h"
 #include "cs3388lib.h"
+#include "terrain.h"
+#include "lod.h"
+#include "impostor.h"
+#include "frustum.h"
+#include "occlusion.h"
+#include "jobs.h"
+#include "postfx.h"
+#include "dynres.h"
+#include "quality.h"
+#include "profiler.h"
+#include "geometry.h"
+#include "stream.h"
+#include "pacing.h"
+#include "camera.h"
+#include "shaders.h"
+#include "text.h"
+#include "capture.h"
+#include "minimap.h"
+#include "rng.h"
+#include "heightfield.h"
 #include <vector>
+#include <algorithm>
+#include <string>
 
 #include <stdlib.h>
+#include <stdio.h>
 #include "fmod.h"
 #include "fmod_errors.h"
 #include <iostream>
@@ -25,16 +48,47 @@ using namespace std;
 
 #define PI					3.14159265359f
 #define MAX_HEIGHT			10
-#define INVERSE256			0.00390625
 #define PLAYER_HEIGHT		1
-#define LOD_DISTANCE		24
-#define VIEW_DISTANCE		48
+#define DETAIL_DISTANCE		10		// level of detail switches at the best quality tier;
+#define LOD_DISTANCE		24		// cheaper tiers scale them down at run time
+#define IMPOSTOR_DISTANCE	32
+#define VIEW_DISTANCE		96
 #define POSTAGE_RANGE		2.0
 #define TREE_RADIUS			1.7
 #define TREE_TIGHTRADIUS	0.75
 #define NUM_PAGES			8
 #define NUM_TRIMESHES		5
 #define TREE_OFFSET			-1
+#define TREE_SCALE			0.5
+#define IMPOSTOR_VIEWS		16
+#define IMPOSTOR_SIZE		128
+#define OCCLUDER_DISTANCE	12		// trees closer than this hide what is behind their trunks
+#define MAX_OCCLUDER_TREES	64
+#define FRAMES_IN_FLIGHT	2		// frames the GPU may lag behind the CPU (1-3)
+#define LOW_LATENCY			false	// start each frame just in time for the GPU instead
+#define POST_SCALE			1.0		// resolution of the screen effects relative to the window, e.g. 0.5 for half
+#define FRAME_BUDGET_MS		14.0	// GPU time per frame the scene resolution is adjusted to meet
+#define MIN_RENDER_SCALE	0.5		// scene resolution relative to the window, at worst...
+#define MAX_RENDER_SCALE	1.0		// ...and at best
+#define RENDER_SCALE_STEP	0.05	// largest change of scene resolution per adjustment
+#define RENDER_SCALE_FRAMES	8		// frames between adjustments
+#define SHARPEN				0.5		// sharpening of a scene drawn below window resolution
+#define CPU_BUDGET_MS		10.0	// CPU time per frame the quality tier is chosen to meet (with FRAME_BUDGET_MS)
+#define QUALITY_WINDOW		30		// frames averaged per quality decision
+#define EFFECT_VIGNETTE		1		// screen effects that can be compiled out of the shaders
+#define EFFECT_SCANLINES	2
+#define EFFECT_NOISE		4
+#define NUM_EFFECTS			3
+#define EFFECTS_MIN_TIER	1		// cheapest quality tier that gets the vignette and scan lines
+#define GPU_TIMELINE		0		// e.g. "gpu_timeline.csv" to record the GPU time of every pass of every frame
+#define SHOW_HUD			true	// frame times and pages found, drawn over the screen
+#define CAPTURE_KEY			'r'		// starts and stops recording the frames to disk
+#define CAPTURE_PREFIX		"capture_"	// frames are written as capture_000000.qoi, ...
+#define CAPTURE_WRITERS		3		// threads encoding recorded frames
+#define QUIT_KEY			27		// escape
+#define SHOW_MINIMAP		true	// the valley from above, in the top-right corner
+#define MINIMAP_SCALE		3		// minimap pixels per world unit
+#define WORLD_SEED			0x5e17de2ULL	// picks the trees' turns and thinning; the same forest every run
 
 struct object {
 	vec4		pos;  // position
@@ -42,6 +96,9 @@ struct object {
 	vec4		sca;  // scaling
 	vec4		clr;  // diffuse colour
 	triangles*	tri;  // triangles
+	lod_group*	lod;  // if set, 'tri' is picked from these levels each frame
+	int			lod_level;
+	float		thinning;  // far trees are left out when this is above the tree density
 	float		collisionRadius;
 	bool		postable;
 
@@ -52,25 +109,65 @@ struct object {
 		, sca(1,1,1,0)  // default scale (1,1,1)
 		, clr(0,0,0,1)  // default colour (white)
 		, tri(0)        // default geometry (none)
+		, lod(0)        // default level of detail (none, always draw 'tri')
+		, lod_level(-1)
+		, thinning(0)
 		, collisionRadius(-1)
 		, postable(false) 
 	{
 	}
 };
 
-GLuint mesh_vbo[NUM_TRIMESHES];  // id for our list of 3D vertices
+geometry_arena* arena = 0;		// one vertex and index buffer shared by all of our meshes
+geometry_mesh* mesh_geometry[NUM_TRIMESHES];	// where each of meshes[] lives in the arena
+stream_buffer* stream = 0;		// per-frame instance data, written in one go
+frame_pacer* pacer = 0;
+camera_block* eye_block = 0;	// view matrix, written just before the draw calls
+double mouse_time = 0;			// when the last mouse movement was applied to the player
 GLuint program = 0;   // id for our GLSL program
+GLuint mesh_program = 0;		// same, reading each object's transform and colour from the arena's instance data
+GLuint impostor_program = 0;	// same effects, but for billboards cut out of an impostor atlas
+GLuint post_program = 0;		// screen effects, applied once per pixel after the scene is drawn
+postfx* fx = 0;					// offscreen scene target; 0 if unsupported, then effects run per fragment
+shader_variants* program_variants[4];	// the programs above, one for each combination of effects
+dynres* resolution = 0;			// picks the scene's resolution from the GPU's frame time
+quality_governor* governor = 0;	// picks the quality tier from CPU and GPU frame times
+gpu_profiler* gpu_profile = 0;	// GPU time of each pass of the frame
+frame_capture* recorder = 0;	// writes the frames to disk while recording; 0 if unsupported
+minimap* overview = 0;			// the terrain and trees from above, with the pages and the player marked
+
+// Quality tiers, cheapest first; the governor moves between them to stay within budget
+const quality_tier quality_tiers[] = {
+	// name		view distance	lod scale	far tree density
+	{ "low",	48,				0.5f,		0.4f },
+	{ "medium",	72,				0.75f,		0.7f },
+	{ "high",	VIEW_DISTANCE,	1.0f,		1.0f },
+};
+const int NUM_QUALITY_TIERS = sizeof(quality_tiers)/sizeof(quality_tiers[0]);
 
 // build some triangle lists ONE TIME ONLY; objects can point 
 // to these to share the geometry inside, using different materials
-bitmap* hm				= bitmap_load("valley_heightmap.png");
-bitmap* tm				= bitmap_load("valley_treemap.png");
+heightfield* land		= heightfield_load("valley_heightmap.png", MAX_HEIGHT);	// decoded once; the images are freed
+bitmask* tree_map		= bitmask_load("valley_treemap.png");					// a bit per world unit where a tree stands
 
-triangles tri_hm		= create_heightmap(hm);
+triangles tri_treeHD	= load_obj("tree6_0.obj");
 triangles tri_tree		= load_obj("tree6_1.obj");
 triangles tri_treeLOD	= load_obj("tree6_2.obj");
 triangles tri_box		= create_box();
 triangles tri_sphere	= create_sphere(6);
+terrain*  ter			= terrain_create(land);	// heightmap is drawn in culled, level-of-detail chunks
+
+int map_half_wd			= land->wd/2;				// map is centered on the origin, one unit per sample
+int map_half_ht			= land->ht/2;
+
+// mesh_geometry[i] holds the vertices of meshes[i]
+triangles* meshes[NUM_TRIMESHES] = { &tri_box, &tri_sphere, &tri_treeHD, &tri_tree, &tri_treeLOD };
+
+lod_group* lod_tree		= 0;
+impostor*  imp_tree		= 0;						// far trees are billboards, if the atlas could be made
+vec4 tree_colour		= vec4(0,0,0,1);
+vector<vec4> tree_trunk;							// box inside the trunk of tri_tree, for occlusion culling
+occlusion_buffer* occlusion = 0;
 
 object* player			= 0;						// one object is the 'player' from which the eye is drawn
 object* obj_hm			= 0;
@@ -82,7 +179,7 @@ float madness			= 0;
 int currPage = 0;
 vector<bool> keystate(256);
 bool warped;
-vec4 boxdim(32,32,32,0);
+vec4 boxdim((float)map_half_wd,32,(float)map_half_ht,0);
 
 FSOUND_STREAM* g_mp3_stream = NULL;
 
@@ -104,28 +201,16 @@ float flatDistance(vec4 a, vec4 b){
 	return sqrt( (a.x-b.x)*(a.x-b.x) + (a.z-b.z)*(a.z-b.z) );
 }
 
-// Bitmap lookups
-float height(int x, int z) {
-	int p = 4 * ((z+32)*hm->wd+(x+32));
-	float h = hm->pixels[p] * INVERSE256;
-	return MAX_HEIGHT * h;
-}
-
-bool tree(int x, int z){
-	int p = 4 * ((z+32)*hm->wd+(x+32));
-	return tm->pixels[p];
-}
-
 float interpolatedHeight(float x, float z){
 	int xRoundDown	= (int)(x);			// x position, to int, rounded down
 	int zRoundDown	= (int)(z);			// z position, to int, rounded down
 	int xRoundUp	= (int)(x+0.5);		// x position, to int, rounded up 
 	int zRoundUp	= (int)(z+0.5);		// z position, to int, rounded up
 
-	float ypos[4] = {	obj_hm->sca.y * height(xRoundDown, zRoundDown),
-						obj_hm->sca.y * height(xRoundDown, zRoundUp),
-						obj_hm->sca.y * height(xRoundUp, zRoundUp),
-						obj_hm->sca.y * height(xRoundUp, zRoundDown)	};
+	float ypos[4] = {	obj_hm->sca.y * heightfield_height(land, xRoundDown, zRoundDown),
+						obj_hm->sca.y * heightfield_height(land, xRoundDown, zRoundUp),
+						obj_hm->sca.y * heightfield_height(land, xRoundUp, zRoundUp),
+						obj_hm->sca.y * heightfield_height(land, xRoundUp, zRoundDown)	};
 
 	float xCoeff = player->pos.x - xRoundDown;
 	float zCoeff = player->pos.z - zRoundDown;
@@ -146,10 +231,11 @@ void init_program()
 	// Specify a GLSL program that will be applied to each vertex independently
 	// (a "vertex program" or "vertex shader")
 	
-	const char* vscode =						// vertex shader code
-		"#version 120					\n"     // code is in GLSL version 1.20 (OpenGL 2.1)		
+	string vscode = string(						// vertex shader code
+		"#version 120					\n")    // code is in GLSL version 1.20 (OpenGL 2.1)		
+		+ camera_glsl() +						// view matrix
 		"uniform mat4 P;				\n"     // projection matrix
-		"uniform mat4 M;				\n"     // modelview matrix
+		"uniform mat4 M;				\n"     // model matrix
 
 		"attribute vec4 c;				\n" 
 		"attribute vec4 p;				\n"     // the (x,y,z,1) point that we should process
@@ -158,97 +244,214 @@ void init_program()
 
 		"void main()					\n"
 		"{								\n"
-		"	gl_Position = P*M*p;		\n"		// just transform model-coordinates to clip-coordinates
+		"	gl_Position = P*V*M*p;		\n"		// just transform model-coordinates to clip-coordinates
 		"	p_col = c;					\n"												
 												// Everything is done at the fragment level
 		"}								\n";
 	
 	// Specify a GLSL program that will be applied to each pixel ('fragment') 
 	// independently (a "fragment program" or "fragment shader")
-	const char* fscode =						// fragment shader code
+	const char* fsheader =						// fragment shader declarations
 		"#version 120					\n"		// code is in GLSL version 1.20 (OpenGL 2.1)
 		"uniform float time;"
 		"uniform vec2 resolution;"
 		"uniform float madness;"
 
-		"varying vec4 p_col;			\n"		// Point Colour
+		"varying vec4 p_col;			\n";	// Point Colour
 
-		"void main()					\n"
+	// The effect stack for one pixel at screen position q (0..1) with window depth 'depth'
+	// and surface colour p_col. It runs in the post pass over the finished scene if the
+	// offscreen target is available, otherwise for every fragment as it is drawn.
+	const char* fseffects =
+		"vec4 effects(vec2 q, float depth, vec4 p_col)	\n"
 		"{								\n"
 
-		"	vec2 q = gl_FragCoord.xy / resolution.xy;"
-		"	vec2 uv = 0.5 + (q-0.5)*(0.95 + 0.05*sin(0.2*time));"
+		"	vec2 uv = 0.5 + (q-0.5)*(0.95 + 0.05*sin(0.2*time));	\n"
 
 			// Fog Colour
 			"	vec4 fogColour	= vec4(0.7,0.7,0.7,1);"
 			// Increase contrast on the depth
-			"	float d0		= pow(gl_FragCoord.z, 64); \n"
-			"	vec4 oricol		= clamp(	d0*fogColour	+gl_FragCoord.z*0.5*(1-madness/4)*fogColour		+p_col,			0.0,1.0);\n"
+			"	float d0		= pow(depth, 64); \n"
+			"	vec4 oricol		= clamp(	d0*fogColour	+depth*0.5*(1-madness/4)*fogColour		+p_col,			0.0,1.0);\n"
 		    "	vec4 col = oricol;"
 			// Contrast
 			"	col = clamp(col*0.5 + 0.5*col*col*1.2 ,0.0,1.0);													\n"
 			// radial vignette
+			"#ifdef VIGNETTE																						\n"
 			"	col = col * (0.5 + 0.5*16.0*uv.x*uv.y*(1.0-uv.x)*(1.0-uv.y));										\n"
+			"#endif																								\n"
 			// Green Shift
 			"	col = col * (vec3(0.9, 1.0, 0.8));																	\n"
+			"#ifdef SCANLINES																						\n"
 		    // Scan lines
 			"	col = col * (0.95+0.05 * sin(10.0*time+uv.y*1000.0));												\n"
 			// Slight flicker
 			"	col = col * ( 0.97 + 0.03 * sin(110.0*time) );														\n"
+			"#endif																								\n"
+			"#ifdef NOISE																							\n"
 			 // static strength
 			"	float noiseCoeff = 0.1*madness + 0.03 * sin(23.42357*time);											\n"
 			// pseudo-random number generator
 			"	vec4 noiseCol = fract(sin(dot(uv.xy , vec2(12.9898,78.233) ) )* 43758.5453) * vec4(1,1,1,1);		\n"
 			// Put it all together
-			"	gl_FragColor = (1-noiseCoeff) * col + (noiseCoeff) * noiseCol;										\n"	
+			"	return (1-noiseCoeff) * col + (noiseCoeff) * noiseCol;												\n"	
+			"#else																									\n"
+			"	return col;																							\n"
+			"#endif																								\n"
 		"}																											\n";
 
+	fx = postfx_create(POST_SCALE);
+
+	// Materials just output their colour when the post pass does the rest
+	const char* fsshade = fx ?
+		"	gl_FragColor = p_col;		\n" :
+		"	gl_FragColor = effects(gl_FragCoord.xy / resolution.xy, gl_FragCoord.z, p_col);	\n";
+
+	string fscode = string(fsheader) + fseffects +
+		"void main()					\n"
+		"{								\n" + fsshade +
+		"}								\n";
+
+	// Billboards discard whatever is outside the silhouette in the atlas
+	string fsimpostor = string(fsheader) +
+		"uniform sampler2D atlas;		\n"
+		"varying vec2 atlas_uv;			\n" + fseffects +
+		"void main()					\n"
+		"{								\n"
+		"	if (texture2D(atlas, atlas_uv).a < 0.5) discard;	\n" + fsshade +
+		"}								\n";
+
+	// Post pass: pixels left at the far plane are background and keep their clear colour.
+	// A scene drawn below window resolution is stretched over the screen and sharpened
+	// against the average of its four neighbours to make up for the blur
+	string fspost = string(
+		"#version 120					\n"
+		"uniform float time;"
+		"uniform float madness;"
+		"uniform sampler2D scene;		\n"
+		"uniform sampler2D depth;		\n"
+		"uniform vec2 scene_scale;		\n"
+		"uniform vec2 scene_texel;		\n"
+		"uniform float sharpen;			\n"
+		"varying vec2 screen_uv;		\n") + fseffects +
+		"vec4 scene_colour(vec2 uv)		\n"
+		"{								\n"
+		"	return texture2D(scene, min(uv, scene_scale - 0.5*scene_texel));	\n"	// stay inside what was drawn
+		"}								\n"
+		"void main()					\n"
+		"{								\n"
+		"	vec2 uv = screen_uv * scene_scale;	\n"
+		"	vec4 p_col = scene_colour(uv);		\n"
+		"	if (sharpen > 0.0) {				\n"
+		"		vec4 blur = 0.25*(scene_colour(uv + vec2(scene_texel.x,0)) + scene_colour(uv - vec2(scene_texel.x,0))	\n"
+		"		                + scene_colour(uv + vec2(0,scene_texel.y)) + scene_colour(uv - vec2(0,scene_texel.y)));	\n"
+		"		p_col = clamp(p_col + sharpen*(p_col - blur), 0.0, 1.0);	\n"
+		"	}									\n"
+		"	float z = texture2D(depth, uv).r;	\n"
+		"	gl_FragColor = (z < 1.0) ? effects(screen_uv, z, p_col) : p_col;	\n"
+		"}								\n";
+
 	// Compile each piece of code and link them into a shader program
-	// i.e. "vertex shader" + "fragment shader" = GLSL program
-	program = gl_createprogram(vscode,fscode);
+	// i.e. "vertex shader" + "fragment shader" = GLSL program.
+	// Whichever programs run the effects get a variant for each combination of them;
+	// all are requested now, from the shader cache or compiled in the background
+	const char* features[NUM_EFFECTS] = { "VIGNETTE", "SCANLINES", "NOISE" };
+	int material_features = fx ? 0 : NUM_EFFECTS;
+	program_variants[0] = variants_create(vscode.c_str(),fscode.c_str(),features,material_features);
+	program_variants[1] = variants_create(geometry_vertex_shader(),fscode.c_str(),features,material_features);
+	program_variants[2] = variants_create(impostor_vertex_shader(),fsimpostor.c_str(),features,material_features);
+	program_variants[3] = fx ? variants_create(postfx_vertex_shader(),fspost.c_str(),features,NUM_EFFECTS) : 0;
+	for (int i = 0; i < 4; ++i)
+		if (program_variants[i])
+			variants_prewarm(program_variants[i]);
+	gl_initdrawbitmap();
+}
+
+// Pick the programs with just the effects that make a difference right now
+void select_programs()
+{
+	unsigned features = EFFECT_VIGNETTE | EFFECT_SCANLINES;
+	if (governor && governor->tier < EFFECTS_MIN_TIER)
+		features = 0;					// the cheapest tier keeps fog and colour, nothing more
+	if (madness > 0)
+		features |= EFFECT_NOISE;		// otherwise the static is too faint to see
+
+	program = variants_get(program_variants[0], features);
+	mesh_program = variants_get(program_variants[1], features);
+	impostor_program = variants_get(program_variants[2], features);
+	if (program_variants[3])
+		post_program = variants_get(program_variants[3], features);
 }
 
 // Send meshes down the drinking straw
 void init_vertex_buffer()
 {
-	// Just like for textures, we must ask OpenGL for a unique ID
-	// that will identify some vert
-	glGenBuffers(NUM_TRIMESHES,&mesh_vbo[0]);														/* number of buffers needed */
+	// All meshes share one arena; sharing vertices can only make them smaller than their triangle lists
+	int max_vertices = 0;
+	for (int i = 0; i < NUM_TRIMESHES; i++)
+		max_vertices += meshes[i]->size();
+	arena = geometry_create(max_vertices, max_vertices);
+
+	for (int i = 0; i < NUM_TRIMESHES; i++) {
+		mesh_geometry[i] = geometry_add(arena, *meshes[i]);
+		assert_msg(mesh_geometry[i], "geometry arena is full");
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER,	mesh_vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER,	tri_box.size()*sizeof(vertex),		&tri_box[0],		GL_STATIC_DRAW);
-	
-	glBindBuffer(GL_ARRAY_BUFFER,	mesh_vbo[1]);
-	glBufferData(GL_ARRAY_BUFFER,	tri_sphere.size()*sizeof(vertex),	&tri_sphere[0],		GL_STATIC_DRAW);
-	
-	glBindBuffer(GL_ARRAY_BUFFER,	mesh_vbo[2]);
-	glBufferData(GL_ARRAY_BUFFER,	tri_hm.size()*sizeof(vertex),		&tri_hm[0],			GL_STATIC_DRAW);
+	terrain_init_buffers(ter);
 
-	glBindBuffer(GL_ARRAY_BUFFER,	mesh_vbo[3]);
-	glBufferData(GL_ARRAY_BUFFER,	tri_tree.size()*sizeof(vertex),		&tri_tree[0],		GL_STATIC_DRAW);
+	// distant trees; the atlas is cached next to the game so later launches skip rendering it
+	imp_tree = impostor_create(tri_tree, IMPOSTOR_VIEWS, IMPOSTOR_SIZE, "tree6_1_impostor.bmp");
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER,	mesh_vbo[4]);
-	glBufferData(GL_ARRAY_BUFFER,	tri_treeLOD.size()*sizeof(vertex),	&tri_treeLOD[0],	GL_STATIC_DRAW);
+// Find the vertex buffer holding a mesh
+geometry_mesh* mesh_geometry_of(const triangles* tri)
+{
+	for (int i = 0; i < NUM_TRIMESHES; i++)
+		if (meshes[i] == tri)
+			return mesh_geometry[i];
+	return 0;
+}
+
+// Trees get finer up close and disappear in the distance; the distances
+// are for our own field of view and the trees' scale
+void init_tree_levels(const quality_tier& q)
+{
+	float view = q.view_distance;
+	lod_clear_levels(lod_tree);
+	lod_add_level(lod_tree, &tri_tree,		min(DETAIL_DISTANCE*q.lod_scale, view) / TREE_SCALE);
+	lod_add_level(lod_tree, &tri_treeLOD,	min(LOD_DISTANCE*q.lod_scale, view) / TREE_SCALE);
+	if (imp_tree)
+		lod_add_impostor(lod_tree, imp_tree,min(IMPOSTOR_DISTANCE*q.lod_scale, view) / TREE_SCALE);
+	lod_set_cull_distance(lod_tree,			view / TREE_SCALE);
 }
 
 // Initialize objects
 void init_objects()
 {
+	lod_tree = lod_create(&tri_treeHD);
+	init_tree_levels(quality_current(governor));
+	tree_trunk = occlusion_trunk_proxy(tri_tree);
+	occlusion = occlusion_create();
+
 	// create height map
 	obj_hm = new object;
 	obj_hm->pos = vec4(0,0,0,1);
-	obj_hm->tri = &tri_hm;
 	obj_hm->sca.y = 0.5;
-	objects.push_back(obj_hm);
+	objects.push_back(obj_hm);							// no 'tri'; drawn through the terrain chunks instead
 
-	for(int x = -32; x < 32; x++){
-		for(int z = -32; z < 32; z++){
-			if(tree(x,z)){
+	rng placement;
+	rng_seed(&placement, WORLD_SEED);
+	for(int x = -map_half_wd; x < map_half_wd; x++){
+		for(int z = -map_half_ht; z < map_half_ht; z++){
+			if(bitmask_at(tree_map, x, z)){
 				object* obj_tree = new object;
-				obj_tree->pos = vec4(x, height(x,z)*obj_hm->sca.y + TREE_OFFSET, z, 1);
+				obj_tree->pos = vec4(x, heightfield_height(land, x, z)*obj_hm->sca.y + TREE_OFFSET, z, 1);
 				obj_tree->tri = &tri_tree;
-				obj_tree->rot.y = rand();
-				obj_tree->sca = vec4(0.5,0.5,0.5,1);
+				obj_tree->lod = lod_tree;
+				obj_tree->thinning = rng_float(&placement);
+				obj_tree->clr = tree_colour;
+				obj_tree->rot.y = 2*PI*rng_float(&placement);
+				obj_tree->sca = vec4(TREE_SCALE,TREE_SCALE,TREE_SCALE,1);
 				obj_tree->collisionRadius = TREE_RADIUS;
 				obj_tree->postable = true;
 				objects.push_back(obj_tree);
@@ -287,7 +490,7 @@ void init_objects()
 	// insert player into world as an object with some position/rotation; we remember the 
 	// object's pointer so that we can manipulate its position and draw from its viewpoint
 	player = new object;
-	player->pos = vec4(0, height(0,0) ,0,1);
+	player->pos = vec4(0, heightfield_height(land, 0, 0) ,0,1);
 	objects.push_back(player);
 }
 
@@ -302,13 +505,111 @@ mat4x4 xform(const object* obj)
 	return T*Rx*Ry*Rz*S;  // scale first, then rotate z,y,x, then translate
 }
 
-void draw_scene(const mat4x4& P, const object* camera)
+// Turn 'obj' by a mouse movement of (diffx,diffy) pixels
+void apply_mouse_look(object* obj, float diffx, float diffy)
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // clear color, and reset the z-buffer
+	//Suffers from gymbal locking but still works better than current quaternion implementation.
+	
+	obj->rot.y += 0.005f*diffx;
+        
+	// Allows for vertical movement relative to the x axis.
+	// Closer to the x-axis, this condenses to 0.
+	// Some rotation in the z-axis(?) should take over as this happens.
+		obj->rot.x -= 0.005f*diffy*(cos(obj->rot.y) //- 0.005*diffx*sin(obj->rot.x)
+			);
+
+		obj->rot.z -= 0.005f*diffy*(sin(obj->rot.y) //+ 0.005*diffx*cos(obj->rot.z)
+			);
+		
+		
+		obj->rot.x = clamp(obj->rot.x, -PI/4, PI/4);
+		obj->rot.z = clamp(obj->rot.z, -PI/4, PI/4);
+
+	//Seems to keep the camera level.
+		obj->rot.z = sin(obj->rot.y)*sin(obj->rot.x);
+}
+
+// Mouse movement that GLUT has not delivered to mouseMovement yet: how far the cursor is from
+// the center it was last warped to. Only Windows lets us ask; the window is fullscreen.
+bool poll_mouse(float& diffx, float& diffy)
+{
+#ifdef WIN32
+	POINT pt;
+	if (!GetCursorPos(&pt))
+		return false;
+	diffx = (float)(pt.x - glutGet(GLUT_WINDOW_X) - glutGet(GLUT_WINDOW_WIDTH)/2);
+	diffy = (float)(pt.y - glutGet(GLUT_WINDOW_Y) - glutGet(GLUT_WINDOW_HEIGHT)/2);
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Bind the shader with the per-object uniforms and colour; returns the position attribute location
+GLuint use_program(GLuint program, const mat4x4& P, const mat4x4& M, const vec4& clr)
+{
+	glUseProgram(program);
+	camera_use(eye_block, program);
+	glUniformMatrix4fv(glGetUniformLocation(program,"P"),1,GL_TRUE,P.ptr());
+	glUniformMatrix4fv(glGetUniformLocation(program,"M"),1,GL_TRUE,M.ptr());
+
+	glUniform1f(glGetUniformLocation(program,"time"), time);
+	glUniform1f(glGetUniformLocation(program,"madness"), madness);
+	glUniform2f(glGetUniformLocation(program,"resolution"),glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
 
-	// prepare to configure modelview matrix
+	// Send object colour to vertex shader
+	GLint cloc = glGetAttribLocation(program,"c");
+	if (cloc >= 0)									// arena meshes take their colour per object instead
+		glVertexAttrib4f(cloc, clr.x, clr.y, clr.z, clr.w);
+
+	return glGetAttribLocation(program,"p");
+}
+
+void draw_scene(const mat4x4& P, const object* camera)
+{
+	// Culling, levels of detail and uploads use the camera as it was when the frame began;
+	// the view matrix the GPU draws with is only decided right before the draw calls
 	mat4x4 Meye_inv = inverse(xform(camera));
 
+	// Terrain culls its own chunks and picks a level of detail for each
+	mat4x4 Mhm = Meye_inv*xform(obj_hm);
+	terrain_cull(ter, P, Mhm);
+
+	// Hills and nearby trunks go into a small software depth buffer
+	// so that whatever they hide can be skipped below
+	occlusion_begin(occlusion, P);
+	for (size_t i = 0; i < ter->visible.size(); ++i) {
+		const terrain_chunk& c = ter->chunks[ter->visible[i]];
+		occlusion_add_triangles(occlusion, Mhm, &ter->occluder[c.first_occluder], c.occluder_count);
+	}
+	if (!tree_trunk.empty()) {
+		static vector<pair<float,object*> > near_trees;
+		near_trees.clear();
+		for (size_t i = 0; i < objects.size(); ++i) {
+			float dist = flatDistance(objects[i]->pos, camera->pos);
+			if (objects[i]->lod == lod_tree && dist < OCCLUDER_DISTANCE)
+				near_trees.push_back(make_pair(dist, objects[i]));
+		}
+		if (near_trees.size() > MAX_OCCLUDER_TREES) {
+			nth_element(near_trees.begin(), near_trees.begin() + MAX_OCCLUDER_TREES, near_trees.end());
+			near_trees.resize(MAX_OCCLUDER_TREES);
+		}
+		for (size_t i = 0; i < near_trees.size(); ++i)
+			occlusion_add_triangles(occlusion, Meye_inv*xform(near_trees[i].second), &tree_trunk[0], tree_trunk.size());
+	}
+	occlusion_rasterize(occlusion);
+
+	// chunks behind nearer hills need not be drawn either
+	size_t kept = 0;
+	for (size_t i = 0; i < ter->visible.size(); ++i) {
+		const terrain_chunk& c = ter->chunks[ter->visible[i]];
+		if (occlusion_test_aabb(occlusion, Mhm, c.bmin, c.bmax))
+			ter->visible[kept++] = ter->visible[i];
+	}
+	ter->visible.resize(kept);
+
+	frustum view = frustum_from_matrix(P);
+
 	for (size_t i = 0; i < objects.size(); ++i) {
 		object* obj = objects[i];
 		
@@ -316,59 +617,140 @@ void draw_scene(const mat4x4& P, const object* camera)
 		if (!(obj->tri) )
 			continue;
 
-		int size = (obj->tri)->size();
-		mat4x4 M = Meye_inv*xform(obj);
+		mat4x4 Mmodel = xform(obj);
+		mat4x4 M = Meye_inv*Mmodel;
+		triangles* tri = obj->tri;
 
-		if (obj->tri == &tri_box) {
-			glBindBuffer(GL_ARRAY_BUFFER,mesh_vbo[0]);
-		}
-		else if (obj->tri == &tri_sphere) {
-			glBindBuffer(GL_ARRAY_BUFFER,mesh_vbo[1]);
-		}
-		else if (obj->tri == &tri_hm) {
-			glBindBuffer(GL_ARRAY_BUFFER,mesh_vbo[2]);
-		}
-		else if (obj->tri == &tri_tree) {
-			if(flatDistance(obj->pos, player->pos) > VIEW_DISTANCE){
+		if (obj->lod) {
+			// Cheaper quality tiers leave out some of the trees that are not close by
+			if (obj->thinning >= quality_current(governor).tree_density && flatDistance(obj->pos, camera->pos) > DETAIL_DISTANCE)
 				continue;
+
+			// Skip anything off screen, then pick the level for how big it looks
+			float scale = max(obj->sca.x, max(obj->sca.y, obj->sca.z));
+			if (frustum_test_sphere(view, M*obj->lod->center, obj->lod->radius*scale) == FRUSTUM_OUTSIDE)
+				continue;
+			if (!occlusion_test_sphere(occlusion, M*obj->lod->center, obj->lod->radius*scale))
+				continue;						// behind a hill or a nearer tree
+
+			obj->lod_level = lod_select(obj->lod, lod_screen_size(obj->lod, P, M), obj->lod_level);
+			if (obj->lod_level >= (int)obj->lod->levels.size())
+				continue;						// too small to see
+
+			const lod_level& level = obj->lod->levels[obj->lod_level];
+			if (level.imp) {
+				impostor_add(level.imp, obj->pos, obj->rot.y, obj->sca.x, camera->pos);
+				continue;						// drawn with the other billboards below
 			}
-			else if(flatDistance(obj->pos, player->pos) > LOD_DISTANCE){
-				glBindBuffer(GL_ARRAY_BUFFER,mesh_vbo[4]);
-				size = tri_treeLOD.size();			// Using smaller model so need to be careful of out of bounds.
-			}
-			else{
-				glBindBuffer(GL_ARRAY_BUFFER,mesh_vbo[3]);
-			}
+			tri = level.tri;
 		}
 
+		geometry_queue(mesh_geometry_of(tri), Mmodel, obj->clr);	// drawn with everything else that uses this mesh below
+	}
 
-		glUseProgram(program);
-		glUniformMatrix4fv(glGetUniformLocation(program,"P"),1,GL_TRUE,P.ptr());
-		glUniformMatrix4fv(glGetUniformLocation(program,"M"),1,GL_TRUE,M.ptr());
-
-		glUniform1f(glGetUniformLocation(program,"time"), time);
-		glUniform1f(glGetUniformLocation(program,"madness"), madness);
-		glUniform2f(glGetUniformLocation(program,"resolution"),glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+	// This frame's per-object data goes to the GPU in one contiguous write
+	stream_map(stream);
+	geometry_upload(arena, stream);
+	if (imp_tree)
+		impostor_upload(imp_tree, stream);
+	stream_unmap(stream);
+
+	// Late latch: turn the view by any mouse movement that arrived while we were busy
+	object latched = *camera;
+	double input_time = max(mouse_time, pacer->frame_start);
+	float diffx, diffy;
+	if (poll_mouse(diffx, diffy)) {
+		apply_mouse_look(&latched, diffx, diffy);
+		input_time = pacer_now();
+	}
+	camera_latch(eye_block, inverse(xform(&latched)), input_time);
 
-		// Send point array to vertex shader
-		GLuint ploc = glGetAttribLocation(program,"p");
-		glVertexAttribPointer(ploc,4,GL_FLOAT,GL_FALSE,sizeof(vertex),OFFSET(vertex,p));
-		glEnableVertexAttribArray(ploc);
+	// The CPU work is done; from here on the scene's GPU time is measured
+	dynres_begin_frame(resolution);
+	profiler_begin_pass(gpu_profile, "clear");
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // clear color, and reset the z-buffer
+	profiler_end_pass(gpu_profile);
+
+	profiler_begin_pass(gpu_profile, "terrain");
+	terrain_draw(ter, P, Mhm, use_program(program, P, xform(obj_hm), obj_hm->clr));
+	glUseProgram(0);
+	profiler_end_pass(gpu_profile);
+
+	// Every queued object, a single instanced draw per mesh
+	profiler_begin_pass(gpu_profile, "meshes");
+	use_program(mesh_program, P, mat4x4(), vec4(0,0,0,1));
+	geometry_draw(arena, mesh_program);
+	glUseProgram(0);
+	profiler_end_pass(gpu_profile);
+
+	// All far trees at once, as billboards in world coordinates
+	if (imp_tree) {
+		profiler_begin_pass(gpu_profile, "impostors");
+		use_program(impostor_program, P, mat4x4(), tree_colour);
+		impostor_draw(imp_tree, impostor_program, camera->pos);
+		glUseProgram(0);
+		profiler_end_pass(gpu_profile);
+	}
 
-		// Send object colour to vertex shader
-		GLuint cloc = glGetAttribLocation(program,"c");
-		glVertexAttrib4f(cloc, obj->clr.x, obj->clr.y, obj->clr.z, obj->clr.w);
+	camera_submitted(eye_block);
+	stream_fence(stream);		// its region is reused once the GPU has drawn this frame
+}
 
-		glDrawArrays(GL_TRIANGLES,0, size );			// Rasterize
+// draw_minimap
+//    Marks the pages put up so far and the player, facing the way they
+//    look, and draws the minimap in the top-right corner.
+//
+void draw_minimap()
+{
+	if (!SHOW_MINIMAP || !overview)
+		return;
+	minimap_begin(overview);
+	for (int i = 0; i < currPage; ++i)
+		minimap_mark(overview, obj_page[i]->pos.x, obj_page[i]->pos.z, 3, 255, 255, 255);
+	vec4 facing = rotation_y(player->rot.y)*vec4(0,0,-1,0);
+	minimap_mark(overview, player->pos.x, player->pos.z, 4, 255, 220, 120, facing.x, facing.z);
+	minimap_end(overview);		// redraws only the tiles whose markers moved
+
+	GLboolean depth = glIsEnabled(GL_DEPTH_TEST), cull = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	int left = glutGet(GLUT_WINDOW_WIDTH) - overview->image->wd - 8;
+	gl_drawbitmap(overview->image, left, 8);
+	if (depth) glEnable(GL_DEPTH_TEST);
+	if (cull) glEnable(GL_CULL_FACE);
+}
 
-		// Optional
-		glUseProgram(0);
-		glBindBuffer(GL_ARRAY_BUFFER,0);
+// draw_hud
+//    Queues the frame times, resolution, quality tier and page count in
+//    the top-left corner and draws them, all in one batch.
+//
+void draw_hud()
+{
+	if (!SHOW_HUD || !text_available())
+		return;
+	char line[128];
+	sprintf_s(line, sizeof(line), "cpu %5.2f ms  gpu %5.2f ms  input %5.2f ms",
+	        pacer->cpu_busy_ms, pacer->gpu_busy_ms, eye_block->latency_avg_ms);
+	text_draw(line, 8, 8, 255, 255, 255);
+	sprintf_s(line, sizeof(line), "scene %3d%%  quality %s",
+	        fx ? (int)(100*resolution->scale) : 100, quality_current(governor).name);
+	text_draw(line, 8, 8 + TEXT_LINE_HT, 255, 255, 255);
+	sprintf_s(line, sizeof(line), "pages %d/%d", currPage, NUM_PAGES);
+	text_draw(line, 8, 8 + 2*TEXT_LINE_HT, 255, 220, 120);
+	if (recorder && recorder->recording) {
+		sprintf_s(line, sizeof(line), "recording frame %ld (%ld dropped)", recorder->number, recorder->dropped);
+		text_draw(line, 8, 8 + 3*TEXT_LINE_HT, 255, 80, 80);
 	}
+	text_flush();
 }
 
 void redraw()
 {
+	pacer_begin_frame(pacer);			// already done if update() called us
+	quality_begin_frame(governor);
+	profiler_begin_frame(gpu_profile);
+	select_programs();
+
 	//increment the global timer (used in shader for generating random numbers, should not be treated as actual timer)
 	time++;
 
@@ -383,16 +765,84 @@ void redraw()
 	glScissor(0,0,window_wd,window_ht);
 
 	mat4x4 P0 = perspective(-.1f,.1f,-.1f/aspect,.1f/aspect,-.1f,-100);
+	if (fx) {
+		fx->render_scale = resolution->scale;
+		postfx_begin(fx, (int)window_wd, (int)window_ht);	// scene goes offscreen first, maybe at lower resolution
+	}
 	draw_scene(P0,player);
 
+	// then the screen effects, once for each pixel
+	if (fx) {
+		profiler_begin_pass(gpu_profile, "post");
+		glUseProgram(post_program);
+		glUniform1f(glGetUniformLocation(post_program,"time"), time);
+		glUniform1f(glGetUniformLocation(post_program,"madness"), madness);
+		postfx_end(fx, post_program);
+		glUseProgram(0);
+		profiler_end_pass(gpu_profile);
+	}
+	dynres_end_frame(resolution);		// the scene and its effects are all that the scale changes
+	if (recorder) {
+		profiler_begin_pass(gpu_profile, "capture");	// before the HUD, so recordings can be compared
+		capture_frame(recorder, (int)window_wd, (int)window_ht);
+		profiler_end_pass(gpu_profile);
+	}
+	profiler_begin_pass(gpu_profile, "hud");
+	draw_minimap();
+	draw_hud();
+	profiler_end_pass(gpu_profile);
+	profiler_end_frame(gpu_profile);
+	if (quality_end_frame(governor, gpu_profile->frame_busy_ms))	// its own measurement, not the one dynres steers by
+		init_tree_levels(quality_current(governor));	// objects move to their new levels as they are drawn
+
 	// since drawing may take a while, we draw to an off-screen buffer and then
 	// copy it to the screen (swap buffers) only once drawing is finished.
 	glutSwapBuffers();
-	glFinish();
+	pacer_end_frame(pacer, gpu_profile->frame_busy_ms);	// lets the GPU keep working while we start on the next frame
+
+	// mouse-look latency (and what the frame cost) about once a second
+	static double last_report = 0;
+	if (pacer_now() - last_report >= 1) {
+		last_report = pacer_now();
+		cout << "input to submit " << eye_block->latency_avg_ms << " ms (last " << eye_block->latency_ms << " ms)"
+		     << ", cpu " << pacer->cpu_busy_ms << " ms, gpu " << pacer->gpu_busy_ms << " ms"
+		     << ", waiting " << pacer->cpu_wait_ms << " ms"
+		     << ", scene at " << (fx ? (int)(100*resolution->scale) : 100) << "% (gpu " << resolution->gpu_ms << " ms)"
+		     << ", quality " << quality_current(governor).name << " (cpu " << governor->cpu_ms << " ms, gpu " << governor->gpu_ms << " ms)" << endl;
+		if (!gpu_profile->stats.empty()) {
+			cout << "gpu passes:";
+			for (size_t i = 0; i < gpu_profile->stats.size(); ++i)
+				cout << " " << gpu_profile->stats[i].name << " " << gpu_profile->stats[i].gpu_ms << " ms";
+			cout << " (frame " << gpu_profile->frame_gpu_ms << " ms)" << endl;
+		}
+	}
+}
+
+// quit_game
+//    Every way out of the game comes through here while the GL context
+//    still exists, so the recorder can read back and write what it has.
+//
+void quit_game()
+{
+	if (recorder)
+		capture_delete(recorder);	// writes what is still queued
+	recorder = 0;
+	exit(0);
 }
 
 void key_down(unsigned char key, int x, int y)
 {
+	if (key == QUIT_KEY)
+		quit_game();
+	if (key == CAPTURE_KEY && !keystate[key] && recorder) {
+		if (recorder->recording) {
+			capture_stop(recorder);
+			cout << "recorded up to frame " << recorder->number << ", " << recorder->written << " written, "
+			     << recorder->dropped << " dropped, " << recorder->failed << " failed" << endl;
+		} else {
+			capture_start(recorder);
+		}
+	}
 	keystate[key] = true;
 }
 
@@ -435,25 +885,8 @@ void mouseMovement(int x, int y) {
 							*/
 
 
-		//Suffers from gymbal locking but still works better than current quaternion implementation.
-		
-		player->rot.y += 0.005f*diffx;
-        
-		// Allows for vertical movement relative to the x axis.
-		// Closer to the x-axis, this condenses to 0.
-		// Some rotation in the z-axis(?) should take over as this happens.
-			player->rot.x -= 0.005f*diffy*(cos(player->rot.y) //- 0.005*diffx*sin(player->rot.x)
-				);
-
-			player->rot.z -= 0.005f*diffy*(sin(player->rot.y) //+ 0.005*diffx*cos(player->rot.z)
-				);
-			
-			
-			player->rot.x = clamp(player->rot.x, -PI/4, PI/4);
-			player->rot.z = clamp(player->rot.z, -PI/4, PI/4);
-
-		//Seems to keep the camera level.
-			player->rot.z = sin(player->rot.y)*sin(player->rot.x);
+		apply_mouse_look(player, diffx, diffy);
+		mouse_time = pacer_now();
 
 		warped = true;
         glutWarpPointer(GW/2, GH/2);
@@ -474,6 +907,7 @@ void endGame(){
 void update(int)
 {
 	glutTimerFunc(20,&update,0);
+	pacer_begin_frame(pacer);			// wait for the GPU, if needed, before reading input
 	vec4 targetPos = player->pos;		// Move buffer in case player tries to move into a wall.
 
 	// to move the eye forward along current viewing angle
@@ -512,7 +946,7 @@ void update(int)
 
 
 			if(currPage >= NUM_PAGES ){
-				exit(0);
+				quit_game();
 			}
 			correctedPos.y = player->pos.y;
 			vec4 relativeDir = normalize(player->pos - correctedPos);
@@ -533,10 +967,10 @@ void update(int)
 		endGame();
 	}
 	// Go to your room, and STAY THERE
-	if (30 - targetPos.z <= 0)	{targetPos.z = 29.999;}		// near
-	if (targetPos.z + 31 <= 0)	{targetPos.z = -30.999;}	// far
-	if (29 - (targetPos.x)<= 0)	{targetPos.x = 28.999;}		// right
-	if (targetPos.x + 31 <= 0)	{targetPos.x = -30.999;}	// left
+	if (map_half_ht-2 - targetPos.z <= 0)	{targetPos.z = map_half_ht-2 - 0.001;}		// near
+	if (targetPos.z + map_half_ht-1 <= 0)	{targetPos.z = -(map_half_ht-1) + 0.001;}	// far
+	if (map_half_wd-3 - (targetPos.x)<= 0)	{targetPos.x = map_half_wd-3 - 0.001;}		// right
+	if (targetPos.x + map_half_wd-1 <= 0)	{targetPos.x = -(map_half_wd-1) + 0.001;}	// left
 
 	player->pos = targetPos;
 	redraw();
@@ -555,16 +989,36 @@ void main(int argc, char** argv)
 	glutFullScreen();
 	glutTimerFunc(20,&update,0);
 	gl3wInit();
+	jobs_init();
+	atexit(jobs_shutdown);		// workers must be joined before the program's globals go away
+	shader_init();				// saved program binaries, and a thread to compile the missing ones
+	atexit(shader_shutdown);
+	text_init();				// the glyph atlas, drawn once
 
 	// initialize ALL THE THINGS
 	//init_lights();
-	init_objects();
 	init_program();
 	init_vertex_buffer();
+	governor = quality_create(quality_tiers, NUM_QUALITY_TIERS, NUM_QUALITY_TIERS-1, CPU_BUDGET_MS, FRAME_BUDGET_MS, QUALITY_WINDOW);
+	init_objects();				// after the buffers, since tree levels of detail need the impostor atlas
+	overview = minimap_create(land, tree_map, MINIMAP_SCALE, obj_hm->sca.y);	// shaded once, on the job threads
+
+	pacer = pacer_create(FRAMES_IN_FLIGHT, LOW_LATENCY);
+	eye_block = camera_create();
+	gpu_profile = profiler_create(GPU_TIMELINE);
+	recorder = capture_create(CAPTURE_PREFIX, CAPTURE_WRITERS);	// deleted by quit_game
+	resolution = dynres_create(FRAME_BUDGET_MS, MIN_RENDER_SCALE, MAX_RENDER_SCALE, RENDER_SCALE_STEP, RENDER_SCALE_FRAMES);
+	if (fx)
+		fx->sharpen = SHARPEN;
+
+	// room for every object's instance data (and a billboard each) per frame, plus the draw commands
+	stream = stream_create(objects.size()*(GEOMETRY_INSTANCE_FLOATS*sizeof(float) + sizeof(impostor_instance))
+	                       + NUM_TRIMESHES*sizeof(geometry_command) + 4*STREAM_ALIGN);
+	select_programs();			// as late as possible, so compiling overlaps with loading
 
 	if( FSOUND_Init(44000,64,0) == FALSE )
 	{
-		exit(0);
+		quit_game();
 	}
 
 	// attempt to open the mp3 file as a stream
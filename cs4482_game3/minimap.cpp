@@ -0,0 +1,202 @@
+#include "minimap.h"
+#include "jobs.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// what the static layer is drawn from, for the row jobs
+struct minimap_source {
+	minimap*           mm;
+	const heightfield* land;
+	const bitmask*     trees;
+	float              vertical_scale;
+};
+
+// bilinear, in samples with sample centres at whole numbers
+static float height_at(const heightfield* hf, float u, float v)
+{
+	int x = (int)floor(u), y = (int)floor(v);
+	float fx = u - x, fy = v - y;
+	float top = heightfield_sample(hf,x,y)*(1-fx) + heightfield_sample(hf,x+1,y)*fx;
+	float bottom = heightfield_sample(hf,x,y+1)*(1-fx) + heightfield_sample(hf,x+1,y+1)*fx;
+	return top*(1-fy) + bottom*fy;
+}
+
+static void shade_row(int y, void* arg)
+{
+	const minimap_source* src = (const minimap_source*)arg;
+	const minimap* mm = src->mm;
+	const heightfield* hf = src->land;
+	float k = src->vertical_scale;
+	float bottom = hf->offset, range = heightfield_top(hf) - hf->offset;
+	float lx = -0.5f, ly = 0.7f, lz = -0.5f;   // light from the far left
+	float ll = sqrt(lx*lx + ly*ly + lz*lz);
+	lx /= ll; ly /= ll; lz /= ll;
+
+	unsigned char* p = mm->base->pixels + 4*(size_t)mm->base->wd*y;
+	float v = (y + 0.5f)/mm->scale - 0.5f;
+	for (int x = 0; x < mm->base->wd; ++x, p += 4) {
+		float u = (x + 0.5f)/mm->scale - 0.5f;
+		float h = height_at(hf,u,v);
+		float nx = -k*(height_at(hf,u+1,v) - height_at(hf,u-1,v))/2;
+		float nz = -k*(height_at(hf,u,v+1) - height_at(hf,u,v-1))/2;
+		float light = (nx*lx + ly + nz*lz)/sqrt(nx*nx + 1 + nz*nz);
+		float shade = 0.45f + 0.55f*std::max(light,0.0f);
+
+		// grass in the valley, drier higher up
+		float t = (h - bottom)/range;
+		float r = (60 + 90*t)*shade, g = (96 + 40*t)*shade, b = (50 + 50*t)*shade;
+
+		// a tree is a dark dot centred on its pixel
+		int tx = (int)floor(u + 0.5f), ty = (int)floor(v + 0.5f);
+		if (bitmask_at(src->trees,tx + hf->x0,ty + hf->z0)) {
+			float du = (u - tx)*mm->scale, dv = (v - ty)*mm->scale;
+			float cover = std::min(std::max(0.42f*mm->scale + 0.5f - sqrt(du*du + dv*dv),0.0f),1.0f);
+			r += (18 - r)*cover; g += (48 - g)*cover; b += (24 - b)*cover;
+		}
+		p[0] = (unsigned char)std::min(b,255.0f);
+		p[1] = (unsigned char)std::min(g,255.0f);
+		p[2] = (unsigned char)std::min(r,255.0f);
+		p[3] = 255;
+	}
+}
+
+minimap* minimap_create(const heightfield* land, const bitmask* trees, float scale, float vertical_scale)
+{
+	minimap* mm = new minimap;
+	mm->scale = scale;
+	mm->origin_x = 0.5f - land->x0;   // world x0 is the centre of the first sample
+	mm->origin_z = 0.5f - land->z0;
+	int wd = std::max(1,(int)(land->wd*scale + 0.5f));
+	int ht = std::max(1,(int)(land->ht*scale + 0.5f));
+	mm->base = bitmap_create(wd,ht);
+	mm->image = bitmap_create(wd,ht);
+	mm->tiles_x = (wd + MINIMAP_TILE-1)/MINIMAP_TILE;
+	mm->tiles_y = (ht + MINIMAP_TILE-1)/MINIMAP_TILE;
+	mm->drawn.assign(mm->tiles_x*mm->tiles_y,0);
+
+	minimap_source src = { mm, land, trees, vertical_scale };
+	jobs_parallel_for(ht,shade_row,&src);
+	bitmap_blit(mm->image,0,0,mm->base,0,0,wd,ht);
+	return mm;
+}
+
+void minimap_begin(minimap* mm)
+{
+	mm->markers.clear();
+}
+
+void minimap_mark(minimap* mm, float x, float z, float radius,
+                  unsigned char r, unsigned char g, unsigned char b, float dx, float dz)
+{
+	minimap_marker m;
+	m.x = (x + mm->origin_x)*mm->scale;
+	m.y = (z + mm->origin_z)*mm->scale;
+	m.radius = radius;
+	m.r = r; m.g = g; m.b = b;
+	mm->markers.push_back(m);
+
+	float len = sqrt(dx*dx + dz*dz);
+	if (len > 0) {
+		m.x += dx/len*radius*1.4f;
+		m.y += dz/len*radius*1.4f;
+		m.radius = radius*0.55f;
+		mm->markers.push_back(m);
+	}
+}
+
+// marker_tiles
+//    The tiles marker m touches, as [tx0,tx1) x [ty0,ty1); empty if none.
+//
+static void marker_tiles(const minimap* mm, const minimap_marker& m, int& tx0, int& ty0, int& tx1, int& ty1)
+{
+	int x0 = (int)floor(m.x - m.radius), y0 = (int)floor(m.y - m.radius);
+	int x1 = (int)floor(m.x + m.radius) + 1, y1 = (int)floor(m.y + m.radius) + 1;
+	x0 = std::max(x0,0); y0 = std::max(y0,0);
+	x1 = std::min(x1,mm->image->wd); y1 = std::min(y1,mm->image->ht);
+	if (x0 >= x1 || y0 >= y1) {
+		tx0 = tx1 = ty0 = ty1 = 0;
+		return;
+	}
+	tx0 = x0/MINIMAP_TILE; tx1 = (x1-1)/MINIMAP_TILE + 1;
+	ty0 = y0/MINIMAP_TILE; ty1 = (y1-1)/MINIMAP_TILE + 1;
+}
+
+static void draw_tile(int index, void* arg)
+{
+	minimap* mm = (minimap*)arg;
+	int tile = mm->changed[index];
+	int x0 = (tile % mm->tiles_x)*MINIMAP_TILE, y0 = (tile / mm->tiles_x)*MINIMAP_TILE;
+	int x1 = std::min(x0 + MINIMAP_TILE,mm->image->wd), y1 = std::min(y0 + MINIMAP_TILE,mm->image->ht);
+	int wd = mm->image->wd;
+
+	// back to the static layer; written directly, since bitmap_blit would touch the dirty rectangle
+	for (int y = y0; y < y1; ++y)
+		memcpy(mm->image->pixels + 4*((size_t)wd*y + x0),mm->base->pixels + 4*((size_t)wd*y + x0),4*(size_t)(x1-x0));
+
+	for (size_t i = 0; i < mm->markers.size(); ++i) {
+		const minimap_marker& m = mm->markers[i];
+		int mx0 = std::max(x0,(int)floor(m.x - m.radius)), my0 = std::max(y0,(int)floor(m.y - m.radius));
+		int mx1 = std::min(x1,(int)floor(m.x + m.radius) + 1), my1 = std::min(y1,(int)floor(m.y + m.radius) + 1);
+		float outline = std::min(1.2f,m.radius*0.4f);
+		for (int y = my0; y < my1; ++y) {
+			unsigned char* p = mm->image->pixels + 4*((size_t)wd*y + mx0);
+			for (int x = mx0; x < mx1; ++x, p += 4) {
+				float ddx = x + 0.5f - m.x, ddy = y + 0.5f - m.y;
+				float d = sqrt(ddx*ddx + ddy*ddy);
+				float cover = std::min(std::max(m.radius - d,0.0f),1.0f);
+				if (cover <= 0)
+					continue;
+				float fill = std::min(std::max(m.radius - outline - d,0.0f),1.0f);   // 0 on the outline
+				float c[3] = { m.b*fill, m.g*fill, m.r*fill };
+				for (int k = 0; k < 3; ++k)
+					p[k] = (unsigned char)(p[k] + (c[k] - p[k])*cover + 0.5f);
+			}
+		}
+	}
+}
+
+void minimap_end(minimap* mm)
+{
+	// which markers each tile should show, hashed (FNV-1a) in drawing order
+	mm->wanted.assign(mm->drawn.size(),0);
+	for (size_t i = 0; i < mm->markers.size(); ++i) {
+		int tx0, ty0, tx1, ty1;
+		marker_tiles(mm,mm->markers[i],tx0,ty0,tx1,ty1);
+		const minimap_marker& m = mm->markers[i];
+		float fields[4] = { m.x, m.y, m.radius, (float)(m.r << 16 | m.g << 8 | m.b) };   // not the struct, whose padding is undefined
+		const unsigned char* bytes = (const unsigned char*)fields;
+		for (int ty = ty0; ty < ty1; ++ty)
+			for (int tx = tx0; tx < tx1; ++tx) {
+				unsigned& h = mm->wanted[ty*mm->tiles_x + tx];
+				if (!h)
+					h = 2166136261u;
+				for (size_t b = 0; b < sizeof(fields); ++b)
+					h = (h ^ bytes[b])*16777619u;
+				h |= 1;   // never 0, which means no markers
+			}
+	}
+
+	mm->changed.clear();
+	for (size_t t = 0; t < mm->wanted.size(); ++t)
+		if (mm->wanted[t] != mm->drawn[t])
+			mm->changed.push_back((int)t);
+	if (mm->changed.empty())
+		return;
+
+	jobs_parallel_for((int)mm->changed.size(),draw_tile,mm);
+
+	for (size_t i = 0; i < mm->changed.size(); ++i) {
+		int t = mm->changed[i];
+		int x0 = (t % mm->tiles_x)*MINIMAP_TILE, y0 = (t / mm->tiles_x)*MINIMAP_TILE;
+		bitmap_dirty(mm->image,x0,y0,x0 + MINIMAP_TILE,y0 + MINIMAP_TILE);
+		mm->drawn[t] = mm->wanted[t];
+	}
+}
+
+void minimap_delete(minimap* mm)
+{
+	bitmap_delete(mm->base);
+	bitmap_delete(mm->image);
+	delete mm;
+}
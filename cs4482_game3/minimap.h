@@ -0,0 +1,74 @@
+#ifndef __MINIMAP_H__
+#define __MINIMAP_H__
+
+// minimap.h
+//    A map of the terrain seen from above, kept in a bitmap for
+//    gl_drawbitmap. The static layer (hill-shaded terrain with the trees
+//    on it) is drawn once, in parallel by rows. Each frame only markers
+//    are added, and only where they change anything: the bitmap is cut
+//    into tiles, each tile remembers which markers it was last drawn
+//    with, and the tiles whose markers differ (including those a marker
+//    just left) are redrawn from the static layer on the job threads.
+//    Only those tiles are then marked dirty for upload.
+
+#include "cs3388lib.h"
+#include "heightfield.h"
+#include <vector>
+
+#define MINIMAP_TILE  32   // pixels per side of the tiles redrawn in parallel
+
+//
+// minimap_marker -- a dot drawn over the map this frame
+//
+struct minimap_marker {
+	float x, y;            // centre, in pixels of the minimap
+	float radius;          // in pixels, including a dark outline
+	unsigned char r, g, b;
+};
+
+struct minimap {
+	bitmap* base;          // shaded terrain and trees
+	bitmap* image;         // base with the markers on top; what is drawn
+	float   scale;         // minimap pixels per world unit (heightfield sample)
+	float   origin_x;      // world x and z of the image's top-left corner, negated
+	float   origin_z;
+	int     tiles_x, tiles_y;
+	std::vector<minimap_marker> markers;    // this frame's, in drawing order
+	std::vector<unsigned>       drawn;      // per tile, a hash of the markers it shows; 0 if none
+	std::vector<unsigned>       wanted;     // the same for this frame's markers
+	std::vector<int>            changed;    // tiles to redraw this frame
+};
+
+// minimap_create
+//    Draws the static layer from the terrain's heights and a mask of
+//    where trees stand, covering the heightfield. 'scale' is minimap
+//    pixels per world unit, and vertical_scale the terrain object's
+//    scale along y, which sets the strength of the shading.
+//
+minimap* minimap_create(const heightfield* land, const bitmask* trees, float scale, float vertical_scale);
+
+// minimap_begin
+//    Starts a frame's markers; the previous frame's are forgotten.
+//
+void minimap_begin(minimap* mm);
+
+// minimap_mark
+//    Adds a dot at world position (x,z), of 'radius' minimap pixels. With
+//    a heading (dx,dz) a smaller dot is added in front of it, pointing.
+//
+void minimap_mark(minimap* mm, float x, float z, float radius,
+                  unsigned char r, unsigned char g, unsigned char b,
+                  float dx = 0, float dz = 0);
+
+// minimap_end
+//    Redraws the tiles whose markers changed, using the job threads.
+//    Draw mm->image with gl_drawbitmap afterwards.
+//
+void minimap_end(minimap* mm);
+
+// minimap_delete
+//    Releases both bitmaps.
+//
+void minimap_delete(minimap* mm);
+
+#endif // __MINIMAP_H__
@@ -0,0 +1,320 @@
+#include "occlusion.h"
+#include "jobs.h"
+#include <cmath>
+#include <algorithm>
+#include <emmintrin.h>
+
+#define OCCLUSION_BAND_ROWS  8   // rows of the depth buffer rasterized by one job
+
+occlusion_buffer* occlusion_create(int wd, int ht)
+{
+	assert_msg(wd > 0 && ht > 0 && wd % 8 == 0 && ht % 8 == 0, "occlusion buffer size must be a multiple of 8");
+
+	occlusion_buffer* ob = new occlusion_buffer;
+	ob->wd = wd;
+	ob->ht = ht;
+	ob->occluder_triangles = ob->tested = ob->culled = 0;
+
+	int w = wd, h = ht;
+	for (;;) {
+		ob->hiz.push_back(std::vector<float>(w*h,1.0f));
+		ob->hiz_wd.push_back(w);
+		ob->hiz_ht.push_back(h);
+		if (w == 1 && h == 1)
+			break;
+		w = (w+1)/2;
+		h = (h+1)/2;
+	}
+	return ob;
+}
+
+void occlusion_begin(occlusion_buffer* ob, const mat4x4& P)
+{
+	ob->P = P;
+	ob->screen.clear();
+	ob->occluder_triangles = ob->tested = ob->culled = 0;
+}
+
+////////////////////////////////////////////////////////
+
+// clip coordinates to (pixel x, pixel y, depth in [0,1])
+static vec4 to_screen(const occlusion_buffer* ob, const vec4& c)
+{
+	float iw = 1.0f/c.w;
+	return vec4((c.x*iw*0.5f + 0.5f)*ob->wd, (c.y*iw*0.5f + 0.5f)*ob->ht, c.z*iw*0.5f + 0.5f, 1);
+}
+
+void occlusion_add_triangles(occlusion_buffer* ob, const mat4x4& MV, const vec4* points, int count)
+{
+	mat4x4 M = ob->P*MV;
+	for (int i = 0; i+2 < count; i += 3) {
+		vec4 in[3] = { M*points[i], M*points[i+1], M*points[i+2] };
+
+		// clip against the near plane (z >= -w), which leaves at most four corners
+		vec4 poly[4];
+		int n = 0;
+		for (int k = 0; k < 3; ++k) {
+			const vec4& a = in[k];
+			const vec4& b = in[(k+1)%3];
+			float da = a.z + a.w, db = b.z + b.w;
+			if (da >= 0)
+				poly[n++] = a;
+			if ((da >= 0) != (db >= 0)) {
+				float t = da/(da - db);
+				poly[n++] = a + t*(b - a);
+			}
+		}
+		if (n < 3)
+			continue;
+
+		vec4 s0 = to_screen(ob,poly[0]);
+		for (int k = 1; k+1 < n; ++k) {
+			ob->screen.push_back(s0);
+			ob->screen.push_back(to_screen(ob,poly[k]));
+			ob->screen.push_back(to_screen(ob,poly[k+1]));
+			ob->occluder_triangles++;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////
+
+// Rasterize one triangle into rows [y0,y1) of the depth buffer, keeping the nearest depth.
+// Four pixels of a row are handled at once: edge functions and depth are evaluated
+// at the pixel centers, and only covered pixels that get nearer are written.
+static void raster_triangle(occlusion_buffer* ob, const vec4& v0, const vec4& v1, const vec4& v2, int y0, int y1)
+{
+	const vec4* a = &v0;
+	const vec4* b = &v1;
+	const vec4* c = &v2;
+	float area = (b->x - a->x)*(c->y - a->y) - (c->x - a->x)*(b->y - a->y);
+	if (fabs(area) < 1e-6f)
+		return;
+	if (area < 0) {
+		std::swap(b,c);  // occluders are solid from both sides; make the corners counter-clockwise
+		area = -area;
+	}
+
+	int xmin = std::max(0,        (int)floor(std::min(a->x,std::min(b->x,c->x))));
+	int xmax = std::min(ob->wd-1, (int)ceil (std::max(a->x,std::max(b->x,c->x))));
+	int ymin = std::max(y0,       (int)floor(std::min(a->y,std::min(b->y,c->y))));
+	int ymax = std::min(y1-1,     (int)ceil (std::max(a->y,std::max(b->y,c->y))));
+	if (xmin > xmax || ymin > ymax)
+		return;
+	xmin &= ~3;
+
+	// edge (p,q) is A*x + B*y + C, >= 0 on the inside
+	const vec4* p[3] = { a, b, c };
+	const vec4* q[3] = { b, c, a };
+	__m128 A[3], B[3], C[3];
+	for (int k = 0; k < 3; ++k) {
+		float ea = -(q[k]->y - p[k]->y);
+		float eb =   q[k]->x - p[k]->x;
+		A[k] = _mm_set1_ps(ea);
+		B[k] = _mm_set1_ps(eb);
+		C[k] = _mm_set1_ps(-(ea*p[k]->x + eb*p[k]->y));
+	}
+
+	// depth is linear in screen space
+	float dzdx = ((b->z - a->z)*(c->y - a->y) - (c->z - a->z)*(b->y - a->y)) / area;
+	float dzdy = ((b->x - a->x)*(c->z - a->z) - (c->x - a->x)*(b->z - a->z)) / area;
+	__m128 DZDX = _mm_set1_ps(dzdx);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lane = _mm_setr_ps(0.5f,1.5f,2.5f,3.5f);
+	float* depth = &ob->hiz[0][0];
+
+	for (int y = ymin; y <= ymax; ++y) {
+		__m128 py = _mm_set1_ps(y + 0.5f);
+		__m128 row[3];
+		for (int k = 0; k < 3; ++k)
+			row[k] = _mm_add_ps(_mm_mul_ps(B[k],py),C[k]);
+		__m128 zrow = _mm_set1_ps(a->z + dzdy*(y + 0.5f - a->y) - dzdx*a->x);
+
+		float* out = depth + y*ob->wd;
+		for (int x = xmin; x <= xmax; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x),lane);
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(A[0],px),row[0]);
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(A[1],px),row[1]);
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(A[2],px),row[2]);
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(e0,zero),_mm_and_ps(_mm_cmpge_ps(e1,zero),_mm_cmpge_ps(e2,zero)));
+			if (!_mm_movemask_ps(inside))
+				continue;
+
+			__m128 z = _mm_max_ps(_mm_add_ps(_mm_mul_ps(DZDX,px),zrow),zero);
+			__m128 old = _mm_loadu_ps(out + x);
+			__m128 nearer = _mm_min_ps(old,z);
+			_mm_storeu_ps(out + x,_mm_or_ps(_mm_and_ps(inside,nearer),_mm_andnot_ps(inside,old)));
+		}
+	}
+}
+
+static void raster_band(int band, void* arg)
+{
+	occlusion_buffer* ob = (occlusion_buffer*)arg;
+	int y0 = band*OCCLUSION_BAND_ROWS;
+	int y1 = std::min(y0 + OCCLUSION_BAND_ROWS,ob->ht);
+
+	std::fill(ob->hiz[0].begin() + y0*ob->wd,ob->hiz[0].begin() + y1*ob->wd,1.0f);
+
+	float fy0 = (float)y0, fy1 = (float)y1;
+	const std::vector<vec4>& s = ob->screen;
+	for (size_t i = 0; i+2 < s.size(); i += 3) {
+		// skip triangles that do not reach this band
+		if (std::max(s[i].y,std::max(s[i+1].y,s[i+2].y)) < fy0 ||
+		    std::min(s[i].y,std::min(s[i+1].y,s[i+2].y)) > fy1)
+			continue;
+		raster_triangle(ob,s[i],s[i+1],s[i+2],y0,y1);
+	}
+}
+
+// level k of the pyramid from level k-1: farthest depth of each 2x2 block
+static void build_level(occlusion_buffer* ob, int k)
+{
+	const float* src = &ob->hiz[k-1][0];
+	float* dst = &ob->hiz[k][0];
+	int sw = ob->hiz_wd[k-1], sh = ob->hiz_ht[k-1];
+	int dw = ob->hiz_wd[k],   dh = ob->hiz_ht[k];
+
+	if (sw % 8 == 0 && sh % 2 == 0) {
+		for (int y = 0; y < dh; ++y) {
+			const float* r0 = src + (2*y)*sw;
+			const float* r1 = r0 + sw;
+			for (int x = 0; x < dw; x += 4) {
+				__m128 lo = _mm_max_ps(_mm_loadu_ps(r0 + 2*x),    _mm_loadu_ps(r1 + 2*x));
+				__m128 hi = _mm_max_ps(_mm_loadu_ps(r0 + 2*x + 4),_mm_loadu_ps(r1 + 2*x + 4));
+				__m128 even = _mm_shuffle_ps(lo,hi,_MM_SHUFFLE(2,0,2,0));
+				__m128 odd  = _mm_shuffle_ps(lo,hi,_MM_SHUFFLE(3,1,3,1));
+				_mm_storeu_ps(dst + y*dw + x,_mm_max_ps(even,odd));
+			}
+		}
+		return;
+	}
+
+	for (int y = 0; y < dh; ++y) {
+		int y0 = 2*y, y1 = std::min(2*y+1,sh-1);
+		for (int x = 0; x < dw; ++x) {
+			int x0 = 2*x, x1 = std::min(2*x+1,sw-1);
+			dst[y*dw + x] = std::max(std::max(src[y0*sw + x0],src[y0*sw + x1]),
+			                         std::max(src[y1*sw + x0],src[y1*sw + x1]));
+		}
+	}
+}
+
+void occlusion_rasterize(occlusion_buffer* ob)
+{
+	jobs_parallel_for((ob->ht + OCCLUSION_BAND_ROWS-1) / OCCLUSION_BAND_ROWS,raster_band,ob);
+	for (size_t k = 1; k < ob->hiz.size(); ++k)
+		build_level(ob,(int)k);
+}
+
+////////////////////////////////////////////////////////
+
+bool occlusion_test_aabb(occlusion_buffer* ob, const mat4x4& MV, const vec4& bmin, const vec4& bmax)
+{
+	ob->tested++;
+
+	mat4x4 M = ob->P*MV;
+	float xmin = 1e30f, ymin = 1e30f, xmax = -1e30f, ymax = -1e30f, zmin = 1;
+	for (int k = 0; k < 8; ++k) {
+		vec4 corner((k & 1) ? bmax.x : bmin.x, (k & 2) ? bmax.y : bmin.y, (k & 4) ? bmax.z : bmin.z, 1);
+		vec4 c = M*corner;
+		if (c.z < -c.w)
+			return true;  // reaches in front of the near plane
+		vec4 s = to_screen(ob,c);
+		xmin = std::min(xmin,s.x); xmax = std::max(xmax,s.x);
+		ymin = std::min(ymin,s.y); ymax = std::max(ymax,s.y);
+		zmin = std::min(zmin,s.z);
+	}
+
+	int x0 = std::max(0,(int)floor(xmin)), x1 = std::min(ob->wd-1,(int)floor(xmax));
+	int y0 = std::max(0,(int)floor(ymin)), y1 = std::min(ob->ht-1,(int)floor(ymax));
+	if (x0 > x1 || y0 > y1)
+		return true;  // off screen; that is for frustum culling to decide
+
+	// coarsest level at which the rectangle still spans only a few texels
+	int level = 0;
+	while (level+1 < (int)ob->hiz.size() && ((x1 >> level) - (x0 >> level) >= 4 || (y1 >> level) - (y0 >> level) >= 4))
+		++level;
+
+	const std::vector<float>& hz = ob->hiz[level];
+	int lw = ob->hiz_wd[level];
+	for (int y = y0 >> level; y <= (y1 >> level); ++y)
+		for (int x = x0 >> level; x <= (x1 >> level); ++x)
+			if (hz[y*lw + x] >= zmin)
+				return true;  // some occluder there is further away than the object's nearest point
+
+	ob->culled++;
+	return false;
+}
+
+bool occlusion_test_sphere(occlusion_buffer* ob, const vec4& center, float radius)
+{
+	vec4 r(radius,radius,radius,0);
+	return occlusion_test_aabb(ob,mat4x4(),center - r,center + r);
+}
+
+////////////////////////////////////////////////////////
+
+// the 12 triangles of box [bmin,bmax]
+static void append_box(std::vector<vec4>& out, const vec4& bmin, const vec4& bmax)
+{
+	vec4 v[8];
+	for (int k = 0; k < 8; ++k)
+		v[k] = vec4((k & 1) ? bmax.x : bmin.x, (k & 2) ? bmax.y : bmin.y, (k & 4) ? bmax.z : bmin.z, 1);
+	static const int faces[6][4] = {
+		{ 0,2,3,1 }, { 4,5,7,6 },   // z min, z max
+		{ 0,1,5,4 }, { 2,6,7,3 },   // y min, y max
+		{ 0,4,6,2 }, { 1,3,7,5 }    // x min, x max
+	};
+	for (int f = 0; f < 6; ++f) {
+		out.push_back(v[faces[f][0]]); out.push_back(v[faces[f][1]]); out.push_back(v[faces[f][2]]);
+		out.push_back(v[faces[f][0]]); out.push_back(v[faces[f][2]]); out.push_back(v[faces[f][3]]);
+	}
+}
+
+std::vector<vec4> occlusion_trunk_proxy(const triangles& tri)
+{
+	std::vector<vec4> out;
+	if (tri.empty())
+		return out;
+
+	float ylo = tri[0].p.y, yhi = tri[0].p.y;
+	for (size_t i = 1; i < tri.size(); ++i) {
+		ylo = std::min(ylo,tri[i].p.y);
+		yhi = std::max(yhi,tri[i].p.y);
+	}
+
+	// the trunk: above the roots and below the branches
+	float y0 = ylo + 0.15f*(yhi - ylo);
+	float y1 = ylo + 0.45f*(yhi - ylo);
+	std::vector<float> xs, zs;
+	for (size_t i = 0; i < tri.size(); ++i) {
+		if (tri[i].p.y >= y0 && tri[i].p.y <= y1) {
+			xs.push_back(tri[i].p.x);
+			zs.push_back(tri[i].p.z);
+		}
+	}
+	if (xs.size() < 8)
+		return out;
+
+	// axis through the median vertex; the median is not pulled aside by the odd branch
+	std::vector<float> tmp = xs;
+	std::nth_element(tmp.begin(),tmp.begin() + tmp.size()/2,tmp.end());
+	float ax = tmp[tmp.size()/2];
+	tmp = zs;
+	std::nth_element(tmp.begin(),tmp.begin() + tmp.size()/2,tmp.end());
+	float az = tmp[tmp.size()/2];
+
+	// radius that nearly all of the band's vertices lie outside of, and a square that fits in that circle
+	std::vector<float> dist(xs.size());
+	for (size_t i = 0; i < xs.size(); ++i)
+		dist[i] = sqrt((xs[i]-ax)*(xs[i]-ax) + (zs[i]-az)*(zs[i]-az));
+	std::nth_element(dist.begin(),dist.begin() + dist.size()/10,dist.end());
+	float half = 0.7f*dist[dist.size()/10];
+	if (half <= 0)
+		return out;
+
+	append_box(out,vec4(ax-half,y0,az-half,1),vec4(ax+half,y1,az+half,1));
+	return out;
+}
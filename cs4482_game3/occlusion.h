@@ -0,0 +1,79 @@
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+// occlusion.h
+//    Software occlusion culling. Each frame a few simplified occluders
+//    (coarse terrain, tree trunk boxes) are rasterized on the CPU into a
+//    small depth buffer, using SSE and the worker threads from jobs.h.
+//    A hierarchical-Z pyramid of that buffer then lets objects be tested
+//    by their screen rectangle with a handful of reads, so that whatever
+//    is hidden behind hills and nearer trees is never sent to OpenGL.
+//
+//    Occluders must lie inside the objects they stand for, so a test
+//    can only report something hidden when it really is.
+
+#include "vec4.h"
+#include "mat4x4.h"
+#include "trimesh.h"
+#include <vector>
+
+#define OCCLUSION_WD  256   // depth buffer size; multiples of 8
+#define OCCLUSION_HT  128
+
+struct occlusion_buffer {
+	int    wd, ht;
+	mat4x4 P;                                // projection of the current frame
+
+	std::vector<std::vector<float> > hiz;    // level 0 is the depth buffer; each texel of level k holds
+	std::vector<int> hiz_wd, hiz_ht;         // the farthest depth of the 2x2 texels below it in level k-1
+
+	std::vector<vec4> screen;                // queued occluder triangles: (pixel x, pixel y, depth) per corner
+
+	// statistics for the current frame
+	int occluder_triangles;
+	int tested;
+	int culled;
+};
+
+// occlusion_create
+//    Allocates a wd x ht depth buffer and its pyramid.
+//
+occlusion_buffer* occlusion_create(int wd = OCCLUSION_WD, int ht = OCCLUSION_HT);
+
+// occlusion_begin
+//    Starts a new frame seen through projection P; drops all occluders.
+//
+void occlusion_begin(occlusion_buffer* ob, const mat4x4& P);
+
+// occlusion_add_triangles
+//    Queues a triangle list of 'count' points (3 per triangle) as an
+//    occluder; MV takes the points to eye coordinates. Triangles are
+//    clipped to the near plane; both sides are solid.
+//
+void occlusion_add_triangles(occlusion_buffer* ob, const mat4x4& MV, const vec4* points, int count);
+
+// occlusion_rasterize
+//    Rasterizes every queued occluder in parallel and builds the pyramid.
+//    Call after the last occlusion_add_triangles and before any test.
+//
+void occlusion_rasterize(occlusion_buffer* ob);
+
+// occlusion_test_aabb
+//    Returns false if the box [bmin,bmax] (transformed by MV to eye
+//    coordinates) is certainly hidden, true if it may be visible.
+//
+bool occlusion_test_aabb(occlusion_buffer* ob, const mat4x4& MV, const vec4& bmin, const vec4& bmax);
+
+// occlusion_test_sphere
+//    Same as occlusion_test_aabb for a sphere given in eye coordinates.
+//
+bool occlusion_test_sphere(occlusion_buffer* ob, const vec4& center, float radius);
+
+// occlusion_trunk_proxy
+//    Builds a conservative occluder for a tree mesh: a thin box inside
+//    its trunk, found from the vertices around the lower part of the
+//    mesh's height. Returns a triangle list in model coordinates.
+//
+std::vector<vec4> occlusion_trunk_proxy(const triangles& tri);
+
+#endif // __OCCLUSION_H__
@@ -0,0 +1,110 @@
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "pacing.h"
+#include "gl3w.h"
+#include <algorithm>
+
+#define PACING_SMOOTHING  0.1   // weight of the newest frame in the averages
+
+double pacer_now()
+{
+	static LARGE_INTEGER frequency, start;
+	if (!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&start);
+	}
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double)(now.QuadPart - start.QuadPart)/frequency.QuadPart;
+}
+
+static void smooth(double& average, double sample)
+{
+	average += PACING_SMOOTHING*(sample - average);
+}
+
+frame_pacer* pacer_create(int frames_in_flight, bool low_latency)
+{
+	frame_pacer* fp = new frame_pacer;
+	fp->frames_in_flight = std::min(std::max(frames_in_flight,1),PACING_MAX_FRAMES);
+	fp->low_latency = low_latency;
+	for (int i = 0; i < PACING_MAX_FRAMES; ++i) {
+		fp->fences[i] = 0;
+		fp->submitted[i] = 0;
+	}
+	fp->next = 0;
+	fp->begun = false;
+	fp->frame_start = pacer_now();
+	fp->cpu_wait_ms = fp->cpu_busy_ms = fp->gpu_busy_ms = 0;
+	return fp;
+}
+
+// wait for fence i, returning once it has signalled (or at 'deadline', unless it is negative)
+static bool wait_fence(frame_pacer* fp, int i, double deadline)
+{
+	GLsync fence = (GLsync)fp->fences[i];
+	for (;;) {
+		GLenum r = glClientWaitSync(fence,GL_SYNC_FLUSH_COMMANDS_BIT,0);
+		if (r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED || r == GL_WAIT_FAILED) {
+			glDeleteSync(fence);
+			fp->fences[i] = 0;
+			return true;
+		}
+		double now = pacer_now();
+		if (deadline >= 0 && now >= deadline)
+			return false;  // left for pacer_end_frame to clean up when the slot comes around
+
+		// sleep in small steps; the scheduler may oversleep by a millisecond or so
+		double left = deadline >= 0 ? deadline - now : 0.001;
+		glClientWaitSync(fence,0,(GLuint64)(std::min(left,0.001)*1e9));
+	}
+}
+
+void pacer_begin_frame(frame_pacer* fp)
+{
+	if (fp->begun)
+		return;
+	fp->begun = true;
+
+	double start = pacer_now();
+	if (gl3wIsSupported(3,2)) {
+		// the slot we are about to reuse holds the frame 'frames_in_flight' back
+		int slot = (fp->next + PACING_MAX_FRAMES - fp->frames_in_flight) % PACING_MAX_FRAMES;
+		if (fp->fences[slot])
+			wait_fence(fp,slot,-1);
+
+		// then maybe the previous frame too, but starting early by the time our own work takes
+		int prev = (fp->next + PACING_MAX_FRAMES-1) % PACING_MAX_FRAMES;
+		if (fp->low_latency && fp->gpu_busy_ms > 0 && fp->fences[prev]) {
+			double deadline = fp->submitted[prev] + (fp->gpu_busy_ms - fp->cpu_busy_ms)/1000;
+			wait_fence(fp,prev,std::max(deadline,start));  // past the deadline this just checks the fence once
+		}
+	}
+	fp->frame_start = pacer_now();
+	smooth(fp->cpu_wait_ms,1000*(fp->frame_start - start));
+}
+
+void pacer_end_frame(frame_pacer* fp, double gpu_ms)
+{
+	fp->gpu_busy_ms = gpu_ms;
+	if (!fp->begun)
+		fp->frame_start = pacer_now();  // drawn without pacer_begin_frame, e.g. on a window expose
+	fp->begun = false;
+
+	if (!gl3wIsSupported(3,2)) {
+		glFinish();
+		smooth(fp->cpu_busy_ms,1000*(pacer_now() - fp->frame_start));
+		return;
+	}
+
+	double now = pacer_now();
+	smooth(fp->cpu_busy_ms,1000*(now - fp->frame_start));
+
+	// a fence still in this slot belongs to a frame nobody waited for; let it go
+	int i = fp->next;
+	if (fp->fences[i])
+		glDeleteSync((GLsync)fp->fences[i]);
+	fp->fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	fp->submitted[i] = now;
+	fp->next = (i + 1) % PACING_MAX_FRAMES;
+}
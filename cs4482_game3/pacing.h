@@ -0,0 +1,61 @@
+#ifndef __PACING_H__
+#define __PACING_H__
+
+// pacing.h
+//    Frame pacing. A fence is placed after each frame's swap, and before
+//    starting a new frame the CPU waits only until the GPU has finished
+//    the frame 'frames_in_flight' frames back. CPU and GPU work overlap,
+//    but the driver's queue cannot grow without bound and add input lag.
+//
+//    In low-latency mode the CPU also waits for the previous frame, but
+//    only for as long as needed to finish its own work just as the GPU
+//    runs out of work: the GPU's time for a frame, less the CPU's. The
+//    GPU time comes from the caller, measured with timestamp queries
+//    (see profiler.h); the pacer's fences only say when a frame is done,
+//    which includes the time it spent queued behind earlier ones.
+//
+//    Without OpenGL 3.2 fences it falls back to glFinish after the swap.
+
+#define PACING_MAX_FRAMES  3
+
+struct frame_pacer {
+	int    frames_in_flight;     // 1 to PACING_MAX_FRAMES
+	bool   low_latency;
+
+	void*  fences[PACING_MAX_FRAMES];   // one per frame in flight, oldest at 'next'
+	double submitted[PACING_MAX_FRAMES]; // when each fence was placed (seconds)
+	int    next;
+	bool   begun;                // pacer_begin_frame ran for the current frame
+
+	double frame_start;          // when the current frame's CPU work began
+
+	// measurements, in milliseconds, smoothed over recent frames
+	double cpu_wait_ms;          // time blocked waiting for the GPU
+	double cpu_busy_ms;          // CPU time from the end of the wait to the swap
+	double gpu_busy_ms;          // GPU time of a recent frame, as given to pacer_end_frame
+};
+
+// pacer_create
+//    frames_in_flight is clamped to [1,PACING_MAX_FRAMES].
+//
+frame_pacer* pacer_create(int frames_in_flight = 2, bool low_latency = false);
+
+// pacer_begin_frame
+//    Waits until a new frame may start. Call before reading input for the
+//    frame; calling it again before pacer_end_frame does nothing.
+//
+void pacer_begin_frame(frame_pacer* fp);
+
+// pacer_end_frame
+//    Call right after swapping buffers, with the GPU time of a recent
+//    frame, e.g. the profiler's frame_busy_ms; 0 if it is not known, in
+//    which case low-latency mode waits no more than the normal one.
+//
+void pacer_end_frame(frame_pacer* fp, double gpu_ms);
+
+// pacer_now
+//    Seconds since an arbitrary start, from a high resolution clock.
+//
+double pacer_now();
+
+#endif // __PACING_H__
@@ -0,0 +1,161 @@
+#include "postfx.h"
+#include "cs3388lib.h"
+#include "gl3w.h"
+#include <algorithm>
+
+static void target_delete(render_target& rt)
+{
+	if (rt.fbo)    glDeleteFramebuffers(1,&rt.fbo);
+	if (rt.colour) glDeleteTextures(1,&rt.colour);
+	if (rt.depth)  glDeleteTextures(1,&rt.depth);
+	rt.fbo = rt.colour = rt.depth = 0;
+	rt.wd = rt.ht = 0;
+}
+
+static unsigned target_texture(GLenum internal_format, GLenum format, GLenum type, int wd, int ht)
+{
+	GLuint tex;
+	glGenTextures(1,&tex);
+	glBindTexture(GL_TEXTURE_2D,tex);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);  // no mipmaps
+	glTexImage2D(GL_TEXTURE_2D,0,internal_format,wd,ht,0,format,type,0);
+	return tex;
+}
+
+static void target_create(render_target& rt, int wd, int ht, bool depth)
+{
+	target_delete(rt);
+	rt.wd = wd;
+	rt.ht = ht;
+	rt.colour = target_texture(GL_RGBA8,GL_RGBA,GL_UNSIGNED_BYTE,wd,ht);
+	if (depth) {
+		rt.depth = target_texture(GL_DEPTH_COMPONENT24,GL_DEPTH_COMPONENT,GL_UNSIGNED_INT,wd,ht);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);  // depths are not blended
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+	}
+	glBindTexture(GL_TEXTURE_2D,0);
+
+	glGenFramebuffers(1,&rt.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER,rt.fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,rt.colour,0);
+	if (depth)
+		glFramebufferTexture2D(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_TEXTURE_2D,rt.depth,0);
+	assert_msg(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "post-processing framebuffer incomplete");
+	glBindFramebuffer(GL_FRAMEBUFFER,0);
+}
+
+postfx* postfx_create(float scale)
+{
+	if (!gl3wIsSupported(3,0))
+		return 0;
+
+	postfx* fx = new postfx;
+	fx->scene.fbo = fx->scene.colour = fx->scene.depth = 0;
+	fx->scene.wd = fx->scene.ht = 0;
+	fx->post = fx->scene;
+	fx->scale = std::min(std::max(scale,0.1f),1.0f);
+	fx->render_scale = 1;
+	fx->sharpen = 0;
+	fx->render_wd = fx->render_ht = 0;
+
+	// one strip covering the screen
+	float corners[8] = { -1,-1, 1,-1, -1,1, 1,1 };
+	glGenBuffers(1,&fx->quad_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER,fx->quad_vbo);
+	glBufferData(GL_ARRAY_BUFFER,sizeof(corners),corners,GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	return fx;
+}
+
+const char* postfx_vertex_shader()
+{
+	return
+		"#version 120\n"
+		"attribute vec2 p;\n"
+		"varying vec2 screen_uv;\n"
+		"void main()\n"
+		"{\n"
+		"	screen_uv = 0.5*p + 0.5;\n"
+		"	gl_Position = vec4(p,0,1);\n"
+		"}\n";
+}
+
+void postfx_begin(postfx* fx, int wd, int ht)
+{
+	if (fx->scene.wd != wd || fx->scene.ht != ht)
+		target_create(fx->scene,wd,ht,true);
+
+	int pw = std::max(1,(int)(wd*fx->scale)), ph = std::max(1,(int)(ht*fx->scale));
+	if (fx->scale < 1 && (fx->post.wd != pw || fx->post.ht != ph))
+		target_create(fx->post,pw,ph,false);
+	else if (fx->scale >= 1 && fx->post.fbo)
+		target_delete(fx->post);
+
+	float rs = std::min(std::max(fx->render_scale,0.1f),1.0f);
+	fx->render_wd = std::max(1,(int)(wd*rs + 0.5f));
+	fx->render_ht = std::max(1,(int)(ht*rs + 0.5f));
+
+	glBindFramebuffer(GL_FRAMEBUFFER,fx->scene.fbo);
+	glViewport(0,0,fx->render_wd,fx->render_ht);
+	glScissor(0,0,fx->render_wd,fx->render_ht);
+}
+
+void postfx_end(postfx* fx, unsigned program)
+{
+	bool reduced = fx->post.fbo != 0;
+	int wd = reduced ? fx->post.wd : fx->scene.wd;
+	int ht = reduced ? fx->post.ht : fx->scene.ht;
+
+	GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER,reduced ? fx->post.fbo : 0);
+	glViewport(0,0,wd,ht);
+	glScissor(0,0,fx->scene.wd,fx->scene.ht);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D,fx->scene.depth);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D,fx->scene.colour);
+	glUniform1i(glGetUniformLocation(program,"scene"),0);
+	glUniform1i(glGetUniformLocation(program,"depth"),1);
+	glUniform2f(glGetUniformLocation(program,"scene_scale"),(float)fx->render_wd/fx->scene.wd,(float)fx->render_ht/fx->scene.ht);
+	glUniform2f(glGetUniformLocation(program,"scene_texel"),1.0f/fx->scene.wd,1.0f/fx->scene.ht);
+	glUniform1f(glGetUniformLocation(program,"sharpen"),fx->render_wd < fx->scene.wd ? fx->sharpen : 0.0f);
+
+	GLuint ploc = glGetAttribLocation(program,"p");
+	glBindBuffer(GL_ARRAY_BUFFER,fx->quad_vbo);
+	glVertexAttribPointer(ploc,2,GL_FLOAT,GL_FALSE,0,0);
+	glEnableVertexAttribArray(ploc);
+	glDrawArrays(GL_TRIANGLE_STRIP,0,4);
+	glDisableVertexAttribArray(ploc);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D,0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D,0);
+
+	if (reduced) {
+		// stretch the reduced image over the window
+		glBindFramebuffer(GL_READ_FRAMEBUFFER,fx->post.fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER,0);
+		glBlitFramebuffer(0,0,fx->post.wd,fx->post.ht,0,0,fx->scene.wd,fx->scene.ht,GL_COLOR_BUFFER_BIT,GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER,0);
+	}
+
+	glViewport(0,0,fx->scene.wd,fx->scene.ht);
+	if (depth_test)
+		glEnable(GL_DEPTH_TEST);
+}
+
+void postfx_delete(postfx* fx)
+{
+	target_delete(fx->scene);
+	target_delete(fx->post);
+	glDeleteBuffers(1,&fx->quad_vbo);
+	delete fx;
+}
@@ -0,0 +1,72 @@
+#ifndef __POSTFX_H__
+#define __POSTFX_H__
+
+// postfx.h
+//    Full-screen post-processing. The scene is drawn into an offscreen
+//    colour+depth target with cheap material shaders; a single pass over
+//    the screen then reads both textures and applies the screen effects
+//    once per pixel, however many surfaces were drawn on top of each other.
+//    The pass can run at a fraction of the window resolution, in which
+//    case its result is scaled up to the window.
+//
+//    The scene itself may also be drawn at a fraction of the window size
+//    (render_scale), into the corner of the window-sized target so that
+//    changing the scale every few frames never reallocates anything; the
+//    post pass then stretches that corner over the screen, sharpening it.
+
+//
+// render_target -- a framebuffer object with texture attachments
+//
+struct render_target {
+	unsigned fbo;
+	unsigned colour;   // RGBA8 texture
+	unsigned depth;    // 24-bit depth texture, or 0 if none
+	int      wd, ht;
+};
+
+struct postfx {
+	render_target scene;   // window-sized colour+depth
+	render_target post;    // output of the post pass when scale < 1
+	float    scale;        // resolution of the post pass relative to the window, in (0,1]
+	float    render_scale; // resolution of the scene relative to the window, in (0,1]
+	float    sharpen;      // strength of the sharpening applied when render_scale < 1
+	int      render_wd;    // size of the scene drawn this frame
+	int      render_ht;
+	unsigned quad_vbo;
+};
+
+// postfx_create
+//    Needs OpenGL 3.0 framebuffer objects; returns 0 without them, in
+//    which case the caller should apply its effects while drawing.
+//    Targets are allocated by the first postfx_begin.
+//
+postfx* postfx_create(float scale = 1.0f);
+
+// postfx_vertex_shader
+//    GLSL 1.20 vertex shader for the post pass. It reads attribute p
+//    (a corner of the screen, -1..1) and writes varying screen_uv (0..1).
+//
+const char* postfx_vertex_shader();
+
+// postfx_begin
+//    Redirects drawing into the scene target, (re)allocating the targets
+//    for a wd x ht window if needed, and sets the viewport and scissor
+//    to render_scale of the window. The scene target is not cleared.
+//
+void postfx_begin(postfx* fx, int wd, int ht);
+
+// postfx_end
+//    Draws the post pass into the window with 'program', which must be
+//    bound with its own uniforms set; its sampler2D uniforms 'scene' and
+//    'depth' are given the scene's colour and depth. The scene covers
+//    texture coordinates [0,scene_scale] (a vec2 uniform), scene_texel is
+//    the size of one texel and 'sharpen' the sharpening strength.
+//
+void postfx_end(postfx* fx, unsigned program);
+
+// postfx_delete
+//    Releases the targets and buffers.
+//
+void postfx_delete(postfx* fx);
+
+#endif // __POSTFX_H__
@@ -0,0 +1,214 @@
+#include "profiler.h"
+#include "pacing.h"
+#include "cs3388lib.h"
+#include "gl3w.h"
+#include <cstring>
+
+#define PROFILER_SMOOTHING  0.1   // weight of the newest frame in the averages
+
+gpu_profiler* profiler_create(const char* timeline_path)
+{
+	gpu_profiler* p = new gpu_profiler;
+	p->current = 0;
+	p->number = 0;
+	p->supported = gl3wIsSupported(3,3);
+	p->timestamps = false;
+	p->recording = false;
+	p->open = -1;
+	p->gpu_offset_ms = 0;
+	p->timeline = 0;
+	p->frame_gpu_ms = 0;
+	p->frame_busy_ms = 0;
+	p->dropped = 0;
+
+	for (int i = 0; i < PROFILER_FRAMES; ++i) {
+		profiler_frame& f = p->frames[i];
+		f.pass_count = 0;
+		f.number = -1;
+		f.cpu_start_ms = f.cpu_end_ms = 0;
+		f.pending = false;
+		for (int j = 0; j < PROFILER_MAX_PASSES; ++j) {
+			f.passes[j].name = 0;
+			f.passes[j].cpu_ms = 0;
+			f.passes[j].begin_query = f.passes[j].end_query = 0;
+			if (p->supported) {
+				glGenQueries(1,&f.passes[j].begin_query);
+				glGenQueries(1,&f.passes[j].end_query);
+			}
+		}
+	}
+	if (!p->supported)
+		return p;
+
+	// some drivers time intervals but have no clock to read
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP,GL_QUERY_COUNTER_BITS,&bits);
+	p->timestamps = bits > 0;
+	if (p->timestamps) {
+		GLint64 now;
+		glGetInteger64v(GL_TIMESTAMP,&now);
+		p->gpu_offset_ms = 1000*pacer_now() - now/1e6;
+	}
+
+	if (timeline_path) {
+		if (fopen_s(&p->timeline,timeline_path,"w") != 0)
+			p->timeline = 0;
+		assert_msg(p->timeline, "could not create the GPU timeline file");
+		fprintf(p->timeline,"frame,pass,cpu_frame_start_ms,cpu_frame_end_ms,cpu_pass_ms,gpu_start_ms,gpu_ms\n");
+	}
+	return p;
+}
+
+static profiler_stat& stat_of(gpu_profiler* p, const char* name)
+{
+	for (size_t i = 0; i < p->stats.size(); ++i)
+		if (!strcmp(p->stats[i].name,name))
+			return p->stats[i];
+	profiler_stat s;
+	s.name = name;
+	s.gpu_ms = 0;
+	p->stats.push_back(s);
+	return p->stats.back();
+}
+
+static bool available(unsigned query)
+{
+	GLint ready = 0;
+	glGetQueryObjectiv(query,GL_QUERY_RESULT_AVAILABLE,&ready);
+	return ready != 0;
+}
+
+static double result_ms(unsigned query)
+{
+	GLuint64 ns;
+	glGetQueryObjectui64v(query,GL_QUERY_RESULT,&ns);
+	return ns/1e6;
+}
+
+// reads frame f if all its queries are in; returns false if it has to wait
+static bool read_frame(gpu_profiler* p, profiler_frame& f)
+{
+	for (int i = 0; i < f.pass_count; ++i) {
+		const profiler_pass& pass = f.passes[i];
+		if (!available(pass.begin_query) || (p->timestamps && !available(pass.end_query)))
+			return false;
+	}
+	f.pending = false;
+
+	double first = 0, last = 0, sum = 0;
+	for (int i = 0; i < f.pass_count; ++i) {
+		const profiler_pass& pass = f.passes[i];
+		double start = -1, ms;
+		if (p->timestamps) {
+			start = result_ms(pass.begin_query);
+			double end = result_ms(pass.end_query);
+			ms = end - start;
+			if (i == 0 || start < first) first = start;
+			if (i == 0 || end > last)    last = end;
+			start += p->gpu_offset_ms;
+		} else {
+			ms = result_ms(pass.begin_query);
+		}
+		sum += ms;
+		profiler_stat& s = stat_of(p,pass.name);
+		s.gpu_ms += PROFILER_SMOOTHING*(ms - s.gpu_ms);
+
+		if (p->timeline)
+			fprintf(p->timeline,"%ld,%s,%.3f,%.3f,%.3f,%.3f,%.3f\n",f.number,pass.name,
+			        f.cpu_start_ms,f.cpu_end_ms,pass.cpu_ms,start,ms);  // gpu_start_ms is -1 without timestamps
+	}
+	double total = p->timestamps ? last - first : sum;
+	p->frame_gpu_ms += PROFILER_SMOOTHING*(total - p->frame_gpu_ms);
+	p->frame_busy_ms += PROFILER_SMOOTHING*(sum - p->frame_busy_ms);
+	return true;
+}
+
+void profiler_begin_frame(gpu_profiler* p)
+{
+	if (!p->supported)
+		return;
+
+	// oldest first, stopping at the first frame that is not done
+	for (int k = 1; k <= PROFILER_FRAMES; ++k) {
+		profiler_frame& f = p->frames[(p->current + k) % PROFILER_FRAMES];
+		if (f.pending && !read_frame(p,f))
+			break;
+	}
+
+	p->current = (p->current + 1) % PROFILER_FRAMES;
+	profiler_frame& f = p->frames[p->current];
+	if (f.pending) {
+		f.pending = false;  // its queries are about to be reissued
+		p->dropped++;
+	}
+	f.pass_count = 0;
+	f.number = p->number++;
+	f.cpu_start_ms = 1000*pacer_now();
+	f.cpu_end_ms = f.cpu_start_ms;
+	p->recording = true;
+	p->open = -1;
+}
+
+void profiler_begin_pass(gpu_profiler* p, const char* name)
+{
+	if (!p->recording)
+		return;
+	assert_msg(p->open < 0, "profiler passes must be ended before the next one begins");
+	profiler_frame& f = p->frames[p->current];
+	if (f.pass_count >= PROFILER_MAX_PASSES)
+		return;
+
+	profiler_pass& pass = f.passes[f.pass_count];
+	pass.name = name;
+	pass.cpu_ms = 1000*pacer_now();
+	if (p->timestamps)
+		glQueryCounter(pass.begin_query,GL_TIMESTAMP);
+	else
+		glBeginQuery(GL_TIME_ELAPSED,pass.begin_query);
+	p->open = f.pass_count;
+}
+
+void profiler_end_pass(gpu_profiler* p)
+{
+	if (!p->recording || p->open < 0)
+		return;
+	profiler_frame& f = p->frames[p->current];
+	if (p->timestamps)
+		glQueryCounter(f.passes[p->open].end_query,GL_TIMESTAMP);
+	else
+		glEndQuery(GL_TIME_ELAPSED);
+	f.pass_count = p->open + 1;
+	p->open = -1;
+}
+
+void profiler_end_frame(gpu_profiler* p)
+{
+	if (!p->recording)
+		return;
+	profiler_end_pass(p);
+	profiler_frame& f = p->frames[p->current];
+	f.cpu_end_ms = 1000*pacer_now();
+	f.pending = f.pass_count > 0;
+	p->recording = false;
+}
+
+double profiler_pass_ms(const gpu_profiler* p, const char* name)
+{
+	for (size_t i = 0; i < p->stats.size(); ++i)
+		if (!strcmp(p->stats[i].name,name))
+			return p->stats[i].gpu_ms;
+	return 0;
+}
+
+void profiler_delete(gpu_profiler* p)
+{
+	for (int i = 0; i < PROFILER_FRAMES; ++i)
+		for (int j = 0; j < PROFILER_MAX_PASSES; ++j)
+			if (p->supported) {
+				glDeleteQueries(1,&p->frames[i].passes[j].begin_query);
+				glDeleteQueries(1,&p->frames[i].passes[j].end_query);
+			}
+	if (p->timeline)
+		fclose(p->timeline);
+	delete p;
+}
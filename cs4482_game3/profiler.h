@@ -0,0 +1,103 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+// profiler.h
+//    GPU profiling by named pass. Each pass is bracketed by two timestamp
+//    queries (glQueryCounter with GL_TIMESTAMP, OpenGL 3.3), which can be
+//    interleaved freely with other timers such as dynres's. Passes follow
+//    one another and do not nest: a pass must be ended before the next
+//    one begins. Where the driver reports no timestamp bits a
+//    GL_TIME_ELAPSED query per pass is used instead, and then no other
+//    GL_TIME_ELAPSED query may be running during a pass either.
+//
+//    Nothing ever waits on a query: a frame's results are read once they
+//    are all available, normally a frame or two later. A frame whose
+//    queries are still out when its slot comes around again is dropped.
+//
+//    Results are kept as smoothed per-pass times, and can also be written
+//    to a CSV timeline, one line per pass per frame, with the GPU times
+//    converted to the CPU clock (pacer_now, in milliseconds) so that they
+//    line up with the CPU timestamps of the same frame.
+//
+//    Works with Mesa's llvmpipe and softpipe, which implement timer queries.
+
+#include <cstdio>
+#include <vector>
+
+#define PROFILER_FRAMES      4    // frames whose queries may be outstanding at once
+#define PROFILER_MAX_PASSES  16   // per frame; further passes are not measured
+
+struct profiler_pass {
+	const char* name;      // not copied; use string literals
+	double   cpu_ms;       // when the pass was begun on the CPU
+	unsigned begin_query;  // in GL_TIME_ELAPSED mode the only query of the pass
+	unsigned end_query;
+};
+
+struct profiler_frame {
+	profiler_pass passes[PROFILER_MAX_PASSES];
+	int    pass_count;
+	long   number;
+	double cpu_start_ms;
+	double cpu_end_ms;
+	bool   pending;        // queries issued but not yet read
+};
+
+//
+// profiler_stat -- smoothed GPU time of one pass name
+//
+struct profiler_stat {
+	const char* name;
+	double gpu_ms;
+};
+
+struct gpu_profiler {
+	profiler_frame frames[PROFILER_FRAMES];
+	int    current;              // slot of the frame being recorded
+	long   number;               // frames begun so far
+	bool   supported;            // timer queries are available
+	bool   timestamps;           // GL_TIMESTAMP, else GL_TIME_ELAPSED
+	bool   recording;            // between begin and end frame
+	int    open;                 // pass begun and not yet ended, or -1
+	double gpu_offset_ms;        // add to a GPU timestamp to get pacer_now() time
+	FILE*  timeline;             // or 0
+
+	std::vector<profiler_stat> stats;  // by pass, in order of first appearance
+	double frame_gpu_ms;         // smoothed, first pass start to last pass end
+	double frame_busy_ms;        // smoothed sum of the pass times, leaving out any gaps between passes
+	int    dropped;              // frames whose results were never read
+};
+
+// profiler_create
+//    Needs a GL context. If 'timeline_path' is given the timeline is
+//    written there as CSV. Without timer queries every call is a no-op.
+//
+gpu_profiler* profiler_create(const char* timeline_path = 0);
+
+// profiler_begin_frame
+//    Call before the frame's first pass; reads any finished frames.
+//
+void profiler_begin_frame(gpu_profiler* p);
+
+// profiler_begin_pass, profiler_end_pass
+//    Bracket the GL commands of a pass.
+//
+void profiler_begin_pass(gpu_profiler* p, const char* name);
+void profiler_end_pass(gpu_profiler* p);
+
+// profiler_end_frame
+//    Call after the frame's last pass.
+//
+void profiler_end_frame(gpu_profiler* p);
+
+// profiler_pass_ms
+//    Smoothed GPU time of the named pass, 0 if it has not been measured.
+//
+double profiler_pass_ms(const gpu_profiler* p, const char* name);
+
+// profiler_delete
+//    Releases the queries and closes the timeline.
+//
+void profiler_delete(gpu_profiler* p);
+
+#endif // __PROFILER_H__
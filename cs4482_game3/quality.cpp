@@ -0,0 +1,93 @@
+#include "quality.h"
+#include "pacing.h"
+#include <algorithm>
+
+#define QUALITY_MAX_PATIENCE  64   // windows, however often raises are undone
+
+quality_governor* quality_create(const quality_tier* tiers, int tier_count, int start,
+                                 double cpu_budget_ms, double gpu_budget_ms, int window,
+                                 int patience_down, int patience_up, int cooldown, double headroom, double gpu_band)
+{
+	quality_governor* q = new quality_governor;
+	q->tiers = tiers;
+	q->tier_count = tier_count;
+	q->tier = std::min(std::max(start,0),tier_count-1);
+	q->cpu_budget_ms = cpu_budget_ms;
+	q->gpu_budget_ms = gpu_budget_ms;
+	q->headroom = headroom;
+	q->gpu_band = gpu_band;
+	q->window = std::max(window,1);
+	q->patience_down = std::max(patience_down,1);
+	q->patience_up = std::max(patience_up,1);
+	q->cooldown = std::max(cooldown,0);
+	q->frame_start = pacer_now();
+	q->cpu_sum = q->gpu_sum = 0;
+	q->frames = 0;
+	q->over = q->under = 0;
+	q->resting = 0;
+	q->since_raise = QUALITY_MAX_PATIENCE;
+	q->cpu_ms = q->gpu_ms = 0;
+	q->changes = 0;
+	return q;
+}
+
+void quality_begin_frame(quality_governor* q)
+{
+	q->frame_start = pacer_now();
+}
+
+static void change_tier(quality_governor* q, int tier)
+{
+	q->tier = tier;
+	q->over = q->under = 0;
+	q->resting = q->cooldown;
+	q->changes++;
+}
+
+// one window's averages are in; returns true if the tier changed
+static bool evaluate(quality_governor* q)
+{
+	q->since_raise++;
+	if (q->resting > 0) {
+		q->resting--;
+		return false;
+	}
+
+	bool over = q->cpu_ms > q->cpu_budget_ms || q->gpu_ms > q->gpu_budget_ms*(1 + q->gpu_band);
+	bool spare = q->cpu_ms < q->cpu_budget_ms*(1 - q->headroom) && q->gpu_ms < q->gpu_budget_ms*(1 - q->headroom - q->gpu_band);
+	q->over = over ? q->over + 1 : 0;
+	q->under = spare ? q->under + 1 : 0;
+
+	if (q->over >= q->patience_down && q->tier > 0) {
+		// the last raise did not hold up; be slower to try it again
+		if (q->since_raise <= q->cooldown + q->patience_down)
+			q->patience_up = std::min(2*q->patience_up,QUALITY_MAX_PATIENCE);
+		change_tier(q,q->tier - 1);
+		return true;
+	}
+	if (q->under >= q->patience_up && q->tier < q->tier_count-1) {
+		change_tier(q,q->tier + 1);
+		q->since_raise = 0;
+		return true;
+	}
+	return false;
+}
+
+bool quality_end_frame(quality_governor* q, double gpu_ms)
+{
+	q->cpu_sum += 1000*(pacer_now() - q->frame_start);
+	q->gpu_sum += gpu_ms;
+	if (++q->frames < q->window)
+		return false;
+
+	q->cpu_ms = q->cpu_sum/q->frames;
+	q->gpu_ms = q->gpu_sum/q->frames;
+	q->cpu_sum = q->gpu_sum = 0;
+	q->frames = 0;
+	return evaluate(q);
+}
+
+const quality_tier& quality_current(const quality_governor* q)
+{
+	return q->tiers[q->tier];
+}
@@ -0,0 +1,83 @@
+#ifndef __QUALITY_H__
+#define __QUALITY_H__
+
+// quality.h
+//    Quality governor. Settings that cost geometry (view distance, level
+//    of detail thresholds, how many trees are drawn) come in tiers, from
+//    cheapest to best. The governor times the CPU side of each frame
+//    itself, is handed the GPU time, and every 'window' frames compares
+//    the averages with the budgets.
+//
+//    Changes are damped: a tier is only dropped after 'patience_down'
+//    windows in a row over budget, and only raised after 'patience_up'
+//    windows in a row with some headroom left. After any change it waits
+//    'cooldown' windows for the measurements to settle, and if a raise is
+//    undone soon after, it waits twice as long before trying again.
+//
+//    The GPU side gets a wider band of its own: it only counts as over
+//    budget past budget*(1 + gpu_band), and as having room below
+//    budget*(1 - headroom - gpu_band). Dynamic resolution (dynres.h)
+//    keeps GPU time just under the budget while it has scale to trade,
+//    so the governor only steps in once the scale is pinned at either
+//    end, rather than both reacting to the same frames at once.
+
+struct quality_tier {
+	const char* name;
+	float view_distance;   // trees beyond this are not drawn
+	float lod_scale;       // level of detail switch distances are multiplied by this
+	float tree_density;    // fraction of far trees drawn, in [0,1]
+};
+
+struct quality_governor {
+	const quality_tier* tiers;   // cheapest first
+	int    tier_count;
+	int    tier;                 // current choice
+
+	double cpu_budget_ms;
+	double gpu_budget_ms;
+	double headroom;             // fraction of both budgets left over before raising
+	double gpu_band;             // further fraction of the GPU budget on either side before it counts
+	int    window;               // frames per evaluation
+	int    patience_down;
+	int    patience_up;          // grows each time a raise is undone
+	int    cooldown;
+
+	double frame_start;
+	double cpu_sum, gpu_sum;
+	int    frames;               // in the current window
+	int    over, under;          // consecutive windows over budget / with headroom
+	int    resting;              // windows left before another change is allowed
+	int    since_raise;          // windows since the last raise
+
+	// telemetry
+	double cpu_ms, gpu_ms;       // averages over the last window
+	int    changes;              // tier changes so far
+};
+
+// quality_create
+//    'tiers' is not copied and must outlive the governor. Starts at tier
+//    'start'.
+//
+quality_governor* quality_create(const quality_tier* tiers, int tier_count, int start,
+                                 double cpu_budget_ms, double gpu_budget_ms, int window = 30,
+                                 int patience_down = 2, int patience_up = 4, int cooldown = 2,
+                                 double headroom = 0.2, double gpu_band = 0.1);
+
+// quality_begin_frame
+//    Call when the CPU starts on a frame's work.
+//
+void quality_begin_frame(quality_governor* q);
+
+// quality_end_frame
+//    Call once the frame is submitted, with the GPU time of a recent
+//    frame, e.g. the profiler's frame_busy_ms. Returns true if the tier changed, in which case the caller
+//    should apply quality_current.
+//
+bool quality_end_frame(quality_governor* q, double gpu_ms);
+
+// quality_current
+//    The settings of the current tier.
+//
+const quality_tier& quality_current(const quality_governor* q);
+
+#endif // __QUALITY_H__
@@ -0,0 +1,130 @@
+#include "rng.h"
+#include <emmintrin.h>
+
+#define RNG_BULK_MIN  64   // shorter arrays are not worth setting up the second lane for
+
+void rng_seed(rng* r, unsigned long long seed)
+{
+	for (int i = 0; i < 4; ++i) {
+		unsigned long long z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+		r->s[i] = z ^ (z >> 31);
+	}
+}
+
+// jump_by
+//    Advances r by the distance whose characteristic polynomial is 'poly'.
+//
+static void jump_by(rng* r, const unsigned long long poly[4])
+{
+	unsigned long long s[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 4; ++i)
+		for (int b = 0; b < 64; ++b) {
+			if (poly[i] & (1ULL << b))
+				for (int k = 0; k < 4; ++k)
+					s[k] ^= r->s[k];
+			rng_next(r);
+		}
+	for (int k = 0; k < 4; ++k)
+		r->s[k] = s[k];
+}
+
+void rng_jump(rng* r)
+{
+	static const unsigned long long poly[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+	jump_by(r,poly);
+}
+
+void rng_long_jump(rng* r)
+{
+	static const unsigned long long poly[4] = { 0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL };
+	jump_by(r,poly);
+}
+
+void rng_streams(rng* base, rng* streams, int count)
+{
+	rng r = *base;
+	for (int i = 0; i < count; ++i) {
+		streams[i] = r;
+		rng_jump(&r);
+	}
+	*base = r;
+}
+
+static inline __m128i rotl64(__m128i x, int k)
+{
+	return _mm_or_si128(_mm_slli_epi64(x,k),_mm_srli_epi64(x,64-k));
+}
+
+// bulk
+//    Writes 4*count 32-bit numbers to out (16 bytes at a time, unaligned)
+//    from the two lanes of r, and leaves r where lane 0 ended.
+//
+static void bulk(rng* r, unsigned* out, size_t count, bool floats)
+{
+	rng other = *r;
+	rng_long_jump(&other);
+	unsigned long long lanes[4][2];
+	for (int k = 0; k < 4; ++k) {
+		lanes[k][0] = r->s[k];
+		lanes[k][1] = other.s[k];
+	}
+	__m128i s0 = _mm_loadu_si128((const __m128i*)lanes[0]);
+	__m128i s1 = _mm_loadu_si128((const __m128i*)lanes[1]);
+	__m128i s2 = _mm_loadu_si128((const __m128i*)lanes[2]);
+	__m128i s3 = _mm_loadu_si128((const __m128i*)lanes[3]);
+	__m128 unit = _mm_set1_ps(1.0f/16777216);
+
+	for (size_t i = 0; i < count; ++i) {
+		__m128i result = _mm_add_epi64(rotl64(_mm_add_epi64(s0,s3),23),s0);
+		__m128i t = _mm_slli_epi64(s1,17);
+		s2 = _mm_xor_si128(s2,s0);
+		s3 = _mm_xor_si128(s3,s1);
+		s1 = _mm_xor_si128(s1,s2);
+		s0 = _mm_xor_si128(s0,s3);
+		s2 = _mm_xor_si128(s2,t);
+		s3 = rotl64(s3,45);
+		if (floats)
+			_mm_storeu_ps((float*)out + 4*i,_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result,8)),unit));
+		else
+			_mm_storeu_si128((__m128i*)(out + 4*i),result);
+	}
+
+	_mm_storeu_si128((__m128i*)lanes[0],s0);
+	_mm_storeu_si128((__m128i*)lanes[1],s1);
+	_mm_storeu_si128((__m128i*)lanes[2],s2);
+	_mm_storeu_si128((__m128i*)lanes[3],s3);
+	for (int k = 0; k < 4; ++k)
+		r->s[k] = lanes[k][0];
+}
+
+void rng_uints(rng* r, unsigned* out, size_t count)
+{
+	size_t i = 0;
+	if (count >= RNG_BULK_MIN) {
+		bulk(r,out,count/4,false);
+		i = count & ~(size_t)3;
+	}
+	for (; i < count; i += 2) {
+		unsigned long long x = rng_next(r);
+		out[i] = (unsigned)x;
+		if (i+1 < count)
+			out[i+1] = (unsigned)(x >> 32);
+	}
+}
+
+void rng_floats(rng* r, float* out, size_t count)
+{
+	size_t i = 0;
+	if (count >= RNG_BULK_MIN) {
+		bulk(r,(unsigned*)out,count/4,true);
+		i = count & ~(size_t)3;
+	}
+	for (; i < count; i += 2) {
+		unsigned long long x = rng_next(r);
+		out[i] = (float)((unsigned)x >> 8)*(1.0f/16777216);
+		if (i+1 < count)
+			out[i+1] = (float)((unsigned)(x >> 32) >> 8)*(1.0f/16777216);
+	}
+}
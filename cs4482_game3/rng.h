@@ -0,0 +1,90 @@
+#ifndef __RNG_H__
+#define __RNG_H__
+
+// rng.h
+//    Random numbers from xoshiro256++ (Blackman and Vigna): 256 bits of
+//    state, a handful of adds, shifts and xors per 64-bit number, and
+//    the same sequence on every platform for the same seed.
+//
+//    A generator is a plain value with no hidden global state, so each
+//    thread or task should own one. rng_streams makes any number of
+//    them from one seed that can never overlap: each is the previous
+//    one jumped 2^128 numbers ahead.
+//
+// Example:
+//    rng world, streams[64];
+//    rng_seed(&world, WORLD_SEED);
+//    rng_streams(&world, streams, 64);   // one per job, e.g. per row
+//    ... in job i:  float f = rng_float(&streams[i]);
+
+#include <cstddef>
+
+struct rng {
+	unsigned long long s[4];
+};
+
+// rng_seed
+//    Fills the state from a 64-bit seed with SplitMix64, so nearby
+//    seeds still give unrelated sequences.
+//
+void rng_seed(rng* r, unsigned long long seed);
+
+// rng_jump, rng_long_jump
+//    Advance r by 2^128 or 2^192 numbers, as if that many had been drawn.
+//
+void rng_jump(rng* r);
+void rng_long_jump(rng* r);
+
+// rng_streams
+//    streams[0] is a copy of base and each following one is jumped ahead
+//    of the last; base is left one jump past the final stream, ready to
+//    make more.
+//
+void rng_streams(rng* base, rng* streams, int count);
+
+// rng_uints, rng_floats
+//    Fill an array with 32-bit numbers, or floats in [0,1), much faster
+//    than one at a time: two lanes, r and r long-jumped, are advanced
+//    together with SSE2 and each 64-bit number gives two results. The
+//    same seed and calls always give the same arrays, but not the same
+//    numbers as calling rng_next.
+//
+void rng_uints(rng* r, unsigned* out, size_t count);
+void rng_floats(rng* r, float* out, size_t count);
+
+// rng_next
+//    The next 64 random bits.
+//
+inline unsigned long long rng_next(rng* r)
+{
+	unsigned long long* s = r->s;
+	unsigned long long x = s[0] + s[3];
+	unsigned long long result = ((x << 23) | (x >> 41)) + s[0];
+	unsigned long long t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 45) | (s[3] >> 19);
+	return result;
+}
+
+// rng_float
+//    A float in [0,1), from the top 24 bits.
+//
+inline float rng_float(rng* r)
+{
+	return (float)(rng_next(r) >> 40) * (1.0f/16777216);
+}
+
+// rng_below
+//    An integer in [0,n), from the top 32 bits scaled by n rather than
+//    a remainder; no value is more likely than another by over n/2^32.
+//
+inline unsigned rng_below(rng* r, unsigned n)
+{
+	return (unsigned)(((rng_next(r) >> 32)*n) >> 32);
+}
+
+#endif // __RNG_H__
@@ -0,0 +1,340 @@
+#include "shaders.h"
+#include "cs3388lib.h"
+#include "gl3w.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <deque>
+#ifdef WIN32
+	#include <windows.h>
+#endif
+
+#define SHADER_CACHE_MAGIC  0x52444853   // "SHDR"
+
+static std::string   sPrefix = "shadercache_";
+static std::string   sDriver;           // identifies the driver the binaries are for
+static bool          sBinaries = false; // program binaries supported
+static bool          sIdentified = false;
+static std::map<unsigned long long,shader_program*> sPrograms;
+
+static std::deque<shader_program*> sQueue;
+static bool                    sRunning = false;
+#ifdef WIN32
+static HANDLE                  sWorker = 0;
+static CRITICAL_SECTION        sLock;          // guards sQueue and each program's 'done'
+static HANDLE                  sWake = 0;      // semaphore; one count per queued program, and one to quit
+static HANDLE                  sDone = 0;      // auto-reset event; the compiler finished a program
+static HDC                     sDC = 0;
+static HGLRC                   sContext = 0;   // the background thread's, sharing objects with the main one
+#endif
+
+// FNV-1a, 64 bit
+static unsigned long long hash_bytes(unsigned long long h, const char* s, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		h ^= (unsigned char)s[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static void identify_driver()
+{
+	if (sIdentified)
+		return;
+	sIdentified = true;
+
+	const char* names[3] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+	for (int i = 0; i < 3; ++i) {
+		sDriver += names[i] ? names[i] : "?";
+		sDriver += '\n';
+	}
+
+	GLint formats = 0;
+	if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&formats);
+	sBinaries = formats > 0;
+}
+
+static std::string cache_file(unsigned long long hash)
+{
+	char name[32];
+	sprintf_s(name,32,"%016llx.bin",hash);
+	return sPrefix + name;
+}
+
+// GL program from a saved binary, or 0
+static GLuint load_binary(unsigned long long hash)
+{
+	FILE* fh;
+	if (fopen_s(&fh,cache_file(hash).c_str(),"rb") != 0)
+		return 0;
+
+	unsigned header[3];  // magic, format, length
+	std::string data;
+	if (fread(header,sizeof(header),1,fh) == 1 && header[0] == SHADER_CACHE_MAGIC && header[2] > 0) {
+		data.resize(header[2]);
+		if (fread(&data[0],1,data.size(),fh) != data.size())
+			data.clear();
+	}
+	fclose(fh);
+	if (data.empty())
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program,header[1],data.data(),(GLsizei)data.size());
+	GLint success = 0;
+	glGetProgramiv(program,GL_LINK_STATUS,&success);
+	if (!success) {
+		glDeleteProgram(program);  // stale; it gets rebuilt and saved again
+		return 0;
+	}
+	return program;
+}
+
+static void save_binary(unsigned long long hash, GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program,GL_PROGRAM_BINARY_LENGTH,&length);
+	if (length <= 0)
+		return;
+	std::string data(length,'\0');
+	GLenum format = 0;
+	glGetProgramBinary(program,length,&length,&format,&data[0]);
+
+	FILE* fh;
+	if (fopen_s(&fh,cache_file(hash).c_str(),"wb") != 0)
+		return;  // no cache this time, no harm done
+	unsigned header[3] = { SHADER_CACHE_MAGIC, format, (unsigned)length };
+	fwrite(header,sizeof(header),1,fh);
+	fwrite(data.data(),1,length,fh);
+	fclose(fh);
+}
+
+static GLuint compile_shader(const char* code, GLenum type)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader,1,&code,0);
+	glCompileShader(shader);
+	GLint success = 0;
+	glGetShaderiv(shader,GL_COMPILE_STATUS,&success);
+	if (!success) {
+		GLchar infolog[1024];
+		glGetShaderInfoLog(shader,1024,NULL,infolog);
+		std::cout << "glCompileShader(" << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << ") FAILED: " << std::endl << infolog << std::endl;
+		assert_msg(false,"shader_request failed inside glCompileShader;\n see console output for details");
+	}
+	return shader;
+}
+
+// compiles, links and saves sp, on whichever thread has a context current
+static void build(shader_program* sp)
+{
+	GLuint vs = compile_shader(sp->vscode.c_str(),GL_VERTEX_SHADER);
+	GLuint fs = compile_shader(sp->fscode.c_str(),GL_FRAGMENT_SHADER);
+	GLuint program = glCreateProgram();
+	glAttachShader(program,vs);
+	glAttachShader(program,fs);
+	if (sBinaries)
+		glProgramParameteri(program,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+	glLinkProgram(program);
+	glDeleteShader(fs);
+	glDeleteShader(vs);
+	GLint success = 0;
+	glGetProgramiv(program,GL_LINK_STATUS,&success);
+	if (!success) {
+		GLchar infolog[1024];
+		glGetProgramInfoLog(program,1024,NULL,infolog);
+		std::cout << "glLinkProgram FAILED: " << std::endl << infolog << std::endl;
+		assert_msg(false,"shader_request failed inside glLinkProgram;\n see console output for details");
+	}
+	if (sBinaries)
+		save_binary(sp->hash,program);
+	sp->program = program;
+}
+
+#ifdef WIN32
+static DWORD WINAPI compiler(LPVOID)
+{
+	wglMakeCurrent(sDC,sContext);
+	for (;;) {
+		WaitForSingleObject(sWake,INFINITE);
+		EnterCriticalSection(&sLock);
+		if (sQueue.empty()) {
+			LeaveCriticalSection(&sLock);
+			break;  // the count was the one to quit, and nothing is left to do
+		}
+		shader_program* sp = sQueue.front();
+		sQueue.pop_front();
+		LeaveCriticalSection(&sLock);
+
+		build(sp);
+		glFinish();  // the main context must not see a half-built program
+
+		EnterCriticalSection(&sLock);
+		sp->done = true;
+		LeaveCriticalSection(&sLock);
+		SetEvent(sDone);
+	}
+	wglMakeCurrent(0,0);
+	return 0;
+}
+
+static bool is_done(shader_program* sp)
+{
+	EnterCriticalSection(&sLock);
+	bool done = sp->done;
+	LeaveCriticalSection(&sLock);
+	return done;
+}
+#endif
+
+void shader_init(const char* cache_prefix)
+{
+	sPrefix = cache_prefix;
+	identify_driver();
+	if (sRunning)
+		return;
+
+#ifdef WIN32
+	// a second context on the same window; it must share before either has objects of its own
+	sDC = wglGetCurrentDC();
+	HGLRC main_context = wglGetCurrentContext();
+	sContext = sDC ? wglCreateContext(sDC) : 0;
+	if (sContext && !wglShareLists(main_context,sContext)) {
+		wglDeleteContext(sContext);
+		sContext = 0;
+	}
+	if (!sContext)
+		return;  // compile on the calling thread instead
+
+	InitializeCriticalSection(&sLock);
+	sWake = CreateSemaphore(0,0,0x7fffffff,0);
+	sDone = CreateEvent(0,FALSE,FALSE,0);
+	sWorker = CreateThread(0,0,compiler,0,0,0);
+	sRunning = true;
+#endif
+}
+
+void shader_shutdown()
+{
+	if (!sRunning)
+		return;
+#ifdef WIN32
+	ReleaseSemaphore(sWake,1,0);  // the compiler stops at the first count that finds the queue empty
+	WaitForSingleObject(sWorker,INFINITE);
+	CloseHandle(sWorker);
+	CloseHandle(sWake);
+	CloseHandle(sDone);
+	DeleteCriticalSection(&sLock);
+	wglDeleteContext(sContext);
+	sContext = 0;
+#endif
+	sRunning = false;
+}
+
+shader_program* shader_request(const char* vscode, const char* fscode)
+{
+	identify_driver();
+
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = hash_bytes(hash,vscode,strlen(vscode)+1);
+	hash = hash_bytes(hash,fscode,strlen(fscode)+1);
+	hash = hash_bytes(hash,sDriver.data(),sDriver.size());
+
+	std::map<unsigned long long,shader_program*>::iterator it = sPrograms.find(hash);
+	if (it != sPrograms.end())
+		return it->second;
+
+	shader_program* sp = new shader_program;
+	sp->hash = hash;
+	sp->vscode = vscode;
+	sp->fscode = fscode;
+	sp->program = sBinaries ? load_binary(hash) : 0;
+	sp->from_cache = sp->program != 0;
+	sp->done = sp->from_cache;
+	sPrograms[hash] = sp;
+
+	if (!sp->done) {
+#ifdef WIN32
+		if (sRunning) {
+			EnterCriticalSection(&sLock);
+			sQueue.push_back(sp);
+			LeaveCriticalSection(&sLock);
+			ReleaseSemaphore(sWake,1,0);
+			return sp;
+		}
+#endif
+		build(sp);
+		sp->done = true;
+	}
+	return sp;
+}
+
+unsigned shader_wait(shader_program* sp)
+{
+#ifdef WIN32
+	// without the compiler, or once it has stopped, every program is already done
+	while (sRunning && !is_done(sp))
+		WaitForSingleObject(sDone,INFINITE);
+#endif
+	return sp->program;
+}
+
+unsigned shader_create(const char* vscode, const char* fscode)
+{
+	return shader_wait(shader_request(vscode,fscode));
+}
+
+shader_variants* variants_create(const char* vscode, const char* fscode, const char** features, int feature_count)
+{
+	assert_msg(feature_count >= 0 && feature_count <= 16, "variants_create: too many features");
+	shader_variants* sv = new shader_variants;
+	sv->vscode = vscode;
+	sv->fscode = fscode;
+	sv->features.assign(features,features + feature_count);
+	sv->programs.assign((size_t)1 << feature_count,(shader_program*)0);
+	return sv;
+}
+
+int variants_count(const shader_variants* sv)
+{
+	return (int)sv->programs.size();
+}
+
+// 'code' with a #define for each feature in 'mask', placed after any #version line
+static std::string with_features(const shader_variants* sv, const std::string& code, unsigned mask)
+{
+	std::string defines;
+	for (size_t i = 0; i < sv->features.size(); ++i)
+		if (mask & (1u << i))
+			defines += "#define " + sv->features[i] + " 1\n";
+
+	size_t at = 0;
+	if (code.compare(0,8,"#version") == 0) {
+		at = code.find('\n');
+		at = (at == std::string::npos) ? code.size() : at+1;
+	}
+	return code.substr(0,at) + defines + code.substr(at);
+}
+
+shader_program* variants_request(shader_variants* sv, unsigned mask)
+{
+	mask &= (unsigned)sv->programs.size() - 1;
+	shader_program*& sp = sv->programs[mask];
+	if (!sp)
+		sp = shader_request(with_features(sv,sv->vscode,mask).c_str(),with_features(sv,sv->fscode,mask).c_str());
+	return sp;
+}
+
+void variants_prewarm(shader_variants* sv)
+{
+	for (unsigned mask = 0; mask < sv->programs.size(); ++mask)
+		variants_request(sv,mask);
+}
+
+unsigned variants_get(shader_variants* sv, unsigned mask)
+{
+	return shader_wait(variants_request(sv,mask));
+}
@@ -0,0 +1,99 @@
+#ifndef __SHADERS_H__
+#define __SHADERS_H__
+
+// shaders.h
+//    Shader programs, cached on disk. A program is known by a hash of its
+//    source code and of the driver (vendor, renderer and version strings).
+//    Once linked, its binary is saved with glGetProgramBinary (OpenGL 4.1
+//    or ARB_get_program_binary) and later launches load it back with
+//    glProgramBinary, skipping compilation altogether. A binary the driver
+//    no longer accepts, e.g. after an update, is simply rebuilt.
+//
+//    On a cache miss the program is compiled by a background thread that
+//    has its own GL context sharing objects with the main one (Windows
+//    only; elsewhere it is compiled on the spot). Request programs early
+//    and only wait for them where they are first needed.
+//
+//    Variants build every combination of a set of feature flags from one
+//    source: each enabled feature becomes a #define after the #version
+//    line, so disabled code is compiled out rather than multiplied by 0.
+
+#include <string>
+#include <vector>
+
+struct shader_program {
+	unsigned long long hash;
+	std::string vscode;
+	std::string fscode;
+	unsigned program;      // valid once done
+	bool     done;         // guarded by the compiler's lock until shader_wait has returned
+	bool     from_cache;
+};
+
+//
+// shader_variants -- programs built from the same source with different features
+//
+struct shader_variants {
+	std::string vscode;
+	std::string fscode;
+	std::vector<std::string> features;      // bit i of a variant's mask defines features[i]
+	std::vector<shader_program*> programs;  // by mask, 0 until requested
+};
+
+// shader_init
+//    Starts the background compiler; call with the main GL context current.
+//    Binaries are saved as <cache_prefix><hash>.bin. Without it programs
+//    are still cached, but compiled on the calling thread.
+//
+void shader_init(const char* cache_prefix = "shadercache_");
+
+// shader_shutdown
+//    Finishes any queued programs and stops the background compiler.
+//
+void shader_shutdown();
+
+// shader_request
+//    Returns at once with the program loaded from the cache, or queued to
+//    be compiled. Requests for the same source share one shader_program.
+//
+shader_program* shader_request(const char* vscode, const char* fscode);
+
+// shader_wait
+//    Blocks until the program is linked and returns its GL identifier.
+//
+unsigned shader_wait(shader_program* sp);
+
+// shader_create
+//    shader_request and shader_wait in one; a drop-in for gl_createprogram.
+//
+unsigned shader_create(const char* vscode, const char* fscode);
+
+// variants_create
+//    'features' are preprocessor names, at most 16 of them. Nothing is
+//    compiled until a variant is requested.
+//
+shader_variants* variants_create(const char* vscode, const char* fscode, const char** features, int feature_count);
+
+// variants_count
+//    How many variants there are; masks run from 0 to variants_count-1.
+//
+int variants_count(const shader_variants* sv);
+
+// variants_request
+//    shader_request for the variant with the features in 'mask'.
+//    Bits beyond the variants' features are ignored.
+//
+shader_program* variants_request(shader_variants* sv, unsigned mask);
+
+// variants_prewarm
+//    Requests every variant, so that switching between them later never
+//    waits for a compiler.
+//
+void variants_prewarm(shader_variants* sv);
+
+// variants_get
+//    The GL program of a variant, waiting for it if need be.
+//
+unsigned variants_get(shader_variants* sv, unsigned mask);
+
+#endif // __SHADERS_H__
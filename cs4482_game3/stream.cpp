@@ -0,0 +1,98 @@
+#include "stream.h"
+#include "cs3388lib.h"
+#include "gl3w.h"
+#include <cstring>
+
+stream_buffer* stream_create(int region_size)
+{
+	stream_buffer* sb = new stream_buffer;
+	sb->region_size = (region_size + STREAM_ALIGN-1) & ~(STREAM_ALIGN-1);
+	sb->region = 0;
+	sb->used = 0;
+	sb->mapped = 0;
+	sb->synced = gl3wIsSupported(3,2) != 0;
+	sb->waits = 0;
+	for (int i = 0; i < STREAM_FRAMES; ++i)
+		sb->fences[i] = 0;
+
+	glGenBuffers(1,&sb->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER,sb->buffer);
+	glBufferData(GL_ARRAY_BUFFER,(sb->synced ? STREAM_FRAMES : 1)*sb->region_size,0,GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	if (!sb->synced)
+		sb->staging.resize(sb->region_size);
+	return sb;
+}
+
+void stream_map(stream_buffer* sb)
+{
+	assert_msg(!sb->mapped, "stream_map called twice");
+	sb->used = 0;
+
+	if (!sb->synced) {
+		sb->mapped = &sb->staging[0];
+		return;
+	}
+
+	// the GPU may still be reading what we wrote here STREAM_FRAMES frames ago
+	GLsync fence = (GLsync)sb->fences[sb->region];
+	if (fence) {
+		GLenum r = glClientWaitSync(fence,0,0);
+		if (r == GL_TIMEOUT_EXPIRED) {
+			sb->waits++;
+			while (glClientWaitSync(fence,GL_SYNC_FLUSH_COMMANDS_BIT,1000000) == GL_TIMEOUT_EXPIRED)
+				;
+		}
+		glDeleteSync(fence);
+		sb->fences[sb->region] = 0;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER,sb->buffer);
+	sb->mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER,sb->region*sb->region_size,sb->region_size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	assert_msg(sb->mapped, "could not map stream buffer");
+}
+
+int stream_alloc(stream_buffer* sb, int bytes, void** ptr)
+{
+	if (!sb->mapped || bytes <= 0 || sb->used + bytes > sb->region_size)
+		return -1;
+	int offset = sb->used;
+	sb->used = (sb->used + bytes + STREAM_ALIGN-1) & ~(STREAM_ALIGN-1);
+	*ptr = sb->mapped + offset;
+	return (sb->synced ? sb->region*sb->region_size : 0) + offset;
+}
+
+int stream_write(stream_buffer* sb, const void* data, int bytes)
+{
+	void* ptr;
+	int offset = stream_alloc(sb,bytes,&ptr);
+	if (offset >= 0)
+		memcpy(ptr,data,bytes);
+	return offset;
+}
+
+void stream_unmap(stream_buffer* sb)
+{
+	if (!sb->mapped)
+		return;
+	sb->mapped = 0;
+
+	glBindBuffer(GL_ARRAY_BUFFER,sb->buffer);
+	if (sb->synced) {
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else if (sb->used > 0) {
+		glBufferData(GL_ARRAY_BUFFER,sb->region_size,0,GL_STREAM_DRAW); // orphan last frame's data
+		glBufferSubData(GL_ARRAY_BUFFER,0,sb->used,&sb->staging[0]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+}
+
+void stream_fence(stream_buffer* sb)
+{
+	if (!sb->synced)
+		return;
+	sb->fences[sb->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	sb->region = (sb->region + 1) % STREAM_FRAMES;
+}
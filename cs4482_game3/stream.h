@@ -0,0 +1,68 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+// stream.h
+//    Streaming uploads for data that changes every frame (instance
+//    transforms, billboards, draw commands). One buffer is split into
+//    STREAM_FRAMES regions used in turn; each frame's data is written
+//    into its region in one go, mapped without synchronization, and a
+//    fence placed after the frame's draws tells when the GPU is done
+//    with the region, so it is reused only STREAM_FRAMES frames later
+//    and writing never waits on the driver.
+//
+//    Without OpenGL 3.2 (fences) the frame's data is collected in memory
+//    and uploaded with a single orphaning glBufferData instead.
+
+#include <vector>
+
+#define STREAM_FRAMES   3     // regions in the ring
+#define STREAM_ALIGN    16    // every allocation starts on this many bytes
+
+struct stream_buffer {
+	unsigned buffer;
+	int      region_size;         // bytes per frame
+	int      region;              // region of the current frame
+	int      used;                // bytes allocated from it so far
+	unsigned char* mapped;        // the region's memory between stream_map and stream_unmap
+	bool     synced;              // fences and unsynchronized mapping are available
+	void*    fences[STREAM_FRAMES];
+	std::vector<unsigned char> staging;  // the frame's data when not 'synced'
+
+	int      waits;               // times stream_map had to wait for the GPU to let go of a region
+};
+
+// stream_create
+//    Allocates a ring able to hold region_size bytes per frame.
+//
+stream_buffer* stream_create(int region_size);
+
+// stream_map
+//    Starts writing the current frame's data.
+//
+void stream_map(stream_buffer* sb);
+
+// stream_alloc
+//    Reserves 'bytes' in the current frame's region and sets *ptr to
+//    where they should be written. Returns their byte offset in
+//    sb->buffer for use as a vertex attribute or indirect offset, or -1
+//    if the region is full.
+//
+int stream_alloc(stream_buffer* sb, int bytes, void** ptr);
+
+// stream_write
+//    stream_alloc and copy 'data' there.
+//
+int stream_write(stream_buffer* sb, const void* data, int bytes);
+
+// stream_unmap
+//    Ends the writes; the data can be drawn from after this.
+//
+void stream_unmap(stream_buffer* sb);
+
+// stream_fence
+//    Call after the last draw that reads this frame's data; the next
+//    frame then writes into the next region.
+//
+void stream_fence(stream_buffer* sb);
+
+#endif // __STREAM_H__
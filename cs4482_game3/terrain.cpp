@@ -0,0 +1,353 @@
+#include "terrain.h"
+#include "frustum.h"
+#include "gl3w.h"
+#include <cmath>
+#include <algorithm>
+
+#define BUFFER_OFFSET(bytes) ((const char*)(0) + (bytes))
+
+// largest vertical distance between full detail and the surface drawn at 'level'
+static float level_error(const heightfield* hf, int gi0, int gj0, int level)
+{
+	const int N = TERRAIN_CHUNK_SIZE;
+	int s = 1 << level;
+	float error = 0;
+	for (int z = 0; z < N; z += s) {
+		for (int x = 0; x < N; x += s) {
+			// the coarse cell is split along its (x,z)-(x+s,z+s) diagonal, just like create_quad
+			float ha = heightfield_sample(hf,gi0+x,  gj0+z  );
+			float hb = heightfield_sample(hf,gi0+x,  gj0+z+s);
+			float hc = heightfield_sample(hf,gi0+x+s,gj0+z+s);
+			float hd = heightfield_sample(hf,gi0+x+s,gj0+z  );
+			for (int j = 0; j <= s; ++j) {
+				for (int i = 0; i <= s; ++i) {
+					float u = (float)i/s, w = (float)j/s;
+					float coarse = (w >= u) ? ha + u*(hc-hb) + w*(hb-ha)
+					                        : ha + u*(hd-ha) + w*(hc-hd);
+					float fine = heightfield_sample(hf,gi0+x+i,gj0+z+j);
+					error = std::max(error,fabs(fine-coarse));
+				}
+			}
+		}
+	}
+	return error;
+}
+
+// lowest sample within 'r' samples of (i,j), so that a coarse mesh through
+// these heights never rises above the real surface
+static float min_sample(const heightfield* hf, int i, int j, int r)
+{
+	float h = heightfield_top(hf);
+	for (int y = j-r; y <= j+r; ++y)
+		for (int x = i-r; x <= i+r; ++x)
+			h = std::min(h,heightfield_sample(hf,x,y));
+	return h;
+}
+
+static int build_node(terrain* t, int x0, int z0, int x1, int z1)
+{
+	terrain_node node;
+	node.child[0] = node.child[1] = node.child[2] = node.child[3] = -1;
+	node.chunk = -1;
+
+	if (x1-x0 == 1 && z1-z0 == 1) {
+		node.chunk = z0*t->chunks_x + x0;
+		node.bmin = t->chunks[node.chunk].bmin;
+		node.bmax = t->chunks[node.chunk].bmax;
+	} else {
+		int xm = x0 + (x1-x0+1)/2;
+		int zm = z0 + (z1-z0+1)/2;
+		int range[4][4] = {
+			{ x0,z0, xm,zm },
+			{ xm,z0, x1,zm },
+			{ x0,zm, xm,z1 },
+			{ xm,zm, x1,z1 }
+		};
+		bool first = true;
+		for (int k = 0; k < 4; ++k) {
+			if (range[k][0] >= range[k][2] || range[k][1] >= range[k][3])
+				continue; // empty quadrant along a thin edge of the map
+			node.child[k] = build_node(t,range[k][0],range[k][1],range[k][2],range[k][3]);
+			const terrain_node& c = t->nodes[node.child[k]];
+			if (first) {
+				node.bmin = c.bmin;
+				node.bmax = c.bmax;
+				first = false;
+			} else {
+				node.bmin = vec4(std::min(node.bmin.x,c.bmin.x),std::min(node.bmin.y,c.bmin.y),std::min(node.bmin.z,c.bmin.z),1);
+				node.bmax = vec4(std::max(node.bmax.x,c.bmax.x),std::max(node.bmax.y,c.bmax.y),std::max(node.bmax.z,c.bmax.z),1);
+			}
+		}
+	}
+	t->nodes.push_back(node);
+	return (int)t->nodes.size()-1;
+}
+
+terrain* terrain_create(const heightfield* hf)
+{
+	const int N = TERRAIN_CHUNK_SIZE;
+	const int S = TERRAIN_OCCLUDER_STEP;
+	assert_msg((1 << (TERRAIN_NUM_LEVELS-1)) <= N/2, "TERRAIN_NUM_LEVELS too large for TERRAIN_CHUNK_SIZE");
+	assert_msg(N % S == 0, "TERRAIN_OCCLUDER_STEP must divide TERRAIN_CHUNK_SIZE");
+
+	terrain* t = new terrain;
+	t->wd = hf->wd;
+	t->ht = hf->ht;
+	t->max_height = heightfield_top(hf);
+	t->chunks_x = std::max(1,(hf->wd-1 + N-1) / N);  // cells are between samples, so W samples make W-1 cells
+	t->chunks_z = std::max(1,(hf->ht-1 + N-1) / N);
+	t->vbo = 0;
+	t->pixel_error = 2.0f;
+	t->frame = 0;
+	t->drawn_chunks = 0;
+	t->drawn_triangles = 0;
+
+	int half_wd = -hf->x0;
+	int half_ht = -hf->z0;
+
+	for (int cz = 0; cz < t->chunks_z; ++cz) {
+		for (int cx = 0; cx < t->chunks_x; ++cx) {
+			terrain_chunk c;
+			c.cx = cx;
+			c.cz = cz;
+			c.first_vertex = (int)t->vertices.size();
+			c.level = 0;
+			c.level_frame = -1;
+
+			float ymin = t->max_height, ymax = 0;
+			for (int j = 0; j <= N; ++j) {
+				for (int i = 0; i <= N; ++i) {
+					int gi = cx*N + i, gj = cz*N + j;
+					float h = heightfield_sample(hf,gi,gj);
+					t->vertices.push_back(vec4((float)(gi-half_wd),h,(float)(gj-half_ht),1));
+					ymin = std::min(ymin,h);
+					ymax = std::max(ymax,h);
+				}
+			}
+			c.bmin = vec4((float)(cx*N   - half_wd),ymin,(float)(cz*N   - half_ht),1);
+			c.bmax = vec4((float)(cx*N+N - half_wd),ymax,(float)(cz*N+N - half_ht),1);
+
+			c.error[0] = 0;
+			for (int l = 1; l < TERRAIN_NUM_LEVELS; ++l)
+				c.error[l] = std::max(c.error[l-1],level_error(hf,cx*N,cz*N,l)); // keep errors monotonic
+
+			c.first_occluder = (int)t->occluder.size();
+			for (int z = 0; z < N; z += S) {
+				for (int x = 0; x < N; x += S) {
+					int gi = cx*N + x, gj = cz*N + z;
+					vec4 a((float)(gi  -half_wd),min_sample(hf,gi,  gj,  S),(float)(gj  -half_ht),1);
+					vec4 b((float)(gi  -half_wd),min_sample(hf,gi,  gj+S,S),(float)(gj+S-half_ht),1);
+					vec4 d((float)(gi+S-half_wd),min_sample(hf,gi+S,gj,  S),(float)(gj  -half_ht),1);
+					vec4 e((float)(gi+S-half_wd),min_sample(hf,gi+S,gj+S,S),(float)(gj+S-half_ht),1);
+					t->occluder.push_back(a); t->occluder.push_back(b); t->occluder.push_back(e);
+					t->occluder.push_back(a); t->occluder.push_back(e); t->occluder.push_back(d);
+				}
+			}
+			c.occluder_count = (int)t->occluder.size() - c.first_occluder;
+
+			t->chunks.push_back(c);
+		}
+	}
+
+	t->root = build_node(t,0,0,t->chunks_x,t->chunks_z);
+	return t;
+}
+
+void terrain_init_buffers(terrain* t)
+{
+	glGenBuffers(1,&t->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER,t->vbo);
+	glBufferData(GL_ARRAY_BUFFER,t->vertices.size()*sizeof(vec4),&t->vertices[0],GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	std::vector<vec4>().swap(t->vertices); // the copy on the video card is all we need now
+}
+
+////////////////////////////////////////////////////////
+
+// append triangle (a,b,c), flipped if needed so that it is counter-clockwise from above
+static void emit(std::vector<unsigned short>& idx, int a, int b, int c)
+{
+	const int n = TERRAIN_CHUNK_SIZE+1;
+	int ax = a%n, az = a/n;
+	int bx = b%n, bz = b/n;
+	int cx = c%n, cz = c/n;
+	int area = (bz-az)*(cx-ax) - (bx-ax)*(cz-az);
+	if (area == 0)
+		return;
+	if (area < 0)
+		std::swap(b,c);
+	idx.push_back((unsigned short)a);
+	idx.push_back((unsigned short)b);
+	idx.push_back((unsigned short)c);
+}
+
+// Build the triangle list for a chunk drawn at 'level' whose four edges
+// (x-min, x-max, z-min, z-max) must match neighbours drawn at edge_level[].
+// The interior is a regular grid; the outer ring of cells is a strip
+// between the edge (at the neighbour's spacing) and the interior (at ours).
+static std::vector<unsigned short> build_indices(int level, const int edge_level[4])
+{
+	const int N = TERRAIN_CHUNK_SIZE;
+	const int n = N+1;
+	int s = 1 << level;
+	std::vector<unsigned short> idx;
+
+	for (int z = s; z < N-s; z += s) {
+		for (int x = s; x < N-s; x += s) {
+			int a = z*n + x, b = (z+s)*n + x, c = (z+s)*n + x+s, d = z*n + x+s;
+			emit(idx,a,b,c);
+			emit(idx,a,c,d);
+		}
+	}
+
+	for (int e = 0; e < 4; ++e) {
+		int es = 1 << edge_level[e];
+		std::vector<int> outer, outer_t, inner, inner_t;
+		for (int t = 0; t <= N; t += es) {
+			outer_t.push_back(t);
+			outer.push_back(e == 0 ? t*n     : e == 1 ? t*n + N   : e == 2 ? t     : N*n + t);
+		}
+		for (int t = s; t <= N-s; t += s) {
+			inner_t.push_back(t);
+			inner.push_back(e == 0 ? t*n + s : e == 1 ? t*n + N-s : e == 2 ? s*n + t : (N-s)*n + t);
+		}
+
+		// zip the two rows together, always advancing whichever is behind
+		size_t i = 0, k = 0;
+		while (i+1 < outer.size() || k+1 < inner.size()) {
+			if (k+1 >= inner.size() || (i+1 < outer.size() && outer_t[i+1] <= inner_t[k+1])) {
+				emit(idx,outer[i],inner[k],outer[i+1]);
+				++i;
+			} else {
+				emit(idx,outer[i],inner[k],inner[k+1]);
+				++k;
+			}
+		}
+	}
+	return idx;
+}
+
+static terrain_indices& get_indices(terrain* t, int level, const int edge_level[4])
+{
+	int key = level | (edge_level[0] << 4) | (edge_level[1] << 8) | (edge_level[2] << 12) | (edge_level[3] << 16);
+	std::map<int,terrain_indices>::iterator it = t->indices.find(key);
+	if (it != t->indices.end())
+		return it->second;
+
+	std::vector<unsigned short> idx = build_indices(level,edge_level);
+	terrain_indices ti;
+	ti.count = (int)idx.size();
+	glGenBuffers(1,&ti.ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,ti.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,idx.size()*sizeof(unsigned short),&idx[0],GL_STATIC_DRAW);
+	return t->indices[key] = ti;
+}
+
+////////////////////////////////////////////////////////
+
+struct terrain_view {
+	mat4x4 MV;
+	float  pixels_per_unit;  // pixels covered by a unit length at unit distance
+	float  vertical_scale;   // how MV scales terrain heights
+	float  max_scale;        // largest scale along any axis, for bounding radii
+};
+
+static int choose_level(terrain* t, terrain_chunk& c, const terrain_view& v)
+{
+	if (c.level_frame == t->frame)
+		return c.level;
+
+	vec4 center = 0.5f*(c.bmin + c.bmax);
+	float radius = 0.5f*norm(c.bmax - c.bmin) * v.max_scale;
+	vec4 eye = v.MV*center;
+	float dist = sqrt(eye.x*eye.x + eye.y*eye.y + eye.z*eye.z) - radius;
+
+	int level = 0;
+	if (dist > 0) {
+		float k = v.vertical_scale * v.pixels_per_unit / dist;
+		while (level+1 < TERRAIN_NUM_LEVELS && c.error[level+1]*k <= t->pixel_error)
+			++level;
+	}
+	c.level = level;
+	c.level_frame = t->frame;
+	return level;
+}
+
+static void cull_node(terrain* t, int n, const frustum& f, bool inside, std::vector<int>& visible)
+{
+	const terrain_node& node = t->nodes[n];
+	if (!inside) {
+		int r = frustum_test_aabb(f,node.bmin,node.bmax);
+		if (r == FRUSTUM_OUTSIDE)
+			return;
+		inside = (r == FRUSTUM_INSIDE);  // no need to test anything below this node
+	}
+	if (node.chunk >= 0) {
+		visible.push_back(node.chunk);
+		return;
+	}
+	for (int k = 0; k < 4; ++k)
+		if (node.child[k] >= 0)
+			cull_node(t,node.child[k],f,inside,visible);
+}
+
+void terrain_cull(terrain* t, const mat4x4& P, const mat4x4& MV)
+{
+	t->visible.clear();
+	cull_node(t,t->root,frustum_from_matrix(P*MV),false,t->visible);
+}
+
+void terrain_draw(terrain* t, const mat4x4& P, const mat4x4& MV, unsigned ploc)
+{
+	t->frame++;
+	t->drawn_chunks = 0;
+	t->drawn_triangles = 0;
+
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT,viewport);
+
+	terrain_view v;
+	v.MV = MV;
+	v.pixels_per_unit = fabs(P[1][1]) * 0.5f * viewport[3];
+	v.vertical_scale = norm(MV*vec4(0,1,0,0));
+	v.max_scale = std::max(v.vertical_scale,std::max(norm(MV*vec4(1,0,0,0)),norm(MV*vec4(0,0,1,0))));
+
+	glBindBuffer(GL_ARRAY_BUFFER,t->vbo);
+	glEnableVertexAttribArray(ploc);
+
+	for (size_t i = 0; i < t->visible.size(); ++i) {
+		terrain_chunk& c = t->chunks[t->visible[i]];
+		int level = choose_level(t,c,v);
+
+		// neighbours that are coarser dictate the spacing along the shared edge;
+		// finer neighbours stitch themselves to us instead
+		int nx[4] = { c.cx-1, c.cx+1, c.cx,   c.cx   };
+		int nz[4] = { c.cz,   c.cz,   c.cz-1, c.cz+1 };
+		int edge_level[4];
+		for (int e = 0; e < 4; ++e) {
+			edge_level[e] = level;
+			if (nx[e] >= 0 && nz[e] >= 0 && nx[e] < t->chunks_x && nz[e] < t->chunks_z)
+				edge_level[e] = std::max(level,choose_level(t,t->chunks[nz[e]*t->chunks_x + nx[e]],v));
+		}
+
+		terrain_indices& ti = get_indices(t,level,edge_level);
+		glVertexAttribPointer(ploc,4,GL_FLOAT,GL_FALSE,sizeof(vec4),BUFFER_OFFSET(c.first_vertex*sizeof(vec4)));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,ti.ibo);
+		glDrawElements(GL_TRIANGLES,ti.count,GL_UNSIGNED_SHORT,0);
+
+		t->drawn_chunks++;
+		t->drawn_triangles += ti.count/3;
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+}
+
+void terrain_delete(terrain* t)
+{
+	if (t->vbo)
+		glDeleteBuffers(1,&t->vbo);
+	for (std::map<int,terrain_indices>::iterator it = t->indices.begin(); it != t->indices.end(); ++it)
+		glDeleteBuffers(1,&it->second.ibo);
+	delete t;
+}
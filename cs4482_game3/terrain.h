@@ -0,0 +1,110 @@
+#ifndef __TERRAIN_H__
+#define __TERRAIN_H__
+
+// terrain.h
+//    Takes a heightfield (heightfield.h) and splits it into fixed-size
+//    chunks organized in a quadtree. Each frame the quadtree is culled
+//    against the view frustum and every visible chunk picks a level of
+//    detail (geomipmap) from its screen-space geometric error.
+//    Chunk edges are stitched to coarser neighbours so there are no cracks.
+//
+//    The map size comes from the heightfield: W x H samples cover x in
+//    [-W/2,W/2] and z in [-H/2,H/2] in terrain-local coordinates.
+
+#include "vec4.h"
+#include "mat4x4.h"
+#include "cs3388lib.h"
+#include "heightfield.h"
+#include <vector>
+#include <map>
+
+#define TERRAIN_CHUNK_SIZE  32  // cells along each side of a chunk (power of two)
+#define TERRAIN_NUM_LEVELS  5   // level L draws every (1<<L)th vertex; (1<<(L-1)) <= CHUNK_SIZE/2
+#define TERRAIN_OCCLUDER_STEP 8 // cells per occluder quad (divides CHUNK_SIZE)
+
+//
+// terrain_chunk -- a CHUNK_SIZE x CHUNK_SIZE block of cells
+//
+struct terrain_chunk {
+	int   cx, cz;                       // position in the chunk grid
+	int   first_vertex;                 // offset of this chunk's vertices in the terrain vbo
+	vec4  bmin, bmax;                   // bounds in terrain-local coordinates
+	float error[TERRAIN_NUM_LEVELS];    // max vertical error of each level vs. full detail
+	int   level;                        // level chosen for the current frame
+	int   level_frame;                  // frame on which 'level' was chosen
+	int   first_occluder;               // this chunk's triangles in terrain::occluder
+	int   occluder_count;               // (vertex count, 3 per triangle)
+};
+
+//
+// terrain_node -- quadtree node; leaves refer to a single chunk
+//
+struct terrain_node {
+	vec4 bmin, bmax;   // bounds of everything below this node
+	int  child[4];     // indices into terrain::nodes, or -1
+	int  chunk;        // index into terrain::chunks for leaves, otherwise -1
+};
+
+//
+// terrain_indices -- one index buffer for a (level, neighbour levels) combination;
+//                    shared by every chunk since all chunks have the same layout
+//
+struct terrain_indices {
+	unsigned ibo;
+	int      count;
+};
+
+struct terrain {
+	int   wd, ht;                       // heightmap size in samples
+	int   chunks_x, chunks_z;           // number of chunks along x and z
+	float max_height;                   // local height no sample reaches
+
+	std::vector<terrain_chunk> chunks;
+	std::vector<terrain_node>  nodes;
+	int root;
+
+	std::vector<vec4> vertices;         // (CHUNK_SIZE+1)^2 positions per chunk; freed once uploaded
+	unsigned vbo;
+	std::map<int,terrain_indices> indices;
+
+	std::vector<vec4> occluder;         // coarse triangle list lying on or below the surface, for occlusion culling
+	std::vector<int>  visible;          // chunks that passed terrain_cull
+
+	float pixel_error;                  // max screen-space error (pixels) allowed when choosing a level
+	int   frame;
+
+	// statistics from the last terrain_draw
+	int   drawn_chunks;
+	int   drawn_triangles;
+};
+
+// terrain_create
+//    Builds chunks, per-level errors and the quadtree from the heights
+//    of 'hf'. Does not touch OpenGL; hf may be freed afterwards.
+//
+terrain* terrain_create(const heightfield* hf);
+
+// terrain_init_buffers
+//    Uploads the chunk vertices to OpenGL. Call once a GL context exists.
+//
+void terrain_init_buffers(terrain* t);
+
+// terrain_cull
+//    Finds the chunks inside the view frustum and stores them in
+//    t->visible. P is the projection and MV the terrain's modelview matrix.
+//
+void terrain_cull(terrain* t, const mat4x4& P, const mat4x4& MV);
+
+// terrain_draw
+//    Draws the chunks found by the last terrain_cull with the currently
+//    bound GLSL program; 'ploc' is the location of the program's vec4
+//    position attribute.
+//
+void terrain_draw(terrain* t, const mat4x4& P, const mat4x4& MV, unsigned ploc);
+
+// terrain_delete
+//    Releases the terrain and any OpenGL buffers it owns.
+//
+void terrain_delete(terrain* t);
+
+#endif // __TERRAIN_H__
@@ -0,0 +1,488 @@
+#include "texcook.h"
+#include "gl3w.h"
+#include <emmintrin.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <sys/stat.h>
+
+#define TEXCOOK_MAGIC  0x4b4f4f43   // "COOK"
+#define TEXCOOK_VERSION  1
+#define TEXCOOK_MAX_SIDE  32768   // larger than any texture a driver takes; a header saying so is corrupt
+
+// S3TC is an extension, so gl3.h does not name it
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT  0x83F3
+
+//////////////////////////////////////////////////////////////////
+// sRGB
+
+static float sToLinear[256];
+static unsigned char sToSRGB[4096];   // indexed by linear value * 4095
+
+static void init_tables()
+{
+	static bool done = false;
+	if (done)
+		return;
+	done = true;
+	for (int i = 0; i < 256; ++i) {
+		float c = i/255.0f;
+		sToLinear[i] = c <= 0.04045f ? c/12.92f : pow((c + 0.055f)/1.055f,2.4f);
+	}
+	for (int i = 0; i < 4096; ++i) {
+		float l = i/4095.0f;
+		float c = l <= 0.0031308f ? 12.92f*l : 1.055f*pow(l,1/2.4f) - 0.055f;
+		sToSRGB[i] = (unsigned char)std::min(std::max((int)(255*c + 0.5f),0),255);
+	}
+}
+
+//////////////////////////////////////////////////////////////////
+// Mip chain, in premultiplied linear BGRA floats
+
+struct mip_image {
+	int wd, ht;
+	std::vector<float> texels;   // 4 per texel
+};
+
+static void to_float(const bitmap* bm, bool srgb, mip_image& img)
+{
+	img.wd = bm->wd;
+	img.ht = bm->ht;
+	img.texels.resize(4*bm->wd*bm->ht);
+	const unsigned char* src = bm->pixels;
+	float* dst = &img.texels[0];
+	for (int i = 0; i < bm->wd*bm->ht; ++i, src += 4, dst += 4) {
+		float a = src[3]/255.0f;
+		for (int c = 0; c < 3; ++c)
+			dst[c] = a*(srgb ? sToLinear[src[c]] : src[c]/255.0f);
+		dst[3] = a;
+	}
+}
+
+// filter_taps
+//    Where each of the 'to' texels along one axis reads from the 'from'
+//    texels of the level above: three texels from 'first' on (clamped to
+//    the edge), with the three weights in 'weight'. An even size halves with a 2-texel box;
+//    an odd size 2n+1 goes to n with a box 2+1/n texels wide, so that
+//    every texel, the last one included, counts for the same amount.
+//
+static void filter_taps(int from, int to, std::vector<int>& first, std::vector<float>& weight)
+{
+	first.resize(to);
+	weight.resize(3*to);
+	for (int i = 0; i < to; ++i) {
+		float* w = &weight[3*i];
+		if (from == 1) {
+			first[i] = 0;
+			w[0] = 1; w[1] = w[2] = 0;
+		} else if (from % 2 == 0) {
+			first[i] = 2*i;
+			w[0] = w[1] = 0.5f; w[2] = 0;
+		} else {
+			first[i] = 2*i;
+			w[0] = (float)(to - i)/from;
+			w[1] = (float)to/from;
+			w[2] = (float)(i + 1)/from;
+		}
+	}
+}
+
+// downsample
+//    Halves each side, rounding down as OpenGL's mip sizes do. Even
+//    sizes take a 2x2 box; an odd size filters the leftover texel in
+//    with its neighbours (filter_taps) rather than dropping it.
+//
+static void downsample(const mip_image& src, mip_image& dst)
+{
+	dst.wd = std::max(src.wd/2,1);
+	dst.ht = std::max(src.ht/2,1);
+	dst.texels.resize(4*dst.wd*dst.ht);
+	const float* s = &src.texels[0];
+
+	if (src.wd % 2 == 0 && src.ht % 2 == 0) {
+		const __m128 quarter = _mm_set1_ps(0.25f);
+		for (int y = 0; y < dst.ht; ++y) {
+			const float* row0 = s + 4*src.wd*2*y;
+			const float* row1 = row0 + 4*src.wd;
+			float* d = &dst.texels[4*dst.wd*y];
+			for (int x = 0; x < dst.wd; ++x) {
+				__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + 8*x),_mm_loadu_ps(row0 + 8*x + 4)),
+				                        _mm_add_ps(_mm_loadu_ps(row1 + 8*x),_mm_loadu_ps(row1 + 8*x + 4)));
+				_mm_storeu_ps(d + 4*x,_mm_mul_ps(sum,quarter));
+			}
+		}
+		return;
+	}
+
+	std::vector<int> fx, fy;
+	std::vector<float> wx, wy;
+	filter_taps(src.wd,dst.wd,fx,wx);
+	filter_taps(src.ht,dst.ht,fy,wy);
+	for (int y = 0; y < dst.ht; ++y) {
+		float* d = &dst.texels[4*dst.wd*y];
+		for (int x = 0; x < dst.wd; ++x) {
+			__m128 sum = _mm_setzero_ps();
+			for (int j = 0; j < 3; ++j) {
+				if (wy[3*y+j] == 0)
+					continue;
+				const float* row = s + 4*src.wd*std::min(fy[y]+j,src.ht-1);
+				__m128 h = _mm_setzero_ps();
+				for (int i = 0; i < 3; ++i)
+					h = _mm_add_ps(h,_mm_mul_ps(_mm_loadu_ps(row + 4*std::min(fx[x]+i,src.wd-1)),_mm_set1_ps(wx[3*x+i])));
+				sum = _mm_add_ps(sum,_mm_mul_ps(h,_mm_set1_ps(wy[3*y+j])));
+			}
+			_mm_storeu_ps(d + 4*x,sum);
+		}
+	}
+}
+
+static void to_bytes(const mip_image& img, bool srgb, std::vector<unsigned char>& out)
+{
+	out.resize(4*img.wd*img.ht);
+	const float* src = &img.texels[0];
+	unsigned char* dst = &out[0];
+	for (int i = 0; i < img.wd*img.ht; ++i, src += 4, dst += 4) {
+		float a = src[3];
+		float inv = a > 0 ? 1/a : 0;
+		for (int c = 0; c < 3; ++c) {
+			float v = std::min(src[c]*inv,1.0f);
+			dst[c] = srgb ? sToSRGB[(int)(v*4095 + 0.5f)] : (unsigned char)(255*v + 0.5f);
+		}
+		dst[3] = (unsigned char)(255*std::min(a,1.0f) + 0.5f);
+	}
+}
+
+//////////////////////////////////////////////////////////////////
+// Block encoders; 'block' is 4x4 BGRA texels, rows in order
+
+static unsigned short pack565(const int* c)  // c is r,g,b
+{
+	return (unsigned short)(((c[0]*31 + 127)/255) << 11 | ((c[1]*63 + 127)/255) << 5 | ((c[2]*31 + 127)/255));
+}
+
+static void unpack565(unsigned short v, int* c)
+{
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+static void encode_bc1(const unsigned char* block, unsigned char* out)
+{
+	// the bounding box of the colours, along whichever diagonal follows them
+	int lo[3] = { 255,255,255 }, hi[3] = { 0,0,0 };
+	float mean[3] = { 0,0,0 };
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < 3; ++c) {
+			int v = block[4*i + 2-c];  // BGRA to r,g,b
+			lo[c] = std::min(lo[c],v);
+			hi[c] = std::max(hi[c],v);
+			mean[c] += v/16.0f;
+		}
+	float cov_rg = 0, cov_rb = 0, cov_gb = 0;
+	for (int i = 0; i < 16; ++i) {
+		float r = block[4*i+2] - mean[0], g = block[4*i+1] - mean[1], b = block[4*i+0] - mean[2];
+		cov_rg += r*g; cov_rb += r*b; cov_gb += g*b;
+	}
+	// red decides unless it hardly varies, in which case green does
+	bool by_red = hi[0] - lo[0] >= std::max(hi[1] - lo[1],hi[2] - lo[2])/2;
+	if (by_red ? cov_rg < 0 : false)
+		std::swap(lo[1],hi[1]);
+	if (by_red ? cov_rb < 0 : cov_gb < 0)
+		std::swap(lo[2],hi[2]);
+
+	// inset by 1/16 of the range, which lowers the error at the ends
+	for (int c = 0; c < 3; ++c) {
+		int inset = (hi[c] - lo[c])/16;
+		hi[c] -= inset;
+		lo[c] += inset;
+	}
+
+	unsigned short c0 = pack565(hi), c1 = pack565(lo);
+	unsigned indices = 0;
+	if (c0 != c1) {
+		if (c0 < c1)
+			std::swap(c0,c1);  // c0 > c1 selects the four-colour mode
+		int palette[4][3];
+		unpack565(c0,palette[0]);
+		unpack565(c1,palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (2*palette[0][c] + palette[1][c])/3;
+			palette[3][c] = (palette[0][c] + 2*palette[1][c])/3;
+		}
+		for (int i = 0; i < 16; ++i) {
+			int rgb[3] = { block[4*i+2], block[4*i+1], block[4*i+0] };
+			int best = 0, best_err = 1 << 30;
+			for (int k = 0; k < 4; ++k) {
+				int dr = rgb[0] - palette[k][0], dg = rgb[1] - palette[k][1], db = rgb[2] - palette[k][2];
+				int err = dr*dr + dg*dg + db*db;
+				if (err < best_err) {
+					best_err = err;
+					best = k;
+				}
+			}
+			indices |= (unsigned)best << (2*i);
+		}
+	}
+	out[0] = (unsigned char)c0; out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)c1; out[3] = (unsigned char)(c1 >> 8);
+	for (int k = 0; k < 4; ++k)
+		out[4+k] = (unsigned char)(indices >> (8*k));
+}
+
+// one channel (byte 'channel' of each texel) as an 8-value BC4 block; also BC3's alpha
+static void encode_bc4(const unsigned char* block, int channel, unsigned char* out)
+{
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; ++i) {
+		lo = std::min(lo,(int)block[4*i + channel]);
+		hi = std::max(hi,(int)block[4*i + channel]);
+	}
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+
+	unsigned long long indices = 0;
+	if (hi > lo) {
+		// values run a0, a1, then 6 steps from a0 to a1; map the nearest step to its index
+		static const int step_index[8] = { 0,2,3,4,5,6,7,1 };
+		for (int i = 0; i < 16; ++i) {
+			int v = block[4*i + channel];
+			int step = ((hi - v)*7 + (hi - lo)/2)/(hi - lo);  // 0 at hi .. 7 at lo
+			indices |= (unsigned long long)step_index[step] << (3*i);
+		}
+	}
+	for (int k = 0; k < 6; ++k)
+		out[2+k] = (unsigned char)(indices >> (8*k));
+}
+
+static int block_bytes(int format)
+{
+	return format == TEXCOOK_BC3 ? 16 : 8;
+}
+
+// level_bytes
+//    The size of a level's blocks, as encode_level makes them for the
+//    mip chain of a wd x ht texture.
+//
+static size_t level_bytes(int format, int wd, int ht, int level)
+{
+	int w = std::max(wd >> level,1), h = std::max(ht >> level,1);
+	return (size_t)((w + 3)/4)*((h + 3)/4)*block_bytes(format);
+}
+
+static void encode_level(const std::vector<unsigned char>& texels, int wd, int ht, int format, std::vector<unsigned char>& out)
+{
+	int bw = (wd + 3)/4, bh = (ht + 3)/4;
+	out.resize(bw*bh*block_bytes(format));
+	unsigned char* dst = &out[0];
+	unsigned char block[64];
+	for (int by = 0; by < bh; ++by)
+		for (int bx = 0; bx < bw; ++bx) {
+			// gather, repeating the last row and column of levels smaller than a block
+			for (int y = 0; y < 4; ++y)
+				for (int x = 0; x < 4; ++x) {
+					int sx = std::min(4*bx + x,wd-1), sy = std::min(4*by + y,ht-1);
+					memcpy(block + 4*(4*y + x),&texels[4*(wd*sy + sx)],4);
+				}
+			if (format == TEXCOOK_BC1) {
+				encode_bc1(block,dst);
+			} else if (format == TEXCOOK_BC3) {
+				encode_bc4(block,3,dst);   // alpha
+				encode_bc1(block,dst + 8);
+			} else {
+				encode_bc4(block,2,dst);   // red, which is as good as any channel of a grey image
+			}
+			dst += block_bytes(format);
+		}
+}
+
+//////////////////////////////////////////////////////////////////
+
+int texcook_choose_format(const bitmap* bm)
+{
+	bool grey = true;
+	const unsigned char* p = bm->pixels;
+	for (int i = 0; i < bm->wd*bm->ht; ++i, p += 4) {
+		if (p[3] != 255)
+			return TEXCOOK_BC3;
+		if (p[0] != p[1] || p[1] != p[2])
+			grey = false;
+	}
+	return grey ? TEXCOOK_BC4 : TEXCOOK_BC1;
+}
+
+cooked_texture* texcook_cook(const bitmap* bm, int format, bool srgb)
+{
+	init_tables();
+
+	cooked_texture* ct = new cooked_texture;
+	ct->wd = bm->wd;
+	ct->ht = bm->ht;
+	ct->format = format;
+	ct->source_size = ct->source_time = 0;
+
+	mip_image level, next;
+	to_float(bm,srgb,level);
+	std::vector<unsigned char> texels(bm->pixels,bm->pixels + 4*bm->wd*bm->ht);  // level 0 as it was
+	for (;;) {
+		ct->levels.push_back(std::vector<unsigned char>());
+		encode_level(texels,level.wd,level.ht,format,ct->levels.back());
+		if (level.wd == 1 && level.ht == 1)
+			break;
+		downsample(level,next);
+		std::swap(level,next);
+		to_bytes(level,srgb,texels);
+	}
+	return ct;
+}
+
+bool texcook_save(const cooked_texture* ct, const char* filename)
+{
+	FILE* fh;
+	if (fopen_s(&fh,filename,"wb") != 0)
+		return false;
+	unsigned header[8] = { TEXCOOK_MAGIC, TEXCOOK_VERSION, (unsigned)ct->format, (unsigned)ct->wd, (unsigned)ct->ht,
+	                       (unsigned)ct->levels.size(), ct->source_size, ct->source_time };
+	bool ok = fwrite(header,sizeof(header),1,fh) == 1;
+	for (size_t i = 0; ok && i < ct->levels.size(); ++i) {
+		unsigned size = (unsigned)ct->levels[i].size();
+		ok = fwrite(&size,sizeof(size),1,fh) == 1 && fwrite(&ct->levels[i][0],1,size,fh) == size;
+	}
+	fclose(fh);
+	if (!ok)
+		remove(filename);  // better no cache than a truncated one
+	return ok;
+}
+
+cooked_texture* texcook_load(const char* filename)
+{
+	FILE* fh;
+	if (fopen_s(&fh,filename,"rb") != 0)
+		return 0;
+	unsigned header[8];
+	if (fread(header,sizeof(header),1,fh) != 1 || header[0] != TEXCOOK_MAGIC || header[1] != TEXCOOK_VERSION || header[2] > TEXCOOK_BC4
+	    || header[3] < 1 || header[3] > TEXCOOK_MAX_SIDE || header[4] < 1 || header[4] > TEXCOOK_MAX_SIDE) {
+		fclose(fh);
+		return 0;
+	}
+	int format = (int)header[2], wd = (int)header[3], ht = (int)header[4];
+
+	// no more levels than the full chain, and the file as long as they add up to
+	int max_levels = 1;
+	while ((std::max(wd,ht) >> max_levels) > 0)
+		max_levels++;
+	unsigned levels = header[5];
+	size_t expected = sizeof(header);
+	for (unsigned i = 0; i < levels && i < (unsigned)max_levels; ++i)
+		expected += sizeof(unsigned) + level_bytes(format,wd,ht,i);
+	long length = -1;
+	if (fseek(fh,0,SEEK_END) == 0) {
+		length = ftell(fh);
+		fseek(fh,sizeof(header),SEEK_SET);
+	}
+	if (levels < 1 || levels > (unsigned)max_levels || length < 0 || (size_t)length != expected) {
+		fclose(fh);
+		return 0;
+	}
+
+	cooked_texture* ct = new cooked_texture;
+	ct->format = format;
+	ct->wd = wd;
+	ct->ht = ht;
+	ct->levels.resize(levels);
+	ct->source_size = header[6];
+	ct->source_time = header[7];
+	bool ok = true;
+	for (size_t i = 0; ok && i < ct->levels.size(); ++i) {
+		unsigned size = 0;
+		ok = fread(&size,sizeof(size),1,fh) == 1 && size == level_bytes(format,wd,ht,(int)i);
+		if (ok) {
+			ct->levels[i].resize(size);
+			ok = fread(&ct->levels[i][0],1,size,fh) == size;
+		}
+	}
+	fclose(fh);
+	if (!ok) {
+		delete ct;
+		return 0;
+	}
+	return ct;
+}
+
+cooked_texture* texcook_cached(const char* source)
+{
+	struct stat st;
+	if (stat(source,&st) != 0)
+		return 0;
+	unsigned size = (unsigned)st.st_size, time = (unsigned)st.st_mtime;
+
+	std::string cache = std::string(source) + ".cooked";
+	cooked_texture* ct = texcook_load(cache.c_str());
+	if (ct && ct->source_size == size && ct->source_time == time)
+		return ct;
+	delete ct;
+
+	bitmap* bm = bitmap_load(source);
+	ct = texcook_cook(bm,texcook_choose_format(bm));
+	bitmap_delete(bm);
+	ct->source_size = size;
+	ct->source_time = time;
+	texcook_save(ct,cache.c_str());
+	return ct;
+}
+
+static bool has_extension(const char* name)
+{
+	if (gl3wIsSupported(3,0)) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS,&count);
+		for (GLint i = 0; i < count; ++i)
+			if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS,i),name))
+				return true;
+		return false;
+	}
+	const char* all = (const char*)glGetString(GL_EXTENSIONS);
+	return all && strstr(all,name);
+}
+
+unsigned texcook_upload(const cooked_texture* ct)
+{
+	GLenum internal_format;
+	if (ct->format == TEXCOOK_BC4) {
+		if (!gl3wIsSupported(3,3))
+			return 0;  // would read as red only
+		internal_format = GL_COMPRESSED_RED_RGTC1;
+	} else {
+		static int s3tc = -1;
+		if (s3tc < 0)
+			s3tc = has_extension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+		if (!s3tc)
+			return 0;
+		internal_format = ct->format == TEXCOOK_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+
+	GLuint texid = 0;
+	glGenTextures(1,&texid);
+	glBindTexture(GL_TEXTURE_2D,texid);
+	int wd = ct->wd, ht = ct->ht;
+	for (size_t i = 0; i < ct->levels.size(); ++i) {
+		glCompressedTexImage2D(GL_TEXTURE_2D,(GLint)i,internal_format,wd,ht,0,(GLsizei)ct->levels[i].size(),&ct->levels[i][0]);
+		wd = std::max(wd/2,1);
+		ht = std::max(ht/2,1);
+	}
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,(GLint)ct->levels.size()-1);
+	if (ct->format == TEXCOOK_BC4) {
+		GLint grey[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		glTexParameteriv(GL_TEXTURE_2D,GL_TEXTURE_SWIZZLE_RGBA,grey);
+	}
+	return texid;
+}
+
+void texcook_delete(cooked_texture* ct)
+{
+	delete ct;
+}
@@ -0,0 +1,70 @@
+#ifndef __TEXCOOK_H__
+#define __TEXCOOK_H__
+
+// texcook.h
+//    Texture cooking. A bitmap is turned into a full mip chain, filtered
+//    on the CPU in linear light (sRGB colours are decoded first, and
+//    colours are weighted by alpha so that transparent texels do not
+//    bleed), and each level is block-compressed:
+//
+//       BC1 (S3TC DXT1)  RGB, 4 bits per texel
+//       BC3 (S3TC DXT5)  RGBA, 8 bits per texel
+//       BC4 (RGTC1)      one channel, 4 bits per texel; greyscale images
+//
+//    The result is cached next to the source as <source>.cooked, tagged
+//    with the source file's size and time, so later loads skip decoding
+//    and filtering altogether and upload the compressed levels directly.
+
+#include "cs3388lib.h"
+#include <vector>
+
+#define TEXCOOK_BC1  0
+#define TEXCOOK_BC3  1
+#define TEXCOOK_BC4  2
+
+struct cooked_texture {
+	int wd, ht;                   // of level 0
+	int format;                   // TEXCOOK_BC1, _BC3 or _BC4
+	unsigned source_size;         // of the file it was cooked from, to tell when it is stale
+	unsigned source_time;
+	std::vector<std::vector<unsigned char> > levels;  // compressed blocks, level 0 first
+};
+
+// texcook_choose_format
+//    BC3 if any texel is not opaque, BC4 if every texel is grey, else BC1.
+//
+int texcook_choose_format(const bitmap* bm);
+
+// texcook_cook
+//    Builds and compresses the mip chain. With 'srgb' colour channels are
+//    filtered in linear light; pass false for data such as heights.
+//
+cooked_texture* texcook_cook(const bitmap* bm, int format, bool srgb = true);
+
+// texcook_save, texcook_load
+//    Write and read the container; texcook_load returns 0 if the file is
+//    missing, not a cooked texture, or has levels that do not match its
+//    size and format (a truncated or corrupt cache is cooked again).
+//
+bool texcook_save(const cooked_texture* ct, const char* filename);
+cooked_texture* texcook_load(const char* filename);
+
+// texcook_cached
+//    The cooked version of image file 'source': loaded from its cache if
+//    that is up to date, otherwise cooked (in a format chosen by
+//    texcook_choose_format) and saved for next time.
+//
+cooked_texture* texcook_cached(const char* source);
+
+// texcook_upload
+//    Creates a GL texture with every level, or returns 0 if the driver
+//    cannot sample the format. BC4 textures read as (r,r,r,1) where
+//    texture swizzles are available (OpenGL 3.3).
+//
+unsigned texcook_upload(const cooked_texture* ct);
+
+// texcook_delete
+//
+void texcook_delete(cooked_texture* ct);
+
+#endif // __TEXCOOK_H__
@@ -0,0 +1,283 @@
+#include "text.h"
+#include "shaders.h"
+#include "gl3w.h"
+#include "glut.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#define ATLAS_COLUMNS  16
+#define ATLAS_ROWS     ((TEXT_LAST_CHAR - TEXT_FIRST_CHAR + ATLAS_COLUMNS) / ATLAS_COLUMNS)
+#define ATLAS_WD       (ATLAS_COLUMNS*TEXT_CHAR_WD)
+#define ATLAS_HT       (ATLAS_ROWS*TEXT_CHAR_HT)
+#define FONT_DESCENT   2       // pixel rows of each glyph below its baseline
+
+// The 8x13 fixed font (X11 misc-fixed, which GLUT_BITMAP_8_BY_13 also
+// draws), one byte per pixel row, bottom row first, leftmost pixel in
+// the high bit, for TEXT_FIRST_CHAR to TEXT_LAST_CHAR.
+static const unsigned char sFont[TEXT_LAST_CHAR - TEXT_FIRST_CHAR + 1][TEXT_CHAR_HT] = {
+	{ 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00 },   // ' '
+	{ 0x00,0x00,0x10,0x00,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x00,0x00 },   // !
+	{ 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x24,0x24,0x24,0x00,0x00 },   // "
+	{ 0x00,0x00,0x00,0x24,0x24,0x7e,0x24,0x7e,0x24,0x24,0x00,0x00,0x00 },   // #
+	{ 0x00,0x00,0x10,0x78,0x14,0x14,0x38,0x50,0x50,0x3c,0x10,0x00,0x00 },   // $
+	{ 0x00,0x00,0x44,0x2a,0x24,0x10,0x08,0x08,0x24,0x52,0x22,0x00,0x00 },   // %
+	{ 0x00,0x00,0x3a,0x44,0x4a,0x30,0x48,0x48,0x30,0x00,0x00,0x00,0x00 },   // &
+	{ 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x40,0x30,0x38,0x00,0x00 },   // '
+	{ 0x00,0x00,0x04,0x08,0x08,0x10,0x10,0x10,0x08,0x08,0x04,0x00,0x00 },   // (
+	{ 0x00,0x00,0x20,0x10,0x10,0x08,0x08,0x08,0x10,0x10,0x20,0x00,0x00 },   // )
+	{ 0x00,0x00,0x00,0x00,0x24,0x18,0x7e,0x18,0x24,0x00,0x00,0x00,0x00 },   // *
+	{ 0x00,0x00,0x00,0x00,0x10,0x10,0x7c,0x10,0x10,0x00,0x00,0x00,0x00 },   // +
+	{ 0x00,0x40,0x30,0x38,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00 },   // ,
+	{ 0x00,0x00,0x00,0x00,0x00,0x00,0x7e,0x00,0x00,0x00,0x00,0x00,0x00 },   // -
+	{ 0x00,0x10,0x38,0x10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00 },   // .
+	{ 0x00,0x00,0x80,0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x02,0x00,0x00 },   // /
+	{ 0x00,0x00,0x18,0x24,0x42,0x42,0x42,0x42,0x42,0x24,0x18,0x00,0x00 },   // 0
+	{ 0x00,0x00,0x7c,0x10,0x10,0x10,0x10,0x10,0x50,0x30,0x10,0x00,0x00 },   // 1
+	{ 0x00,0x00,0x7e,0x40,0x20,0x18,0x04,0x02,0x42,0x42,0x3c,0x00,0x00 },   // 2
+	{ 0x00,0x00,0x3c,0x42,0x02,0x02,0x1c,0x08,0x04,0x02,0x7e,0x00,0x00 },   // 3
+	{ 0x00,0x00,0x04,0x04,0x7e,0x44,0x44,0x24,0x14,0x0c,0x04,0x00,0x00 },   // 4
+	{ 0x00,0x00,0x3c,0x42,0x02,0x02,0x62,0x5c,0x40,0x40,0x7e,0x00,0x00 },   // 5
+	{ 0x00,0x00,0x3c,0x42,0x42,0x62,0x5c,0x40,0x40,0x20,0x1c,0x00,0x00 },   // 6
+	{ 0x00,0x00,0x20,0x20,0x10,0x10,0x08,0x08,0x04,0x02,0x7e,0x00,0x00 },   // 7
+	{ 0x00,0x00,0x3c,0x42,0x42,0x42,0x3c,0x42,0x42,0x42,0x3c,0x00,0x00 },   // 8
+	{ 0x00,0x00,0x38,0x04,0x02,0x02,0x3a,0x46,0x42,0x42,0x3c,0x00,0x00 },   // 9
+	{ 0x00,0x10,0x38,0x10,0x00,0x00,0x10,0x38,0x10,0x00,0x00,0x00,0x00 },   // :
+	{ 0x00,0x40,0x30,0x38,0x00,0x00,0x10,0x38,0x10,0x00,0x00,0x00,0x00 },   // ;
+	{ 0x00,0x00,0x02,0x04,0x08,0x10,0x20,0x10,0x08,0x04,0x02,0x00,0x00 },   // <
+	{ 0x00,0x00,0x00,0x00,0x7e,0x00,0x00,0x7e,0x00,0x00,0x00,0x00,0x00 },   // =
+	{ 0x00,0x00,0x40,0x20,0x10,0x08,0x04,0x08,0x10,0x20,0x40,0x00,0x00 },   // >
+	{ 0x00,0x00,0x08,0x00,0x08,0x08,0x04,0x02,0x42,0x42,0x3c,0x00,0x00 },   // ?
+	{ 0x00,0x00,0x3c,0x40,0x4a,0x56,0x52,0x4e,0x42,0x42,0x3c,0x00,0x00 },   // @
+	{ 0x00,0x00,0x42,0x42,0x42,0x7e,0x42,0x42,0x42,0x24,0x18,0x00,0x00 },   // A
+	{ 0x00,0x00,0xfc,0x42,0x42,0x42,0x7c,0x42,0x42,0x42,0xfc,0x00,0x00 },   // B
+	{ 0x00,0x00,0x3c,0x42,0x40,0x40,0x40,0x40,0x40,0x42,0x3c,0x00,0x00 },   // C
+	{ 0x00,0x00,0xfc,0x42,0x42,0x42,0x42,0x42,0x42,0x42,0xfc,0x00,0x00 },   // D
+	{ 0x00,0x00,0x7e,0x40,0x40,0x40,0x78,0x40,0x40,0x40,0x7e,0x00,0x00 },   // E
+	{ 0x00,0x00,0x40,0x40,0x40,0x40,0x78,0x40,0x40,0x40,0x7e,0x00,0x00 },   // F
+	{ 0x00,0x00,0x3a,0x46,0x42,0x4e,0x40,0x40,0x40,0x42,0x3c,0x00,0x00 },   // G
+	{ 0x00,0x00,0x42,0x42,0x42,0x42,0x7e,0x42,0x42,0x42,0x42,0x00,0x00 },   // H
+	{ 0x00,0x00,0x7c,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x7c,0x00,0x00 },   // I
+	{ 0x00,0x00,0x38,0x44,0x04,0x04,0x04,0x04,0x04,0x04,0x1f,0x00,0x00 },   // J
+	{ 0x00,0x00,0x42,0x44,0x48,0x50,0x60,0x50,0x48,0x44,0x42,0x00,0x00 },   // K
+	{ 0x00,0x00,0x7e,0x40,0x40,0x40,0x40,0x40,0x40,0x40,0x40,0x00,0x00 },   // L
+	{ 0x00,0x00,0x82,0x82,0x82,0x92,0x92,0xaa,0xc6,0x82,0x82,0x00,0x00 },   // M
+	{ 0x00,0x00,0x42,0x42,0x42,0x46,0x4a,0x52,0x62,0x42,0x42,0x00,0x00 },   // N
+	{ 0x00,0x00,0x3c,0x42,0x42,0x42,0x42,0x42,0x42,0x42,0x3c,0x00,0x00 },   // O
+	{ 0x00,0x00,0x40,0x40,0x40,0x40,0x7c,0x42,0x42,0x42,0x7c,0x00,0x00 },   // P
+	{ 0x00,0x02,0x3c,0x4a,0x52,0x42,0x42,0x42,0x42,0x42,0x3c,0x00,0x00 },   // Q
+	{ 0x00,0x00,0x42,0x44,0x48,0x50,0x7c,0x42,0x42,0x42,0x7c,0x00,0x00 },   // R
+	{ 0x00,0x00,0x3c,0x42,0x02,0x02,0x3c,0x40,0x40,0x42,0x3c,0x00,0x00 },   // S
+	{ 0x00,0x00,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0xfe,0x00,0x00 },   // T
+	{ 0x00,0x00,0x3c,0x42,0x42,0x42,0x42,0x42,0x42,0x42,0x42,0x00,0x00 },   // U
+	{ 0x00,0x00,0x10,0x28,0x28,0x28,0x44,0x44,0x44,0x82,0x82,0x00,0x00 },   // V
+	{ 0x00,0x00,0x44,0xaa,0x92,0x92,0x92,0x82,0x82,0x82,0x82,0x00,0x00 },   // W
+	{ 0x00,0x00,0x82,0x82,0x44,0x28,0x10,0x28,0x44,0x82,0x82,0x00,0x00 },   // X
+	{ 0x00,0x00,0x10,0x10,0x10,0x10,0x10,0x28,0x44,0x82,0x82,0x00,0x00 },   // Y
+	{ 0x00,0x00,0x7e,0x40,0x40,0x20,0x10,0x08,0x04,0x02,0x7e,0x00,0x00 },   // Z
+	{ 0x00,0x00,0x3c,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x3c,0x00,0x00 },   // [
+	{ 0x00,0x00,0x02,0x02,0x04,0x08,0x10,0x20,0x40,0x80,0x80,0x00,0x00 },   // backslash
+	{ 0x00,0x00,0x78,0x08,0x08,0x08,0x08,0x08,0x08,0x08,0x78,0x00,0x00 },   // ]
+	{ 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x44,0x28,0x10,0x00,0x00 },   // ^
+	{ 0x00,0xfe,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00 },   // _
+	{ 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x04,0x18,0x38,0x00,0x00 },   // `
+	{ 0x00,0x00,0x3a,0x46,0x42,0x3e,0x02,0x3c,0x00,0x00,0x00,0x00,0x00 },   // a
+	{ 0x00,0x00,0x5c,0x62,0x42,0x42,0x62,0x5c,0x40,0x40,0x40,0x00,0x00 },   // b
+	{ 0x00,0x00,0x3c,0x42,0x40,0x40,0x42,0x3c,0x00,0x00,0x00,0x00,0x00 },   // c
+	{ 0x00,0x00,0x3a,0x46,0x42,0x42,0x46,0x3a,0x02,0x02,0x02,0x00,0x00 },   // d
+	{ 0x00,0x00,0x3c,0x42,0x40,0x7e,0x42,0x3c,0x00,0x00,0x00,0x00,0x00 },   // e
+	{ 0x00,0x00,0x20,0x20,0x20,0x20,0x7c,0x20,0x20,0x22,0x1c,0x00,0x00 },   // f
+	{ 0x3c,0x42,0x3c,0x40,0x38,0x44,0x44,0x3a,0x00,0x00,0x00,0x00,0x00 },   // g
+	{ 0x00,0x00,0x42,0x42,0x42,0x42,0x62,0x5c,0x40,0x40,0x40,0x00,0x00 },   // h
+	{ 0x00,0x00,0x7c,0x10,0x10,0x10,0x10,0x30,0x00,0x10,0x00,0x00,0x00 },   // i
+	{ 0x38,0x44,0x44,0x04,0x04,0x04,0x04,0x0c,0x00,0x04,0x00,0x00,0x00 },   // j
+	{ 0x00,0x00,0x42,0x44,0x48,0x70,0x48,0x44,0x40,0x40,0x40,0x00,0x00 },   // k
+	{ 0x00,0x00,0x7c,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x30,0x00,0x00 },   // l
+	{ 0x00,0x00,0x82,0x92,0x92,0x92,0x92,0xec,0x00,0x00,0x00,0x00,0x00 },   // m
+	{ 0x00,0x00,0x42,0x42,0x42,0x42,0x62,0x5c,0x00,0x00,0x00,0x00,0x00 },   // n
+	{ 0x00,0x00,0x3c,0x42,0x42,0x42,0x42,0x3c,0x00,0x00,0x00,0x00,0x00 },   // o
+	{ 0x40,0x40,0x40,0x5c,0x62,0x42,0x62,0x5c,0x00,0x00,0x00,0x00,0x00 },   // p
+	{ 0x02,0x02,0x02,0x3a,0x46,0x42,0x46,0x3a,0x00,0x00,0x00,0x00,0x00 },   // q
+	{ 0x00,0x00,0x20,0x20,0x20,0x20,0x22,0x5c,0x00,0x00,0x00,0x00,0x00 },   // r
+	{ 0x00,0x00,0x3c,0x42,0x0c,0x30,0x42,0x3c,0x00,0x00,0x00,0x00,0x00 },   // s
+	{ 0x00,0x00,0x1c,0x22,0x20,0x20,0x20,0x7c,0x20,0x20,0x00,0x00,0x00 },   // t
+	{ 0x00,0x00,0x3a,0x44,0x44,0x44,0x44,0x44,0x00,0x00,0x00,0x00,0x00 },   // u
+	{ 0x00,0x00,0x10,0x28,0x28,0x44,0x44,0x44,0x00,0x00,0x00,0x00,0x00 },   // v
+	{ 0x00,0x00,0x44,0xaa,0x92,0x92,0x82,0x82,0x00,0x00,0x00,0x00,0x00 },   // w
+	{ 0x00,0x00,0x42,0x24,0x18,0x18,0x24,0x42,0x00,0x00,0x00,0x00,0x00 },   // x
+	{ 0x3c,0x42,0x02,0x3a,0x46,0x42,0x42,0x42,0x00,0x00,0x00,0x00,0x00 },   // y
+	{ 0x00,0x00,0x7e,0x20,0x10,0x08,0x04,0x7e,0x00,0x00,0x00,0x00,0x00 },   // z
+	{ 0x00,0x00,0x0e,0x10,0x10,0x08,0x30,0x08,0x10,0x10,0x0e,0x00,0x00 },   // {
+	{ 0x00,0x00,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x00,0x00 },   // |
+	{ 0x00,0x00,0x70,0x08,0x08,0x10,0x0c,0x10,0x08,0x08,0x70,0x00,0x00 },   // }
+	{ 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x48,0x54,0x24,0x00,0x00 },   // ~
+};
+
+struct text_vertex {
+	float x, y;              // window pixels
+	float u, v;              // atlas
+	unsigned char rgba[4];
+};
+
+static GLuint sAtlas = 0;
+static GLuint sProgram = 0;
+static GLuint sVAO = 0;
+static GLuint sVBO = 0;
+static std::vector<text_vertex> sVertices;   // this frame's text, six per character
+
+// draw_atlas
+//    Sets the bits of every glyph into a one-byte-per-texel image on the
+//    CPU and uploads it; no drawing calls, so it works on core profiles.
+//
+static void draw_atlas()
+{
+	// row 0 of the atlas is at the top of the texture, i.e. its last pixel rows
+	std::vector<unsigned char> texels(ATLAS_WD*ATLAS_HT,0);
+	for (int c = TEXT_FIRST_CHAR; c <= TEXT_LAST_CHAR; ++c) {
+		int i = c - TEXT_FIRST_CHAR;
+		int x = (i % ATLAS_COLUMNS)*TEXT_CHAR_WD;
+		int y = (ATLAS_ROWS-1 - i/ATLAS_COLUMNS)*TEXT_CHAR_HT;
+		for (int row = 0; row < TEXT_CHAR_HT; ++row) {
+			unsigned char bits = sFont[i][row];
+			unsigned char* p = &texels[(y + row)*ATLAS_WD + x];
+			for (int col = 0; col < TEXT_CHAR_WD; ++col)
+				p[col] = (bits & (0x80 >> col)) ? 255 : 0;
+		}
+	}
+
+	glGenTextures(1,&sAtlas);
+	glBindTexture(GL_TEXTURE_2D,sAtlas);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+	glTexImage2D(GL_TEXTURE_2D,0,GL_R8,ATLAS_WD,ATLAS_HT,0,GL_RED,GL_UNSIGNED_BYTE,&texels[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+	glBindTexture(GL_TEXTURE_2D,0);
+}
+
+bool text_init()
+{
+	if (!gl3wIsSupported(3,0))
+		return false;
+	draw_atlas();
+
+	// #version 150 for core profiles; 130 reads the same
+	std::string version = gl3wIsSupported(3,2) ? "#version 150\n" : "#version 130\n";
+	std::string vscode = version +
+		"uniform vec2 screen;\n"
+		"in  vec2 position;\n"
+		"in  vec2 texcoord0;\n"
+		"in  vec4 colour0;\n"
+		"out vec2 texcoord;\n"
+		"out vec4 colour;\n"
+		"void main()\n"
+		"{\n"
+		"	gl_Position = vec4(2.0*position.x/screen.x - 1.0, 1.0 - 2.0*position.y/screen.y, 0, 1);\n"
+		"	texcoord = texcoord0;\n"
+		"	colour = colour0;\n"
+		"}\n";
+	std::string fscode = version +
+		"uniform sampler2D atlas;\n"
+		"in  vec2 texcoord;\n"
+		"in  vec4 colour;\n"
+		"out vec4 fragcolor;\n"
+		"void main()\n"
+		"{\n"
+		"	float coverage = texture(atlas,texcoord).r;\n"
+		"	if (coverage < 0.5) discard;\n"
+		"	fragcolor = colour;\n"
+		"}\n";
+	sProgram = shader_create(vscode.c_str(),fscode.c_str());
+
+	glGenVertexArrays(1,&sVAO);
+	glBindVertexArray(sVAO);
+	glGenBuffers(1,&sVBO);
+	glBindBuffer(GL_ARRAY_BUFFER,sVBO);
+	GLint ploc = glGetAttribLocation(sProgram,"position");
+	GLint tloc = glGetAttribLocation(sProgram,"texcoord0");
+	GLint cloc = glGetAttribLocation(sProgram,"colour0");
+	glVertexAttribPointer(ploc,2,GL_FLOAT,GL_FALSE,sizeof(text_vertex),(void*)offsetof(text_vertex,x));
+	glVertexAttribPointer(tloc,2,GL_FLOAT,GL_FALSE,sizeof(text_vertex),(void*)offsetof(text_vertex,u));
+	glVertexAttribPointer(cloc,4,GL_UNSIGNED_BYTE,GL_TRUE,sizeof(text_vertex),(void*)offsetof(text_vertex,rgba));
+	glEnableVertexAttribArray(ploc);
+	glEnableVertexAttribArray(tloc);
+	glEnableVertexAttribArray(cloc);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	return true;
+}
+
+bool text_available()
+{
+	return sProgram != 0;
+}
+
+void text_draw(const char* str, int left, int top, unsigned char r, unsigned char g, unsigned char b)
+{
+	if (!str)
+		return;
+	text_vertex v;
+	v.rgba[0] = r; v.rgba[1] = g; v.rgba[2] = b; v.rgba[3] = 255;
+
+	int x = left, y = top;
+	for (const char* s = str; *s; ++s) {
+		int c = (unsigned char)*s;
+		if (c == '\n') {
+			x = left;
+			y += TEXT_LINE_HT;
+			continue;
+		}
+		if (c > TEXT_FIRST_CHAR && c <= TEXT_LAST_CHAR) {
+			// the cell's corners on screen and in the atlas (whose row 0 is at v = 1)
+			int i = c - TEXT_FIRST_CHAR;
+			float u0 = (float)(i % ATLAS_COLUMNS)/ATLAS_COLUMNS, u1 = u0 + 1.0f/ATLAS_COLUMNS;
+			float v1 = 1 - (float)(i / ATLAS_COLUMNS)/ATLAS_ROWS, v0 = v1 - 1.0f/ATLAS_ROWS;
+			float x0 = (float)x, x1 = x0 + TEXT_CHAR_WD;
+			float y0 = (float)y + FONT_DESCENT, y1 = y0 + TEXT_CHAR_HT;
+			float corners[6][4] = { { x0,y0,u0,v1 }, { x0,y1,u0,v0 }, { x1,y0,u1,v1 },
+			                        { x1,y0,u1,v1 }, { x0,y1,u0,v0 }, { x1,y1,u1,v0 } };
+			for (int k = 0; k < 6; ++k) {
+				v.x = corners[k][0]; v.y = corners[k][1];
+				v.u = corners[k][2]; v.v = corners[k][3];
+				sVertices.push_back(v);
+			}
+		}
+		x += TEXT_CHAR_WD;
+	}
+}
+
+void text_flush()
+{
+	if (sVertices.empty())
+		return;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT,viewport);
+	GLboolean depth = glIsEnabled(GL_DEPTH_TEST), cull = glIsEnabled(GL_CULL_FACE);
+	int window_wd = glutGet(GLUT_WINDOW_WIDTH), window_ht = glutGet(GLUT_WINDOW_HEIGHT);
+	glViewport(0,0,window_wd,window_ht);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+
+	glBindBuffer(GL_ARRAY_BUFFER,sVBO);
+	glBufferData(GL_ARRAY_BUFFER,sVertices.size()*sizeof(text_vertex),&sVertices[0],GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+
+	glUseProgram(sProgram);
+	glUniform2f(glGetUniformLocation(sProgram,"screen"),(float)window_wd,(float)window_ht);
+	glUniform1i(glGetUniformLocation(sProgram,"atlas"),0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D,sAtlas);
+	glBindVertexArray(sVAO);
+	glDrawArrays(GL_TRIANGLES,0,(GLsizei)sVertices.size());
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D,0);
+	glUseProgram(0);
+
+	glViewport(viewport[0],viewport[1],viewport[2],viewport[3]);
+	if (depth) glEnable(GL_DEPTH_TEST);
+	if (cull)  glEnable(GL_CULL_FACE);
+	sVertices.clear();
+}
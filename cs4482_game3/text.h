@@ -0,0 +1,43 @@
+#ifndef __TEXT_H__
+#define __TEXT_H__
+
+// text.h
+//    Batched screen text. The 8x13 fixed font that GLUT's bitmap font
+//    also uses is kept as a table of bits and set into a small glyph
+//    atlas texture once, on the CPU; after that, text is only queued, and
+//    all of a frame's text goes to the GPU as one vertex buffer and one
+//    draw call, with shaders that also work on core profiles. Needs
+//    OpenGL 3.0.
+
+#define TEXT_CHAR_WD     8      // pixels per character cell
+#define TEXT_CHAR_HT     13
+#define TEXT_LINE_HT     14     // from one line to the next
+#define TEXT_FIRST_CHAR  32     // ' ', the first character in the atlas
+#define TEXT_LAST_CHAR   126    // '~', the last
+
+// text_init
+//    Builds the atlas, the program and the buffers; returns false if
+//    OpenGL 3.0 is missing, in which case nothing else may be called.
+//    Call once.
+//
+bool text_init();
+
+// text_available
+//    Whether text_init succeeded.
+//
+bool text_available();
+
+// text_draw
+//    Queues 'str' with its top-left corner at (left,top) in window
+//    pixels, coloured (r,g,b); '\n' starts a new line under 'left'.
+//    Characters outside the atlas are left blank.
+//
+void text_draw(const char* str, int left, int top, unsigned char r, unsigned char g, unsigned char b);
+
+// text_flush
+//    Draws everything queued since the last flush over whatever is in
+//    the framebuffer. Call once a frame, after the scene.
+//
+void text_flush();
+
+#endif // __TEXT_H__
@@ -4,9 +4,6 @@
 #include "cs3388lib.h"
 
 
-#define MAX_HEIGHT			10
-#define INVERSE_MAX_HEIGHT	0.1
-#define INVERSE256			0.00390625
 #define PI					3.14159265359f
 
 vertex interp(float alpha, float beta, vertex a, vertex b, vertex c)
@@ -117,54 +114,30 @@ triangles create_sphere(int segs, float radius)
 }
 
 
-float height(bitmap* hm, int x, int z) {
-	int p = 4 * ((z+32)*hm->wd + (x+32));
-	float h = hm->pixels[p] * INVERSE256;
-	return MAX_HEIGHT * h;
-}
-
-triangles create_heightmap(bitmap* hm){
-	triangles heightmap;
-
-	for (int z = -32; z < 31; z++) {
-
-		for (int x = -32; x < 31; x++) {
-			
-			vec4 p[4] = {	vec4((float)x,		height(hm, x,z),		(float)z,		1),
-							vec4((float)x,		height(hm, x,z+1),		(float)(z+1),	1),
-							vec4((float)(x+1),	height(hm, x+1,z+1),	(float)(z+1),	1),
-							vec4((float)(x+1),	height(hm, x+1,z),		(float)z,		1)
-			};
-			
-			// compute normals incorrectly
-			vec4 n[4];
-			for (int k = 0; k < 4; ++k) {
-				//vec3 v1 = vec3(
-
-				//n[k]	= cross(
-				n[k]	= vec4(0,1,0,1);
-				//n[k]	= vec4(n[k].x, n[k].y, n[k].z, 1);
-			}
-
-
-			// uv coordinates for textures.
-			vec2 uv[4] = {	vec2(0,0),
-							vec2(0,1),
-							vec2(1,1),
-							vec2(1,0)
-			};
-
-
-			// record the four points of the quad
-			triangles face = create_quad(vertex(p[0],n[0],uv[0]),
-			                             vertex(p[1],n[1],uv[1]),
-			                             vertex(p[2],n[2],uv[2]),
-			                             vertex(p[3],n[3],uv[3])
-										);
-			append(heightmap,face);
- 		}
+void bounding_sphere(const triangles& tri, vec4& center, float& radius)
+{
+	center = vec4(0,0,0,1);
+	radius = 0;
+	if (tri.empty())
+		return;
+
+	// center the sphere on the bounding box, then grow it to reach the furthest point
+	vec4 bmin = tri[0].p, bmax = tri[0].p;
+	for (size_t i = 1; i < tri.size(); ++i) {
+		for (int k = 0; k < 3; ++k) {
+			if (tri[i].p[k] < bmin[k]) bmin[k] = tri[i].p[k];
+			if (tri[i].p[k] > bmax[k]) bmax[k] = tri[i].p[k];
+		}
+	}
+	center = 0.5f*(bmin + bmax);
+	center.w = 1;
+	for (size_t i = 0; i < tri.size(); ++i) {
+		vec4 d = tri[i].p - center;
+		d.w = 0;
+		float r = norm(d);
+		if (r > radius)
+			radius = r;
 	}
-	return heightmap;
 }
 
 
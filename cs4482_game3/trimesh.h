@@ -37,14 +37,15 @@ triangles create_triangle(vertex a, vertex b, vertex c);
 // create a single quad with (a,b,c,d) in counter-clockwise order when viewed from front
 triangles create_quad(vertex a, vertex b, vertex c, vertex d);
 
-triangles create_heightmap(bitmap* hm);
-
 // create a 6-sided 2x2x2 box centered at (0,0,0);
 triangles create_box();
 
 // create a sphere of radius 1 where 'segs' controls the number of segments;
 triangles create_sphere(int segs = 12, float radius = 1.0f);
 
+// compute a sphere (center,radius) enclosing every vertex of the triangle list
+void bounding_sphere(const triangles& tri, vec4& center, float& radius);
+
 // load a triangle list from an obj file; simplified in the following sense:
 //   - all material information is ignored
 //   - all faces in the mesh must be CONVEX, since the import code is 